@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2011 Red Hat, Inc.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 2 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Generates the files the preview benchmark runs on.
+
+Everything is synthesized, so that runs on different machines preview
+the same content. The corpus is described by manifest.json, which lists
+every file along with the kind it is reported under.
+"""
+
+import argparse
+import glob
+import json
+import math
+import os
+import shutil
+import struct
+import wave
+import zlib
+
+
+def write_png(path, width, height):
+    def chunk(kind, data):
+        body = kind + data
+        return (struct.pack('>I', len(data)) + body +
+                struct.pack('>I', zlib.crc32(body) & 0xffffffff))
+
+    compressor = zlib.compressobj(1)
+
+    with open(path, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n')
+        f.write(chunk(b'IHDR', struct.pack('>IIBBBBB', width, height,
+                                           8, 2, 0, 0, 0)))
+
+        # a gradient, so the image doesn't compress to nothing
+        row = bytes((x * 255 // width) for x in range(width))
+        data = bytearray()
+        for y in range(height):
+            shade = y * 255 // height
+            line = bytearray(1 + width * 3)
+            line[1::3] = row
+            line[2::3] = bytes([shade]) * width
+            line[3::3] = row[::-1]
+            data += compressor.compress(bytes(line))
+
+            if len(data) > (1 << 20):
+                f.write(chunk(b'IDAT', bytes(data)))
+                data = bytearray()
+
+        data += compressor.flush()
+        f.write(chunk(b'IDAT', bytes(data)))
+        f.write(chunk(b'IEND', b''))
+
+
+def write_text(path, size):
+    line = b'The quick brown fox jumps over the lazy dog. 0123456789\n'
+    block = line * (65536 // len(line))
+
+    with open(path, 'wb') as f:
+        written = 0
+        while written < size:
+            data = block[:size - written]
+            f.write(data)
+            written += len(data)
+
+
+def write_pdf(path, n_pages):
+    objects = []
+
+    def add(body):
+        objects.append(body)
+        return len(objects)
+
+    catalog = add(None)
+    pages = add(None)
+    font = add(b'<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>')
+
+    kids = []
+    for page in range(n_pages):
+        text = b'\n'.join(b'0 -16 Td (Page %d, line %d of the benchmark document.) Tj'
+                          % (page + 1, line) for line in range(40))
+        stream = b'BT /F1 11 Tf 56 800 Td ' + text + b' ET'
+        contents = add(b'<< /Length %d >>\nstream\n%s\nendstream' % (len(stream), stream))
+        kids.append(add(b'<< /Type /Page /Parent %d 0 R /MediaBox [0 0 595 842] '
+                        b'/Resources << /Font << /F1 %d 0 R >> >> /Contents %d 0 R >>'
+                        % (pages, font, contents)))
+
+    objects[catalog - 1] = b'<< /Type /Catalog /Pages %d 0 R >>' % pages
+    objects[pages - 1] = (b'<< /Type /Pages /Count %d /Kids [%s] >>'
+                          % (n_pages, b' '.join(b'%d 0 R' % kid for kid in kids)))
+
+    with open(path, 'wb') as f:
+        f.write(b'%PDF-1.4\n')
+
+        offsets = []
+        for idx, body in enumerate(objects):
+            offsets.append(f.tell())
+            f.write(b'%d 0 obj\n%s\nendobj\n' % (idx + 1, body))
+
+        xref = f.tell()
+        f.write(b'xref\n0 %d\n0000000000 65535 f \n' % (len(objects) + 1))
+        for offset in offsets:
+            f.write(b'%010d 00000 n \n' % offset)
+        f.write(b'trailer\n<< /Size %d /Root %d 0 R >>\nstartxref\n%d\n%%%%EOF\n'
+                % (len(objects) + 1, catalog, xref))
+
+
+def write_wav(path, seconds):
+    rate = 44100
+
+    with wave.open(path, 'wb') as f:
+        f.setnchannels(2)
+        f.setsampwidth(2)
+        f.setframerate(rate)
+
+        period = [int(16000 * math.sin(2 * math.pi * 440 * i / rate))
+                  for i in range(rate // 10)]
+        frames = b''.join(struct.pack('<hh', s, s) for s in period)
+        for i in range(seconds * 10):
+            f.writeframes(frames)
+
+
+def write_tree(path, depth, fanout):
+    os.makedirs(path)
+
+    for idx in range(fanout):
+        with open(os.path.join(path, 'file-%d.txt' % idx), 'w') as f:
+            f.write('x' * 4096)
+
+    if depth > 0:
+        for idx in range(fanout):
+            write_tree(os.path.join(path, 'dir-%d' % idx), depth - 1, fanout)
+
+
+def find_font():
+    for pattern in ('/usr/share/fonts/**/*.ttf', '/usr/share/fonts/**/*.otf'):
+        fonts = sorted(glob.glob(pattern, recursive=True))
+        if fonts:
+            return fonts[0]
+
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('directory')
+    parser.add_argument('--large', action='store_true',
+                        help='also generate gigabyte-scale files')
+    args = parser.parse_args()
+
+    os.makedirs(args.directory, exist_ok=True)
+    entries = []
+
+    def add(kind, name, generate, *params):
+        path = os.path.join(args.directory, name)
+        if not os.path.exists(path):
+            print('Generating %s' % name)
+            generate(path, *params)
+        entries.append({ 'kind': kind, 'path': os.path.abspath(path) })
+
+    for size in (64, 1024, 4096, 8192) + ((16384,) if args.large else ()):
+        add('image', 'image-%d.png' % size, write_png, size, size)
+
+    for size in (1 << 10, 1 << 20, 100 << 20) + ((1 << 30,) if args.large else ()):
+        add('text', 'text-%d.txt' % size, write_text, size)
+
+    for n_pages in (1, 100, 1000) + ((10000,) if args.large else ()):
+        add('pdf', 'document-%d.pdf' % n_pages, write_pdf, n_pages)
+
+    add('audio', 'tone-10s.wav', write_wav, 10)
+    add('audio', 'tone-600s.wav', write_wav, 600)
+
+    add('folder', 'tree-shallow', write_tree, 1, 8)
+    add('folder', 'tree-deep', write_tree, 6, 4)
+
+    font = find_font()
+    if font:
+        add('font', 'font' + os.path.splitext(font)[1],
+            lambda path: shutil.copyfile(font, path))
+    else:
+        print('No font found to add to the corpus')
+
+    with open(os.path.join(args.directory, 'manifest.json'), 'w') as f:
+        json.dump({ 'entries': entries }, f, indent=2)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Runs the preview benchmark on a private session bus and a virtual X
+# server, so that it neither needs nor disturbs a desktop session.
+#
+#   SUSHI               the sushi launcher to benchmark (default: sushi)
+#   BENCH_CORPUS        where to generate the corpus (default: bench-corpus)
+#   BENCH_REPORT        where to write the report (default: bench-report.json)
+#   BENCH_LARGE         set to also generate gigabyte-scale files
+#   BENCH_FLAGS         extra arguments for sushi-bench.py, e.g.
+#                       "--compare old-report.json" or "--kind pdf"
+
+set -e
+
+srcdir=`dirname "$0"`
+
+for tool in dbus-run-session xvfb-run gdbus python3; do
+    if ! command -v $tool > /dev/null 2>&1; then
+        echo "$0: $tool is needed to run the benchmark" >&2
+        exit 1
+    fi
+done
+
+corpus=${BENCH_CORPUS:-bench-corpus}
+report=${BENCH_REPORT:-bench-report.json}
+
+python3 "$srcdir/make-corpus.py" ${BENCH_LARGE:+--large} "$corpus"
+
+exec dbus-run-session -- \
+    xvfb-run -a -s "-screen 0 1600x1200x24" \
+    python3 "$srcdir/sushi-bench.py" --sushi "${SUSHI:-sushi}" \
+        --corpus "$corpus" --output "$report" $BENCH_FLAGS
@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2011 Red Hat, Inc.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 2 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Measures how fast sushi previews each file of a corpus.
+
+Every file is previewed twice: by a freshly started sushi (cold), then
+again by the same, already running one (warm). For each run, the time
+to the first frame and the other phases come from GetLastPreviewTimings,
+while the peak RSS and the CPU time used come from /proc.
+
+This expects to run on its own session bus and X server already, which
+is what run-bench.sh sets up.
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+BUS_NAME = 'org.gnome.NautilusPreviewer'
+OBJECT_PATH = '/org/gnome/NautilusPreviewer'
+
+CLOCK_TICKS = os.sysconf('SC_CLK_TCK')
+
+
+def gdbus_call(dest, path, method, *args):
+    output = subprocess.check_output(['gdbus', 'call', '--session',
+                                      '--dest', dest,
+                                      '--object-path', path,
+                                      '--method', method] + list(args),
+                                     stderr=subprocess.DEVNULL)
+    return output.decode('utf-8').strip()
+
+
+def name_has_owner():
+    output = gdbus_call('org.freedesktop.DBus', '/org/freedesktop/DBus',
+                        'org.freedesktop.DBus.NameHasOwner', BUS_NAME)
+    return output == '(true,)'
+
+
+def get_timings():
+    output = gdbus_call(BUS_NAME, OBJECT_PATH,
+                        BUS_NAME + '.GetLastPreviewTimings')
+    return { phase: int(value) for phase, value in
+             re.findall(r"'([^']+)': (?:int64 )?(-?\d+)", output) }
+
+
+def get_cpu_time(pid):
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+
+    # utime and stime, the 14th and 15th fields
+    return (int(fields[11]) + int(fields[12])) * 1000 // CLOCK_TICKS
+
+
+def get_peak_rss(pid):
+    with open('/proc/%d/status' % pid) as f:
+        for line in f:
+            if line.startswith('VmHWM:'):
+                return int(line.split()[1])
+
+    return None
+
+
+def reset_peak_rss(pid):
+    try:
+        with open('/proc/%d/clear_refs' % pid, 'w') as f:
+            f.write('5')
+    except OSError:
+        pass
+
+
+class Sushi:
+    def __init__(self, command, timeout):
+        self.timeout = timeout
+        self.start_time = time.monotonic()
+        self.process = subprocess.Popen([command],
+                                        stdout=subprocess.DEVNULL,
+                                        stderr=subprocess.DEVNULL)
+
+        while not name_has_owner():
+            if self.process.poll() is not None:
+                raise RuntimeError('sushi exited with status %d' % self.process.returncode)
+            if time.monotonic() - self.start_time > timeout:
+                raise RuntimeError('sushi did not show up on the bus')
+            time.sleep(0.01)
+
+        self.startup_time = time.monotonic() - self.start_time
+
+    def preview(self, path):
+        pid = self.process.pid
+        uri = 'file://' + path
+
+        reset_peak_rss(pid)
+        cpu_before = get_cpu_time(pid)
+
+        gdbus_call(BUS_NAME, OBJECT_PATH, BUS_NAME + '.ShowFile',
+                   uri, '0', 'false')
+
+        start = time.monotonic()
+        timings = {}
+        while 'first-frame' not in timings:
+            if time.monotonic() - start > self.timeout:
+                break
+            time.sleep(0.005)
+            timings = get_timings()
+
+        result = { 'phases': timings,
+                   'first_frame_us': timings.get('first-frame'),
+                   'timed_out': 'first-frame' not in timings,
+                   'cpu_ms': get_cpu_time(pid) - cpu_before,
+                   'peak_rss_kb': get_peak_rss(pid) }
+
+        gdbus_call(BUS_NAME, OBJECT_PATH, BUS_NAME + '.Close')
+        return result
+
+    def stop(self):
+        self.process.terminate()
+        try:
+            self.process.wait(5)
+        except subprocess.TimeoutExpired:
+            self.process.kill()
+            self.process.wait()
+
+        while name_has_owner():
+            time.sleep(0.01)
+
+
+def summarize(results):
+    summary = {}
+
+    for kind in sorted(set(r['kind'] for r in results)):
+        runs = [r for r in results if r['kind'] == kind]
+        entry = {}
+
+        for mode in ('cold', 'warm'):
+            frames = [r[mode]['first_frame_us'] for r in runs
+                      if r[mode]['first_frame_us'] is not None]
+            entry[mode] = {
+                'median_first_frame_us': int(statistics.median(frames)) if frames else None,
+                'max_peak_rss_kb': max(r[mode]['peak_rss_kb'] or 0 for r in runs),
+                'total_cpu_ms': sum(r[mode]['cpu_ms'] for r in runs),
+                'timeouts': sum(1 for r in runs if r[mode]['timed_out'])
+            }
+
+        summary[kind] = entry
+
+    return summary
+
+
+def compare(old, new):
+    def change(before, after):
+        if not before or after is None:
+            return '%12s' % after
+        return '%12s (%+.1f%%)' % (after, 100.0 * (after - before) / before)
+
+    print('%-8s %-5s %28s %28s' % ('kind', 'mode', 'first frame (us)', 'peak RSS (kB)'))
+    for kind, entry in sorted(new['summary'].items()):
+        for mode in ('cold', 'warm'):
+            before = old['summary'].get(kind, {}).get(mode, {})
+            after = entry[mode]
+            print('%-8s %-5s %28s %28s' % (kind, mode,
+                  change(before.get('median_first_frame_us'), after['median_first_frame_us']),
+                  change(before.get('max_peak_rss_kb'), after['max_peak_rss_kb'])))
+
+
+def get_revision():
+    try:
+        output = subprocess.check_output(['git', 'describe', '--always', '--dirty'],
+                                         cwd=os.path.dirname(os.path.abspath(__file__)),
+                                         stderr=subprocess.DEVNULL)
+        return output.decode('utf-8').strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--sushi', default='sushi',
+                        help='the sushi launcher to run')
+    parser.add_argument('--corpus', required=True,
+                        help='a directory made by make-corpus.py')
+    parser.add_argument('--output', default='bench-report.json')
+    parser.add_argument('--timeout', type=float, default=60,
+                        help='how long to wait for a preview, in seconds')
+    parser.add_argument('--kind', action='append',
+                        help='only preview files of this kind')
+    parser.add_argument('--compare', metavar='REPORT',
+                        help='print the changes from an earlier report')
+    args = parser.parse_args()
+
+    with open(os.path.join(args.corpus, 'manifest.json')) as f:
+        entries = json.load(f)['entries']
+
+    if args.kind:
+        entries = [e for e in entries if e['kind'] in args.kind]
+
+    results = []
+    for entry in entries:
+        print('Previewing %s' % os.path.basename(entry['path']), file=sys.stderr)
+
+        sushi = Sushi(args.sushi, args.timeout)
+        try:
+            cold = sushi.preview(entry['path'])
+            warm = sushi.preview(entry['path'])
+        finally:
+            sushi.stop()
+
+        results.append({ 'kind': entry['kind'],
+                         'file': os.path.basename(entry['path']),
+                         'size': os.path.getsize(entry['path']),
+                         'startup_s': round(sushi.startup_time, 3),
+                         'cold': cold,
+                         'warm': warm })
+
+    report = { 'revision': get_revision(),
+               'date': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+               'host': platform.node(),
+               'kernel': platform.release(),
+               'results': results,
+               'summary': summarize(results) }
+
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+
+    if args.compare:
+        with open(args.compare) as f:
+            compare(json.load(f), report)
+
+
+if __name__ == '__main__':
+    main()
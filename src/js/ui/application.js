@@ -28,6 +28,7 @@ const Gio = imports.gi.Gio;
 const GLib = imports.gi.GLib;
 const Gtk = imports.gi.Gtk;
 const Lang = imports.lang;
+const Sushi = imports.gi.Sushi;
 
 const MainWindow = imports.ui.mainWindow;
 
@@ -43,6 +44,13 @@ const SushiIface = '<node> \
 </method> \
 <method name="Close"> \
 </method> \
+<method name="SetSelection"> \
+    <arg type="as" direction="in" name="uris" /> \
+    <arg type="i" direction="in" name="current" /> \
+</method> \
+<method name="GetLastPreviewTimings"> \
+    <arg type="a{sx}" direction="out" name="timings" /> \
+</method> \
 </interface> \
 </node>';
 
@@ -91,7 +99,21 @@ const Application = new Lang.Class({
         this._mainWindow.close();
     },
 
+    GetLastPreviewTimings : function() {
+        return Sushi.trace_get_last_timings().deep_unpack();
+    },
+
+    SetSelection : function(uris, current) {
+        let files = uris.map(function(uri) {
+            return Gio.file_new_for_uri(uri);
+        });
+
+        this._mainWindow.setSelection(files, current);
+    },
+
     ShowFile : function(uri, xid, closeIfAlreadyShown) {
+        Sushi.trace_begin(uri);
+
 	let file = Gio.file_new_for_uri(uri);
 	if (closeIfAlreadyShown &&
 	    this._mainWindow.file &&
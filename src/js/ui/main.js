@@ -45,6 +45,14 @@ function run(argv) {
             Utils.setSlowDownFactor(factor);
     }
 
+    /* in MiB */
+    let pageCacheEnv = GLib.getenv('SUSHI_PAGE_CACHE_SIZE');
+    if (pageCacheEnv) {
+        let size = parseInt(pageCacheEnv, 10);
+        if (!isNaN(size) && size > 0)
+            Utils.setPageCacheSize(size * 1024 * 1024);
+    }
+
     Tweener.init();
 
     let application = new Application.Application();
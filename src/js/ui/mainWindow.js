@@ -59,6 +59,10 @@ const MainWindow = new Lang.Class({
         this._fullScreenId = 0;
         this._toolbarId = 0;
         this._unFullScreenId = 0;
+        this._standbyId = 0;
+        this._selection = [];
+        this._selectionCurrent = -1;
+        this._prefetched = [];
 
         this._mimeHandler = new MimeHandler.MimeHandler();
 
@@ -158,12 +162,19 @@ const MainWindow = new Lang.Class({
      ****************** main object event callbacks ***************************
      **************************************************************************/
     _onWindowDeleteEvent : function() {
+        /* hiding for standby is all the teardown there is */
         this._clearAndQuit();
+        return true;
     },
 
     _onKeyPressEvent : function(actor, event) {
         let key = event.get_keyval()[1];
 
+        /* leave the keys to text entries in the toolbar */
+        if (key != Gdk.KEY_Escape &&
+            this._gtkWindow.get_focus() instanceof Gtk.Entry)
+            return false;
+
         if (key == Gdk.KEY_Escape ||
             key == Gdk.KEY_space ||
             key == Gdk.KEY_q)
@@ -273,7 +284,17 @@ const MainWindow = new Lang.Class({
         }
     },
 
-    _createRenderer : function(file) {
+    _clearPendingRenderer : function() {
+        if (!this._pendingRenderer)
+            return;
+
+        if (this._pendingRenderer.clear)
+            this._pendingRenderer.clear();
+
+        this._pendingRenderer = null;
+    },
+
+    _createRenderer : function(file, prefetched) {
         if (this._renderer) {
             if (this._renderer.clear)
                 this._renderer.clear();
@@ -281,12 +302,25 @@ const MainWindow = new Lang.Class({
             this._renderer = null;
         }
 
+        this._clearPendingRenderer();
+
         /* create a temporary spinner renderer, that will timeout and show itself
          * if the loading takes too long.
          */
         this._renderer = new SpinnerBox.SpinnerBox();
         this._renderer.startTimeout();
 
+        if (prefetched) {
+            this._fileInfo = prefetched.fileInfo;
+            this.setTitle(this._fileInfo.get_display_name());
+            Sushi.trace_mark(file.get_uri(), 'prefetched');
+
+            this._pendingRenderer = prefetched.renderer;
+            if (this._pendingRenderer.setPrefetched)
+                this._pendingRenderer.setPrefetched(false);
+            return;
+        }
+
         file.query_info_async
         (Gio.FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME + ',' +
          Gio.FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
@@ -294,29 +328,224 @@ const MainWindow = new Lang.Class({
          GLib.PRIORITY_DEFAULT, null,
          Lang.bind (this,
                     function(obj, res) {
+                        /* another file may be shown by now */
+                        if (!this.file || !this.file.equal(file))
+                            return;
+
                         try {
                             this._fileInfo = obj.query_info_finish(res);
                             this.setTitle(this._fileInfo.get_display_name());
+                            Sushi.trace_mark(file.get_uri(), 'query-info');
 
                             /* now prepare the real renderer */
                             this._pendingRenderer = this._mimeHandler.getObject(this._fileInfo.get_content_type());
-                            this._pendingRenderer.prepare(file, this, Lang.bind(this, this._onRendererPrepared));
+                            Sushi.trace_mark(file.get_uri(), 'renderer-chosen');
+                            this._pendingRenderer.prepare(file, this, Lang.bind(this, this._onRendererPrepared,
+                                                                                this._pendingRenderer));
                         } catch(e) {
                             /* FIXME: report the error */
                             logError(e, 'Error calling prepare() on viewer');
                         }}));
     },
 
-    _onRendererPrepared : function() {
+    /**************************************************************************
+     ************************** prefetching ***********************************
+     **************************************************************************/
+    _getPrefetchCost : function(entry) {
+        /* renderers which know what they hold once prepared, e.g. a
+         * decoded image, tell; the file size stands in until then.
+         */
+        if (entry.ready && entry.renderer.getPrefetchCost)
+            return entry.renderer.getPrefetchCost();
+
+        return entry.fileInfo.get_size();
+    },
+
+    _getPrefetchedCost : function() {
+        let cost = 0;
+
+        for (let idx in this._prefetched)
+            cost += this._prefetched[idx].cost;
+
+        return cost;
+    },
+
+    _dropPrefetched : function(entry) {
+        let idx = this._prefetched.indexOf(entry);
+        if (idx != -1)
+            this._prefetched.splice(idx, 1);
+
+        if (entry.renderer && entry.renderer.clear)
+            entry.renderer.clear();
+
+        entry.renderer = null;
+    },
+
+    _takePrefetched : function(file) {
+        for (let idx = 0; idx < this._prefetched.length; idx++) {
+            let entry = this._prefetched[idx];
+
+            if (!entry.file.equal(file))
+                continue;
+
+            this._prefetched.splice(idx, 1);
+
+            /* still looking at the file; start over */
+            if (!entry.renderer)
+                return null;
+
+            return entry;
+        }
+
+        return null;
+    },
+
+    _prefetch : function(file) {
+        let entry = { file: file,
+                      fileInfo: null,
+                      renderer: null,
+                      ready: false,
+                      cost: 0 };
+        this._prefetched.push(entry);
+
+        file.query_info_async
+        (Gio.FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME + ',' +
+         Gio.FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE + ',' +
+         Gio.FILE_ATTRIBUTE_STANDARD_SIZE,
+         Gio.FileQueryInfoFlags.NONE,
+         GLib.PRIORITY_LOW, null,
+         Lang.bind (this,
+                    function(obj, res) {
+                        if (this._prefetched.indexOf(entry) == -1)
+                            return;
+
+                        try {
+                            entry.fileInfo = obj.query_info_finish(res);
+                        } catch(e) {
+                            this._dropPrefetched(entry);
+                            return;
+                        }
+
+                        /* only viewers which don't do anything visible
+                         * before being shown, like playing sound, can
+                         * be prepared ahead; some only for the types
+                         * they open cheaply.
+                         */
+                        let contentType = entry.fileInfo.get_content_type();
+                        let renderer = this._mimeHandler.getObject(contentType);
+                        let cost = this._getPrefetchCost(entry);
+
+                        if (!renderer.canPrefetch ||
+                            (renderer.canPrefetchType && !renderer.canPrefetchType(contentType)) ||
+                            this._getPrefetchedCost() + cost > Constants.PREFETCH_BUDGET) {
+                            this._dropPrefetched(entry);
+                            return;
+                        }
+
+                        entry.cost = cost;
+                        entry.renderer = renderer;
+
+                        if (renderer.setPrefetched)
+                            renderer.setPrefetched(true);
+
+                        try {
+                            renderer.prepare(file, this, Lang.bind(this, this._onPrefetchPrepared, entry));
+                        } catch(e) {
+                            logError(e, 'Error calling prepare() on viewer');
+                            this._dropPrefetched(entry);
+                        }
+                    }));
+    },
+
+    _onPrefetchPrepared : function(entry) {
+        entry.ready = true;
+
+        /* it was asked for while still preparing */
+        if (entry.renderer && entry.renderer == this._pendingRenderer) {
+            this._onRendererPrepared(entry.renderer);
+            return;
+        }
+
+        if (this._prefetched.indexOf(entry) == -1)
+            return;
+
+        /* compressed images take much more memory once decoded */
+        entry.cost = 0;
+        let cost = this._getPrefetchCost(entry);
+
+        if (this._getPrefetchedCost() + cost > Constants.PREFETCH_BUDGET) {
+            this._dropPrefetched(entry);
+            return;
+        }
+
+        entry.cost = cost;
+    },
+
+    _updatePrefetch : function() {
+        let current = this._selectionCurrent;
+        let wanted = [];
+
+        /* follow the user moving through the selection */
+        for (let idx = 0; this.file && idx < this._selection.length; idx++) {
+            if (this._selection[idx].equal(this.file)) {
+                current = idx;
+                break;
+            }
+        }
+
+        if (current >= 0) {
+            for (let distance = 1; distance <= Constants.PREFETCH_NEIGHBOURS; distance++) {
+                if (current + distance < this._selection.length)
+                    wanted.push(this._selection[current + distance]);
+                if (current - distance >= 0)
+                    wanted.push(this._selection[current - distance]);
+            }
+        }
+
+        let stale = this._prefetched.filter(function(entry) {
+            return !wanted.some(function(file) {
+                return file.equal(entry.file);
+            });
+        });
+        stale.forEach(Lang.bind(this, this._dropPrefetched));
+
+        for (let idx in wanted) {
+            let file = wanted[idx];
+
+            if (this.file && this.file.equal(file))
+                continue;
+
+            if (this._prefetched.some(function(entry) {
+                return entry.file.equal(file);
+            }))
+                continue;
+
+            this._prefetch(file);
+        }
+    },
+
+    _onRendererPrepared : function(renderer) {
+        /* the preview may have been closed or replaced meanwhile */
+        if (renderer != this._pendingRenderer)
+            return;
+
         /* destroy the spinner renderer */
         this._renderer.destroy();
 
         this._renderer = this._pendingRenderer;
         this._pendingRenderer = null;
 
+        let uri = this.file.get_uri();
+        Sushi.trace_mark(uri, 'renderer-prepared');
+
         /* generate the texture and toolbar for the new renderer */
         this._createTexture();
         this._createToolbar();
+
+        let paintId = this._stage.connect('after-paint', Lang.bind(this, function() {
+            this._stage.disconnect(paintId);
+            Sushi.trace_mark(uri, 'first-frame');
+        }));
     },
 
     _createTexture : function() {
@@ -530,11 +759,85 @@ const MainWindow = new Lang.Class({
     /**************************************************************************
      *********************** Window move/fade helpers *************************
      **************************************************************************/
+    _resetFullScreen : function() {
+        if (this._fullScreenId != 0) {
+            this._stage.disconnect(this._fullScreenId);
+            this._fullScreenId = 0;
+        }
+
+        if (this._unFullScreenId != 0) {
+            this._stage.disconnect(this._unFullScreenId);
+            this._unFullScreenId = 0;
+        }
+
+        Tweener.removeTweens(this._mainGroup);
+        this._mainGroup.set_opacity(255);
+
+        if (this._background) {
+            this._background.destroy();
+            this._background = null;
+        }
+
+        this._isFullScreen = false;
+        this._gtkWindow.unfullscreen();
+    },
+
     _clearAndQuit : function() {
-        if (this._renderer.clear)
-            this._renderer.clear();
+        /* keep the window, its stage and the loaded viewers around,
+         * so that the next preview only has to load the file; only
+         * what belongs to this one is let go.
+         */
+        this._gtkWindow.hide();
+        this.file = null;
+
+        this._selection = [];
+        this._selectionCurrent = -1;
+        this._updatePrefetch();
 
+        this._clearPendingRenderer();
+
+        if (this._renderer) {
+            if (this._renderer.clear)
+                this._renderer.clear();
+            else if (this._renderer.destroy)
+                this._renderer.destroy();
+
+            this._renderer = null;
+        }
+
+        if (this._toolbarActor) {
+            this._removeToolbarTimeout();
+            this._toolbarActor.destroy();
+            this._toolbarActor = null;
+        }
+
+        if (this._texture) {
+            this._texture.destroy();
+            this._texture = null;
+        }
+
+        if (this._isFullScreen || this._fullScreenId != 0 || this._unFullScreenId != 0)
+            this._resetFullScreen();
+
+        this._lastWindowSize = null;
+
+        this._removeStandbyTimeout();
+        this._standbyId = Mainloop.timeout_add_seconds(Constants.STANDBY_TIMEOUT,
+                                                       Lang.bind(this, this._onStandbyTimeout));
+    },
+
+    _removeStandbyTimeout : function() {
+        if (this._standbyId != 0) {
+            Mainloop.source_remove(this._standbyId);
+            this._standbyId = 0;
+        }
+    },
+
+    _onStandbyTimeout : function() {
+        this._standbyId = 0;
         this._gtkWindow.destroy();
+
+        return false;
     },
 
     /**************************************************************************
@@ -552,13 +855,31 @@ const MainWindow = new Lang.Class({
     },
 
     setFile : function(file) {
+        this._removeStandbyTimeout();
+
 	this.file = file;
         this._createAlphaBackground();
-        this._createRenderer(file);
-        this._createTexture();
-        this._createToolbar();
+
+        let prefetched = this._takePrefetched(file);
+        this._createRenderer(file, prefetched);
+
+        if (prefetched && prefetched.ready) {
+            this._onRendererPrepared(prefetched.renderer);
+        } else {
+            this._createTexture();
+            this._createToolbar();
+        }
 
         this._gtkWindow.show_all();
+
+        this._updatePrefetch();
+    },
+
+    setSelection : function(files, current) {
+        this._selection = files;
+        this._selectionCurrent = current;
+
+        this._updatePrefetch();
     },
 
     setTitle : function(label) {
@@ -569,6 +890,16 @@ const MainWindow = new Lang.Class({
         this._positionTexture();
     },
 
+    setLoadingProgress : function(renderer, fraction) {
+        /* only while the spinner stands in for that renderer */
+        if (renderer == this._pendingRenderer && this._renderer.setProgress)
+            this._renderer.setProgress(fraction);
+    },
+
+    getEmbed : function() {
+        return this._clutterEmbed;
+    },
+
     toggleFullScreen : function() {
         if (!this._renderer.canFullScreen)
             return false;
@@ -25,7 +25,10 @@
 
 const FallbackRenderer = imports.ui.fallbackRenderer;
 
-const Gio = imports.gi.Gio;
+const GdkPixbuf = imports.gi.GdkPixbuf;
+const Sushi = imports.gi.Sushi;
+
+const ViewerManifest = imports.util.viewerManifest;
 
 let _mimeHandler = null;
 
@@ -42,39 +45,74 @@ function init() {
     let handler = new MimeHandler();
 }
 
+/* content types which are only known at runtime */
+function _expandProvider(name) {
+    let mimeTypes = [];
+
+    switch (name) {
+    case '@pixbuf':
+        GdkPixbuf.Pixbuf.get_formats().forEach(function(format) {
+            mimeTypes = mimeTypes.concat(format.get_mime_types());
+        });
+        return mimeTypes;
+    case '@evince':
+        return Sushi.query_supported_document_types() || [];
+    case '@totem-audio':
+        return imports.util.totemMimeTypes.audioTypes;
+    case '@totem-video':
+        return imports.util.totemMimeTypes.videoTypes;
+    default:
+        log('Unknown content type provider ' + name);
+        return mimeTypes;
+    }
+}
+
 MimeHandler.prototype = {
     _init: function() {
-        this._mimeTypes = [];
+        /* content types are resolved to the name of their viewer
+         * in C, which remembers the result for each type it's asked.
+         */
+        this._registry = Sushi.MimeRegistry.get_default();
 
         this._fallbackRenderer = new FallbackRenderer.FallbackRenderer();
-    },
 
-    registerMime: function(mime, obj) {
-        this._mimeTypes[mime] = obj;
+        /* viewers are only imported once something needs them; they
+         * come in order of precedence, and the first one registered
+         * for a type keeps it.
+         */
+        let viewers = ViewerManifest.viewers;
+        for (let idx in viewers) {
+            let mimeTypes = viewers[idx].mimeTypes;
+
+            for (let typeIdx in mimeTypes) {
+                let mime = mimeTypes[typeIdx];
 
-        log ('Register mimetype ' + mime);
+                if (mime[0] == '@')
+                    this._registry.register_types(_expandProvider(mime), viewers[idx].name);
+                else
+                    this._registry.register(mime, viewers[idx].name);
+            }
+        }
     },
 
-    registerMimeTypes: function(mimeTypes, obj) {
-        for (let idx in mimeTypes)
-            this.registerMime(mimeTypes[idx], obj);
+    _createRenderer: function(id) {
+        try {
+            return new imports.viewers[id].Renderer();
+        } catch (e) {
+            log('Unable to load viewer ' + id + ': ' + e.toString());
+            return null;
+        }
     },
 
     getObject: function(mime) {
-        if (this._mimeTypes[mime]) {
-            /* first, try a direct match with the mimetype itself */
-            return this._mimeTypes[mime];
-        } else {
-            /* if this fails, try to see if we have any handlers
-             * registered for a parent type.
-             */
-            for (let key in this._mimeTypes) {
-                if (Gio.content_type_is_a (mime, key))
-                    return this._mimeTypes[key];
-            }
+        let id = this._registry.lookup(mime);
+        let renderer = null;
 
-            /* finally, resort to the fallback renderer */
-            return this._fallbackRenderer;
-        }
+        /* every preview gets a renderer of its own */
+        if (id != null)
+            renderer = this._createRenderer(id);
+
+        /* finally, resort to the fallback renderer */
+        return renderer || this._fallbackRenderer;
     }
 }
@@ -71,6 +71,10 @@ const SpinnerBox = new Lang.Class({
                  spinnerSize[0].height ];
     },
 
+    setProgress : function(fraction) {
+        this._label.set_text(_("Loading…") + ' ' + Math.floor(fraction * 100) + '%');
+    },
+
     startTimeout : function() {
         if (this._timeoutId)
             return;
@@ -31,11 +31,21 @@ const Lang = imports.lang;
 const Constants = imports.util.constants;
 
 let slowDownFactor = 0;
+let pageCacheSize = 0;
 
 function setSlowDownFactor(factor) {
     slowDownFactor = factor;
 }
 
+function setPageCacheSize(size) {
+    pageCacheSize = size;
+}
+
+/* 0 unless set from the environment */
+function getPageCacheSize() {
+    return pageCacheSize;
+}
+
 function getScaledSize(baseSize, allocSize, upscale) {
     let allocW = allocSize[0];
     let allocH = allocSize[1];
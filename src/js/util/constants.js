@@ -30,3 +30,23 @@ let VIEW_PADDING_X = 2;
 let VIEW_MAX_W = 800;
 let VIEW_MAX_H = 600;
 let TOOLBAR_SPACING = 32;
+
+/* how many pages the rendered pages of a document are budgeted for, at
+ * the width of the screen: the two a page turn may show at once, and
+ * one more on either side of them to render ahead.
+ */
+let PAGE_CACHE_PAGES = 4;
+
+/* images larger than this many pixels are decoded in tiles, as they're
+ * looked at, rather than whole.
+ */
+let TILED_IMAGE_MIN_PIXELS = 64 * 1024 * 1024;
+
+/* how long to stay around after the window was closed, in seconds */
+let STANDBY_TIMEOUT = 300;
+
+/* how many files on each side of the previewed one to prepare ahead,
+ * and roughly how much memory they may take, in bytes.
+ */
+let PREFETCH_NEIGHBOURS = 1;
+let PREFETCH_BUDGET = 128 * 1024 * 1024;
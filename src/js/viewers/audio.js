@@ -23,6 +23,8 @@
  *
  */
 
+// Manifest: @totem-audio
+
 const GdkPixbuf = imports.gi.GdkPixbuf;
 const Gio = imports.gi.Gio;
 const Gst = imports.gi.Gst;
@@ -35,8 +37,6 @@ const _ = Gettext.gettext;
 const Lang = imports.lang;
 
 const Constants = imports.util.constants;
-const MimeHandler = imports.ui.mimeHandler;
-const TotemMimeTypes = imports.util.totemMimeTypes;
 const Utils = imports.ui.utils;
 
 const AudioRenderer = new Lang.Class({
@@ -309,7 +309,4 @@ const AudioRenderer = new Lang.Class({
     },
 });
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new AudioRenderer();
-
-handler.registerMimeTypes(TotemMimeTypes.audioTypes, renderer);
+const Renderer = AudioRenderer;
@@ -23,8 +23,20 @@
  *
  */
 
+// Manifest: @evince
+// Manifest: application/vnd.oasis.opendocument.text
+// Manifest: application/vnd.oasis.opendocument.presentation
+// Manifest: application/vnd.openxmlformats-officedocument.wordprocessingml.document
+// Manifest: application/vnd.openxmlformats-officedocument.presentationml.presentation
+// Manifest: application/msword
+// Manifest: application/vnd.ms-excel
+// Manifest: application/vnd.ms-powerpoint
+// Manifest: application/rtf
+
 const EvDoc = imports.gi.EvinceDocument;
 const EvView = imports.gi.EvinceView;
+const Gdk = imports.gi.Gdk;
+const GObject = imports.gi.GObject;
 const Gtk = imports.gi.Gtk;
 const GtkClutter = imports.gi.GtkClutter;
 const Sushi = imports.gi.Sushi;
@@ -34,9 +46,10 @@ const _ = Gettext.gettext;
 const Lang = imports.lang;
 
 const Constants = imports.util.constants;
-const MimeHandler = imports.ui.mimeHandler;
 const Utils = imports.ui.utils;
 
+const THUMBNAIL_WIDTH = 64;
+
 const EvinceRenderer = new Lang.Class({
     Name: 'EvinceRenderer',
 
@@ -48,6 +61,7 @@ const EvinceRenderer = new Lang.Class({
 
         this.moveOnClick = false;
         this.canFullScreen = true;
+        this.canPrefetch = true;
     },
 
     prepare : function(file, mainWindow, callback) {
@@ -55,12 +69,62 @@ const EvinceRenderer = new Lang.Class({
         this._file = file;
         this._callback = callback;
 
+        this._actor = null;
+        this._stack = null;
+        this._thumbnail = null;
+        this._textView = null;
+        this._toolbarActor = null;
+        this._searchMatches = [];
+        this._thumbnailQueue = null;
+        this._sidebar = null;
+
         this._pdfLoader = new Sushi.PdfLoader();
         this._pdfLoader.connect('notify::document',
                                 Lang.bind(this, this._onDocumentLoaded));
+        this._pdfLoader.connect('notify::thumbnail',
+                                Lang.bind(this, this._onThumbnailLoaded));
+        this._pdfLoader.connect('notify::text',
+                                Lang.bind(this, this._onTextLoaded));
+        this._pdfLoader.connect('search-match',
+                                Lang.bind(this, this._onSearchMatch));
+        this._pdfLoader.connect('search-progress',
+                                Lang.bind(this, this._onSearchProgress));
+        this._pdfLoader.connect('conversion-failed',
+                                Lang.bind(this, this._onConversionFailed));
+        this._pdfLoader.target_width = Constants.VIEW_MAX_W - 2 * Constants.VIEW_PADDING_X;
         this._pdfLoader.uri = file.get_uri();
     },
 
+    canPrefetchType : function(contentType) {
+        /* converting an office document spawns LibreOffice, which
+         * is too much to spend on a file which may not be looked at
+         */
+        return Sushi.PdfLoader.is_native_type(contentType);
+    },
+
+    getPrefetchCost : function() {
+        /* what's held once prepared: the first page rendered ahead,
+         * and the pages the view renders as soon as it is shown, up
+         * to what its page cache holds
+         */
+        let cost = 0;
+        let thumbnail = this._pdfLoader.thumbnail;
+
+        if (thumbnail)
+            cost += thumbnail.get_rowstride() * thumbnail.get_height();
+
+        if (this._document) {
+            let [ pageWidth, pageHeight ] = this._document.get_page_size(0);
+            let width = this._pdfLoader.target_width;
+            let height = Math.ceil(width * pageHeight / Math.max(pageWidth, 1));
+
+            cost += Math.min(this._document.get_n_pages() * width * height * 4,
+                             this._getPageCacheSize());
+        }
+
+        return cost;
+    },
+
     render : function() {
         return this._actor;
     },
@@ -68,6 +132,17 @@ const EvinceRenderer = new Lang.Class({
     _updatePageLabel : function() {
         let curPage, totPages;
 
+        if (!this._document) {
+            this._toolbarBack.set_sensitive(false);
+            this._toolbarForward.set_sensitive(false);
+            this._searchEntry.set_sensitive(false);
+            this._pageLabel.set_text('');
+
+            return;
+        }
+
+        this._searchEntry.set_sensitive(true);
+
         curPage = this._model.get_page();
         totPages = this._document.get_n_pages();
 
@@ -77,7 +152,115 @@ const EvinceRenderer = new Lang.Class({
         this._pageLabel.set_text(_("%d of %d").format(curPage + 1, totPages));
     },
 
-    _onDocumentLoaded : function() {
+    _ensureActor : function() {
+        if (this._actor)
+            return;
+
+        this._stack = new Gtk.Stack({ transition_type: Gtk.StackTransitionType.CROSSFADE });
+        this._stack.show();
+
+        this._actor = new GtkClutter.Actor({ contents: this._stack });
+        this._actor.set_reactive(true);
+    },
+
+    _onThumbnailLoaded : function(loader) {
+        if (loader != this._pdfLoader || this._document || this._textView)
+            return;
+
+        /* show a preview of the first page right away, until the
+         * document view is ready to replace it.
+         */
+        if (this._thumbnail) {
+            this._thumbnail.set_from_pixbuf(loader.thumbnail);
+            return;
+        }
+
+        this._ensureActor();
+
+        this._thumbnail = Gtk.Image.new_from_pixbuf(loader.thumbnail);
+        this._thumbnail.show();
+
+        let scrolledWin = Gtk.ScrolledWindow.new(null, null);
+        scrolledWin.set_min_content_width(Constants.VIEW_MIN);
+        scrolledWin.set_min_content_height(Constants.VIEW_MIN);
+        scrolledWin.add(this._thumbnail);
+        scrolledWin.show();
+        this._stack.add_named(scrolledWin, 'thumbnail');
+
+        this._callback();
+    },
+
+    _onTextLoaded : function(loader) {
+        if (loader != this._pdfLoader || this._document)
+            return;
+
+        /* show the text reflowed until, if ever, the original layout
+         * is asked for.
+         */
+        let buffer = new Gtk.TextBuffer();
+        buffer.set_text(loader.text, -1);
+
+        this._textView = new Gtk.TextView({ buffer: buffer,
+                                            editable: false,
+                                            cursor_visible: false,
+                                            wrap_mode: Gtk.WrapMode.WORD_CHAR,
+                                            left_margin: 12,
+                                            right_margin: 12,
+                                            pixels_below_lines: 6 });
+        this._textView.set_can_focus(false);
+        this._textView.show();
+
+        let scrolledWin = Gtk.ScrolledWindow.new(null, null);
+        scrolledWin.set_min_content_width(Constants.VIEW_MIN);
+        scrolledWin.set_min_content_height(Constants.VIEW_MIN);
+        scrolledWin.add(this._textView);
+        scrolledWin.show();
+
+        let showingThumbnail = (this._actor != null);
+
+        this._ensureActor();
+        this._stack.add_named(scrolledWin, 'text');
+        this._stack.set_visible_child_name('text');
+
+        if (showingThumbnail) {
+            if (this._toolbarActor)
+                this._toolbarLayout.show();
+        } else {
+            this._callback();
+        }
+    },
+
+    _onConversionFailed : function(loader) {
+        if (loader != this._pdfLoader)
+            return;
+
+        /* keep showing the thumbnail or text, if any */
+        if (this._actor) {
+            if (this._toolbarActor)
+                this._toolbarLayout.hide();
+
+            return;
+        }
+
+        let label = new Gtk.Label({ label: _("The document could not be previewed") });
+        label.get_style_context().add_class('dim-label');
+        label.show();
+
+        let box = new Gtk.EventBox({ width_request: Constants.VIEW_MIN,
+                                     height_request: Constants.VIEW_MIN });
+        box.add(label);
+        box.show();
+
+        this._ensureActor();
+        this._stack.add_named(box, 'error');
+
+        this._callback();
+    },
+
+    _onDocumentLoaded : function(loader) {
+        if (loader != this._pdfLoader)
+            return;
+
         this._document = this._pdfLoader.document;
         this._model = EvView.DocumentModel.new_with_document(this._document);
 
@@ -90,6 +273,7 @@ const EvinceRenderer = new Lang.Class({
                             }));
 
         this._view = EvView.View.new();
+        this._view.set_page_cache_size(this._getPageCacheSize());
         this._view.show();
 
         this._scrolledWin = Gtk.ScrolledWindow.new(null, null);
@@ -100,10 +284,140 @@ const EvinceRenderer = new Lang.Class({
         this._view.set_model(this._model);
         this._scrolledWin.add(this._view);
 
-        this._actor = new GtkClutter.Actor({ contents: this._scrolledWin });
-        this._actor.set_reactive(true);
+        this._createSidebar();
 
-        this._callback();
+        let box = new Gtk.Box({ orientation: Gtk.Orientation.HORIZONTAL });
+        box.pack_start(this._sidebar, false, false, 0);
+        box.pack_start(this._scrolledWin, true, true, 0);
+        box.show();
+
+        let showingThumbnail = (this._actor != null);
+
+        this._ensureActor();
+        this._stack.add_named(box, 'document');
+        this._stack.set_visible_child_name('document');
+
+        if (showingThumbnail) {
+            if (this._toolbarActor) {
+                this._toolbarLayout.hide();
+                this._toolbarSidebar.show();
+                this._updatePageLabel();
+            }
+        } else {
+            this._callback();
+        }
+    },
+
+    /* EvView renders pages through its own pixbuf cache, which holds
+     * the visible pages and renders their neighbours ahead only while
+     * they fit in its budget; its default of 50 MiB doesn't fit the
+     * neighbours of a page shown fullscreen on a large screen, nor does
+     * it need to be that large for small ones.
+     */
+    _getPageCacheSize : function() {
+        let size = Utils.getPageCacheSize();
+        if (size > 0)
+            return size;
+
+        let screen = Gdk.Screen.get_default();
+        let monitor = screen.get_primary_monitor();
+        let width = screen.get_monitor_geometry(monitor).width *
+            screen.get_monitor_scale_factor(monitor);
+
+        let [ pageWidth, pageHeight ] = this._document.get_page_size(0);
+        let height = Math.ceil(width * pageHeight / Math.max(pageWidth, 1));
+
+        return Constants.PAGE_CACHE_PAGES * width * height * 4;
+    },
+
+    _createSidebar : function() {
+        let nPages = this._document.get_n_pages();
+
+        this._thumbnailQueue = Sushi.ThumbnailQueue.new(this._document, THUMBNAIL_WIDTH);
+        this._thumbnailQueue.connect('thumbnail-ready',
+                                     Lang.bind(this, this._onThumbnailReady));
+
+        /* the store only holds page numbers; the pixbufs are fetched
+         * from the queue's cache when a row is drawn.
+         */
+        this._thumbnailStore = new Gtk.ListStore();
+        this._thumbnailStore.set_column_types([ GObject.TYPE_INT ]);
+        for (let idx = 0; idx < nPages; idx++)
+            this._thumbnailStore.set(this._thumbnailStore.append(), [ 0 ], [ idx ]);
+
+        let [ pageWidth, pageHeight ] = this._document.get_page_size(0);
+        let height = Math.ceil(THUMBNAIL_WIDTH * pageHeight / Math.max(pageWidth, 1));
+
+        let renderer = new Gtk.CellRendererPixbuf({ xpad: 6, ypad: 3 });
+        renderer.set_fixed_size(THUMBNAIL_WIDTH + 12, height + 6);
+
+        let column = new Gtk.TreeViewColumn({ sizing: Gtk.TreeViewColumnSizing.FIXED,
+                                              fixed_width: THUMBNAIL_WIDTH + 12 });
+        column.pack_start(renderer, true);
+        column.set_cell_data_func(renderer, Lang.bind(this, function(column, cell, model, iter) {
+            let page = model.get_value(iter, 0);
+            cell.pixbuf = this._thumbnailQueue.get_thumbnail(page);
+        }));
+
+        /* with fixed height rows, only the visible ones are measured */
+        this._thumbnailView = new Gtk.TreeView({ model: this._thumbnailStore,
+                                                 headers_visible: false,
+                                                 fixed_height_mode: true,
+                                                 enable_search: false });
+        this._thumbnailView.append_column(column);
+        this._thumbnailView.get_selection().connect('changed',
+                                                    Lang.bind(this, function(selection) {
+                                                        let [ selected, model, iter ] = selection.get_selected();
+                                                        if (selected)
+                                                            this._model.set_page(model.get_value(iter, 0));
+                                                    }));
+
+        let scrolledWin = Gtk.ScrolledWindow.new(null, null);
+        scrolledWin.set_policy(Gtk.PolicyType.NEVER, Gtk.PolicyType.AUTOMATIC);
+        scrolledWin.add(this._thumbnailView);
+        scrolledWin.get_vadjustment().connect('value-changed',
+                                              Lang.bind(this, this._queueVisibleThumbnails));
+        scrolledWin.connect('size-allocate',
+                            Lang.bind(this, this._queueVisibleThumbnails));
+        scrolledWin.show_all();
+
+        this._sidebar = new Gtk.Revealer({ transition_type: Gtk.RevealerTransitionType.SLIDE_RIGHT,
+                                           reveal_child: false });
+        this._sidebar.add(scrolledWin);
+        this._sidebar.show();
+    },
+
+    _queueVisibleThumbnails : function() {
+        if (!this._sidebar || !this._sidebar.reveal_child)
+            return;
+
+        let [ visible, start, end ] = this._thumbnailView.get_visible_range();
+        if (visible)
+            this._thumbnailQueue.set_visible_range(start.get_indices()[0],
+                                                   end.get_indices()[0]);
+    },
+
+    _onThumbnailReady : function(queue, page) {
+        if (queue != this._thumbnailQueue)
+            return;
+
+        let path = Gtk.TreePath.new_from_indices([ page ]);
+        let [ valid, iter ] = this._thumbnailStore.get_iter(path);
+        if (valid)
+            this._thumbnailStore.row_changed(path, iter);
+    },
+
+    _toggleSidebar : function() {
+        if (!this._sidebar)
+            return;
+
+        let reveal = !this._sidebar.reveal_child;
+        this._sidebar.reveal_child = reveal;
+
+        if (reveal)
+            this._queueVisibleThumbnails();
+        else
+            this._thumbnailQueue.cancel_all();
     },
 
     getSizeForAllocation : function(allocation) {
@@ -123,6 +437,75 @@ const EvinceRenderer = new Lang.Class({
         return item;
     },
 
+    _createSearchItem : function() {
+        this._searchEntry = new Gtk.SearchEntry({ width_chars: 12,
+                                                  placeholder_text: _("Search") });
+        this._searchEntry.connect('search-changed',
+                                  Lang.bind(this, this._onSearchChanged));
+        this._searchEntry.connect('activate',
+                                  Lang.bind(this, this._onSearchNext));
+
+        let item = new Gtk.ToolItem();
+        item.add(this._searchEntry);
+        item.show_all();
+
+        return item;
+    },
+
+    _onSearchChanged : function() {
+        this._searchMatches = [];
+        this._searchEntry.set_progress_fraction(0);
+        this._searchEntry.get_style_context().remove_class('error');
+
+        this._pdfLoader.search(this._searchEntry.get_text());
+    },
+
+    _onSearchMatch : function(loader, page, nMatches) {
+        if (loader != this._pdfLoader)
+            return;
+
+        this._searchMatches.push(page);
+
+        /* results stream in while the document is being indexed,
+         * so jump to the first one as soon as it is found.
+         */
+        if (this._searchMatches.length == 1)
+            this._model.set_page(page);
+    },
+
+    _onSearchProgress : function(loader, nPages) {
+        if (loader != this._pdfLoader || !this._searchEntry)
+            return;
+
+        let fraction = nPages / this._document.get_n_pages();
+
+        if (fraction < 1) {
+            this._searchEntry.set_progress_fraction(fraction);
+            return;
+        }
+
+        this._searchEntry.set_progress_fraction(0);
+        if (this._searchMatches.length == 0)
+            this._searchEntry.get_style_context().add_class('error');
+    },
+
+    _onSearchNext : function() {
+        if (this._searchMatches.length == 0)
+            return;
+
+        let curPage = this._model.get_page();
+        let nextPage = this._searchMatches[0];
+
+        for (let idx = 0; idx < this._searchMatches.length; idx++) {
+            if (this._searchMatches[idx] > curPage) {
+                nextPage = this._searchMatches[idx];
+                break;
+            }
+        }
+
+        this._model.set_page(nextPage);
+    },
+
     createToolbar : function() {
         this._mainToolbar = new Gtk.Toolbar({ icon_size: Gtk.IconSize.MENU });
         this._mainToolbar.get_style_context().add_class('osd');
@@ -131,6 +514,12 @@ const EvinceRenderer = new Lang.Class({
 
         this._toolbarActor = new GtkClutter.Actor({ contents: this._mainToolbar });
 
+        this._toolbarSidebar = Utils.createToolButton('view-sidebar-symbolic',
+                                                      Lang.bind(this, this._toggleSidebar));
+        this._toolbarSidebar.set_tooltip_text(_("Page Thumbnails"));
+        this._toolbarSidebar.set_visible(this._document != null);
+        this._mainToolbar.insert(this._toolbarSidebar, -1);
+
         this._toolbarBack = new Gtk.ToolButton({ expand: false,
                                                  icon_name: 'go-previous-symbolic' });
         this._toolbarBack.show();
@@ -154,6 +543,9 @@ const EvinceRenderer = new Lang.Class({
                                          this._view.next_page();
                                      }));
 
+        let searchItem = this._createSearchItem();
+        this._mainToolbar.insert(searchItem, -1);
+
         let separator = new Gtk.SeparatorToolItem();
         separator.show();
         this._mainToolbar.insert(separator, -1);
@@ -161,35 +553,39 @@ const EvinceRenderer = new Lang.Class({
         this._toolbarZoom = Utils.createFullScreenButton(this._mainWindow);
         this._mainToolbar.insert(this._toolbarZoom, -1);
 
+        this._toolbarLayout = Utils.createToolButton('x-office-document-symbolic',
+                                                     Lang.bind(this, function(button) {
+                                                         button.set_sensitive(false);
+                                                         this._pdfLoader.load_document();
+                                                     }));
+        this._toolbarLayout.set_tooltip_text(_("Show Original Layout"));
+        this._toolbarLayout.set_visible(this._textView != null && !this._document);
+        this._mainToolbar.insert(this._toolbarLayout, -1);
+
         this._updatePageLabel();
 
         return this._toolbarActor;
     },
 
     clear : function() {
+        if (this._thumbnailQueue)
+            this._thumbnailQueue.cancel_all();
+
         this._pdfLoader.cleanup_document();
         this._document = null;
         this._pdfLoader = null;
+        this._actor = null;
+        this._stack = null;
+        this._thumbnail = null;
+        this._textView = null;
+        this._searchEntry = null;
+        this._searchMatches = [];
+        this._thumbnailQueue = null;
+        this._thumbnailStore = null;
+        this._thumbnailView = null;
+        this._sidebar = null;
+        this._toolbarActor = null;
     }
 });
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new EvinceRenderer();
-
-let mimeTypes = Sushi.query_supported_document_types();
-handler.registerMimeTypes(mimeTypes, renderer);
-
-let officeTypes = [
-    'application/vnd.oasis.opendocument.text',
-    'application/vnd.oasis.opendocument.presentation',
-    'application/vnd.oasis.opendocument.spreadsheet',
-    'application/vnd.openxmlformats-officedocument.wordprocessingml.document',
-    'application/vnd.openxmlformats-officedocument.spreadsheetml.sheet',
-    'application/vnd.openxmlformats-officedocument.presentationml.presentation',
-    'application/msword',
-    'application/vnd.ms-excel',
-    'application/vnd.ms-powerpoint',
-    'application/rtf'
-];
-
-handler.registerMimeTypes(officeTypes, renderer);
+const Renderer = EvinceRenderer;
@@ -23,7 +23,11 @@
  *
  */
 
-const MimeHandler = imports.ui.mimeHandler;
+// Manifest: application/x-font-ttf
+// Manifest: application/x-font-otf
+// Manifest: application/x-font-pcf
+// Manifest: application/x-font-type1
+
 const Utils = imports.ui.utils;
 
 const Lang = imports.lang;
@@ -39,6 +43,7 @@ const FontRenderer = new Lang.Class({
     _init : function(args) {
         this.moveOnClick = true;
         this.canFullScreen = true;
+        this.canPrefetch = true;
     },
 
     prepare : function(file, mainWindow, callback) {
@@ -77,14 +82,4 @@ const FontRenderer = new Lang.Class({
     }
 });
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new FontRenderer();
-
-let mimeTypes = [
-    'application/x-font-ttf',
-    'application/x-font-otf',
-    'application/x-font-pcf',
-    'application/x-font-type1'
-];
-
-handler.registerMimeTypes(mimeTypes, renderer);
+const Renderer = FontRenderer;
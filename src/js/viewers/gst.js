@@ -23,6 +23,8 @@
  *
  */
 
+// Manifest: @totem-video
+
 imports.gi.versions.ClutterGst = '3.0';
 const ClutterGst = imports.gi.ClutterGst;
 const Clutter = imports.gi.Clutter;
@@ -34,8 +36,6 @@ const GtkClutter = imports.gi.GtkClutter;
 const Lang = imports.lang;
 
 const Constants = imports.util.constants;
-const MimeHandler = imports.ui.mimeHandler;
-const TotemMimeTypes = imports.util.totemMimeTypes;
 const Utils = imports.ui.utils;
 
 const GstRenderer = new Lang.Class({
@@ -212,7 +212,4 @@ const GstRenderer = new Lang.Class({
     },
 });
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new GstRenderer();
-
-handler.registerMimeTypes(TotemMimeTypes.videoTypes, renderer);
+const Renderer = GstRenderer;
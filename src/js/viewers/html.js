@@ -23,6 +23,8 @@
  *
  */
 
+// Manifest: text/html
+
 const GtkClutter = imports.gi.GtkClutter;
 const Gtk = imports.gi.Gtk;
 const GLib = imports.gi.GLib;
@@ -30,7 +32,6 @@ const Lang = imports.lang;
 const Sushi = imports.gi.Sushi;
 const WebKit = imports.gi.WebKit2;
 
-const MimeHandler = imports.ui.mimeHandler;
 const Utils = imports.ui.utils;
 
 const HTMLRenderer = new Lang.Class({
@@ -91,11 +92,4 @@ const HTMLRenderer = new Lang.Class({
     }
 });
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new HTMLRenderer();
-
-let mimeTypes = [
-    'text/html'
-];
-
-handler.registerMimeTypes(mimeTypes, renderer);
+const Renderer = HTMLRenderer;
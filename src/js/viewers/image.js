@@ -23,26 +23,427 @@
  *
  */
 
-const GdkPixbuf = imports.gi.GdkPixbuf;
+// Manifest: @pixbuf
+// Manifest: image/x-adobe-dng image/x-canon-cr2 image/x-fuji-raf
+// Manifest: image/x-nikon-nef image/x-nikon-nrw image/x-olympus-orf
+// Manifest: image/x-panasonic-rw2 image/x-pentax-pef image/x-samsung-srw
+// Manifest: image/x-sony-arw image/x-sony-sr2
+// Manifest: image/svg+xml image/svg+xml-compressed
+
+const Clutter = imports.gi.Clutter;
+const Gio = imports.gi.Gio;
+const GLib = imports.gi.GLib;
 const GtkClutter = imports.gi.GtkClutter;
 const Gtk = imports.gi.Gtk;
-const GLib = imports.gi.GLib;
+const Sushi = imports.gi.Sushi;
 
+const Cairo = imports.cairo;
 const Gettext = imports.gettext.domain('sushi');
 const _ = Gettext.gettext;
 const Lang = imports.lang;
 const Mainloop = imports.mainloop;
 
-const MimeHandler = imports.ui.mimeHandler;
+const Constants = imports.util.constants;
 const Utils = imports.ui.utils;
 
+/* the size of the histogram in the toolbar */
+const HISTOGRAM_WIDTH = 128;
+const HISTOGRAM_HEIGHT = 40;
+
+/* how much a step of the scroll wheel zooms, and how far in */
+const ZOOM_STEP = 1.25;
+const ZOOM_MAX_SCALE = 2;
+
+/* Shows a Sushi.TiledImage: the tiles of the level closest to the
+ * current zoom are laid out in image coordinates on top of the last,
+ * coarsest level, and the whole is scaled to the view. Scrolling zooms
+ * around the pointer and dragging pans, when zooming is enabled.
+ */
+const TiledImageActor = new Lang.Class({
+    Name: 'TiledImageActor',
+
+    _init : function(image) {
+        this._image = image;
+        this._tiles = {};
+        this._zoom = 1;
+        this._center = [ image.width / 2, image.height / 2 ];
+        this._zoomable = false;
+        this._dragStart = null;
+        this._updateId = 0;
+
+        this.actor = new Clutter.Actor({ reactive: true,
+                                         clip_to_allocation: true });
+        this._content = new Clutter.Actor();
+        this.actor.add_child(this._content);
+
+        this.actor.connect('allocation-changed',
+                           Lang.bind(this, this._queueUpdate));
+        this.actor.connect('scroll-event',
+                           Lang.bind(this, this._onScrollEvent));
+        this.actor.connect('button-press-event',
+                           Lang.bind(this, this._onButtonPressEvent));
+        this.actor.connect('motion-event',
+                           Lang.bind(this, this._onMotionEvent));
+        this.actor.connect('button-release-event',
+                           Lang.bind(this, this._onButtonReleaseEvent));
+        this.actor.connect('destroy',
+                           Lang.bind(this, this._onDestroy));
+
+        this._tilesReadyId =
+            this._image.connect('tiles-ready',
+                                Lang.bind(this, this._queueUpdate));
+    },
+
+    setZoomable : function(zoomable) {
+        if (this._zoomable == zoomable)
+            return;
+
+        this._zoomable = zoomable;
+
+        if (!zoomable) {
+            this._zoom = 1;
+            this._dragStart = null;
+        }
+
+        this._queueUpdate();
+    },
+
+    _getScale : function(width, height) {
+        let fit = Math.min(width / this._image.width,
+                           height / this._image.height);
+
+        this._zoom = Math.min(Math.max(this._zoom, 1),
+                              Math.max(ZOOM_MAX_SCALE / fit, 1));
+
+        return fit * this._zoom;
+    },
+
+    _clampCenter : function(width, height, scale) {
+        let view = [ width / scale, height / scale ];
+        let size = [ this._image.width, this._image.height ];
+
+        for (let idx = 0; idx < 2; idx++) {
+            if (view[idx] >= size[idx])
+                this._center[idx] = size[idx] / 2;
+            else
+                this._center[idx] = Math.min(Math.max(this._center[idx],
+                                                      view[idx] / 2),
+                                             size[idx] - view[idx] / 2);
+        }
+    },
+
+    _queueUpdate : function() {
+        /* this can come in the middle of an allocation cycle */
+        if (this._updateId == 0)
+            this._updateId = Mainloop.idle_add(Lang.bind(this, this._update));
+    },
+
+    _addTile : function(shown, level, col, row) {
+        let key = level + '/' + col + '/' + row;
+        let texture = this._tiles[key];
+
+        if (!texture) {
+            let pix = this._image.get_tile(level, col, row);
+            if (!pix)
+                return;
+
+            let span = Sushi.TILED_IMAGE_TILE_SIZE << level;
+
+            let image = new Clutter.Image();
+            Sushi.clutter_image_set_pixbuf(image, pix);
+
+            texture = new Clutter.Actor({ x: col * span,
+                                          y: row * span,
+                                          width: pix.get_width() << level,
+                                          height: pix.get_height() << level,
+                                          content: image });
+
+            /* the coarsest level stays below the others */
+            if (level == this._image.n_levels - 1)
+                this._content.insert_child_below(texture, null);
+            else
+                this._content.add_child(texture);
+
+            this._tiles[key] = texture;
+        }
+
+        shown[key] = true;
+    },
+
+    _update : function() {
+        this._updateId = 0;
+
+        let [width, height] = this.actor.get_size();
+        if (width <= 0 || height <= 0)
+            return false;
+
+        let scale = this._getScale(width, height);
+        this._clampCenter(width, height, scale);
+
+        let originX = this._center[0] - width / (2 * scale);
+        let originY = this._center[1] - height / (2 * scale);
+
+        this._content.set_scale(scale, scale);
+        this._content.set_position(-originX * scale, -originY * scale);
+
+        /* the coarsest level with at least a pixel per screen pixel */
+        let top = this._image.n_levels - 1;
+        let level = Math.floor(-Math.log(scale) / Math.LN2);
+        level = Math.min(Math.max(level, 0), top);
+
+        let x0 = Math.max(originX, 0);
+        let y0 = Math.max(originY, 0);
+        let x1 = Math.min(originX + width / scale, this._image.width);
+        let y1 = Math.min(originY + height / scale, this._image.height);
+
+        let shown = {};
+        this._addTile(shown, top, 0, 0);
+
+        if (level < top) {
+            let span = Sushi.TILED_IMAGE_TILE_SIZE << level;
+
+            for (let row = Math.floor(y0 / span); row * span < y1; row++)
+                for (let col = Math.floor(x0 / span); col * span < x1; col++)
+                    this._addTile(shown, level, col, row);
+        }
+
+        this._image.set_viewport(level,
+                                 Math.floor(x0 / (1 << level)),
+                                 Math.floor(y0 / (1 << level)),
+                                 Math.ceil((x1 - x0) / (1 << level)),
+                                 Math.ceil((y1 - y0) / (1 << level)));
+
+        for (let key in this._tiles) {
+            if (!shown[key]) {
+                this._tiles[key].destroy();
+                delete this._tiles[key];
+            }
+        }
+
+        return false;
+    },
+
+    _zoomAt : function(x, y, factor) {
+        let [width, height] = this.actor.get_size();
+        let scale = this._getScale(width, height);
+
+        /* keep the point under the pointer where it is */
+        let point = [ this._center[0] + (x - width / 2) / scale,
+                      this._center[1] + (y - height / 2) / scale ];
+
+        this._zoom *= factor;
+        scale = this._getScale(width, height);
+
+        this._center = [ point[0] - (x - width / 2) / scale,
+                         point[1] - (y - height / 2) / scale ];
+        this._queueUpdate();
+    },
+
+    _getEventCoords : function(event) {
+        let [stageX, stageY] = event.get_coords();
+        let [res, x, y] = this.actor.transform_stage_point(stageX, stageY);
+
+        return [ x, y ];
+    },
+
+    _onScrollEvent : function(actor, event) {
+        if (!this._zoomable)
+            return false;
+
+        let direction = event.get_scroll_direction();
+        let factor;
+
+        if (direction == Clutter.ScrollDirection.UP) {
+            factor = ZOOM_STEP;
+        } else if (direction == Clutter.ScrollDirection.DOWN) {
+            factor = 1 / ZOOM_STEP;
+        } else if (direction == Clutter.ScrollDirection.SMOOTH) {
+            let [dx, dy] = event.get_scroll_delta();
+            factor = Math.pow(ZOOM_STEP, -dy);
+        } else {
+            return false;
+        }
+
+        let [x, y] = this._getEventCoords(event);
+        this._zoomAt(x, y, factor);
+
+        return true;
+    },
+
+    _onButtonPressEvent : function(actor, event) {
+        if (!this._zoomable || event.get_button() != 1)
+            return false;
+
+        this._dragStart = { coords: this._getEventCoords(event),
+                            center: this._center.slice(0) };
+        Clutter.grab_pointer(this.actor);
+
+        return true;
+    },
+
+    _onMotionEvent : function(actor, event) {
+        if (!this._dragStart)
+            return false;
+
+        let [width, height] = this.actor.get_size();
+        let scale = this._getScale(width, height);
+        let [x, y] = this._getEventCoords(event);
+
+        this._center = [ this._dragStart.center[0] - (x - this._dragStart.coords[0]) / scale,
+                         this._dragStart.center[1] - (y - this._dragStart.coords[1]) / scale ];
+        this._queueUpdate();
+
+        return true;
+    },
+
+    _onButtonReleaseEvent : function(actor, event) {
+        if (!this._dragStart)
+            return false;
+
+        this._dragStart = null;
+        Clutter.ungrab_pointer();
+
+        return true;
+    },
+
+    _onDestroy : function() {
+        if (this._updateId != 0) {
+            Mainloop.source_remove(this._updateId);
+            this._updateId = 0;
+        }
+
+        this._image.disconnect(this._tilesReadyId);
+        this._image.cancel_all();
+        this._tiles = {};
+    }
+});
+
+/* how the image is turned for each EXIF orientation: the angle it's
+ * rotated by, clockwise, once it's flipped as the scales say.
+ */
+const ORIENTATIONS = [ null,
+                       [ 0, 1, 1 ],
+                       [ 0, -1, 1 ],
+                       [ 180, 1, 1 ],
+                       [ 0, 1, -1 ],
+                       [ 90, 1, -1 ],
+                       [ 90, 1, 1 ],
+                       [ 90, -1, 1 ],
+                       [ 270, 1, 1 ] ];
+
+/* Gives the only child of the container the whole of its allocation,
+ * with the width and the height swapped for images on their side.
+ */
+const OrientedLayout = new Lang.Class({
+    Name: 'OrientedLayout',
+    Extends: Clutter.LayoutManager,
+
+    _init : function() {
+        this.parent();
+        this._transposed = false;
+    },
+
+    setTransposed : function(transposed) {
+        if (this._transposed == transposed)
+            return;
+
+        this._transposed = transposed;
+        this.layout_changed();
+    },
+
+    vfunc_get_preferred_width : function(container, forHeight) {
+        return [ 0, 0 ];
+    },
+
+    vfunc_get_preferred_height : function(container, forWidth) {
+        return [ 0, 0 ];
+    },
+
+    vfunc_allocate : function(container, box, flags) {
+        let child = container.get_first_child();
+        if (!child)
+            return;
+
+        let width = box.get_width();
+        let height = box.get_height();
+        let childWidth = this._transposed ? height : width;
+        let childHeight = this._transposed ? width : height;
+
+        let childBox = new Clutter.ActorBox();
+        childBox.x1 = (width - childWidth) / 2;
+        childBox.y1 = (height - childHeight) / 2;
+        childBox.x2 = childBox.x1 + childWidth;
+        childBox.y2 = childBox.y1 + childHeight;
+
+        child.allocate(childBox, flags);
+    }
+});
+
+/* Shows a pixbuf as decoded, in its stored orientation, and turns it
+ * as its EXIF orientation says with a transformation of the actor
+ * rather than a rotated copy of the pixels.
+ */
+const OrientedImage = new Lang.Class({
+    Name: 'OrientedImage',
+
+    _init : function() {
+        this.image = new Clutter.Image();
+        this._orientation = 1;
+
+        this._layout = new OrientedLayout();
+        this.actor = new Clutter.Actor({ layout_manager: this._layout });
+
+        this._content =
+            new Clutter.Actor({ content: this.image,
+                                content_gravity: Clutter.ContentGravity.RESIZE_ASPECT,
+                                pivot_point: new Clutter.Point({ x: 0.5, y: 0.5 }) });
+        this.actor.add_child(this._content);
+    },
+
+    setPixbuf : function(pix, orientation) {
+        Sushi.clutter_image_set_pixbuf(this.image, pix);
+        this.setOrientation(orientation);
+    },
+
+    setOrientation : function(orientation) {
+        if (orientation < 1 || orientation >= ORIENTATIONS.length)
+            orientation = 1;
+
+        if (this._orientation == orientation)
+            return;
+
+        this._orientation = orientation;
+
+        let [angle, scaleX, scaleY] = ORIENTATIONS[orientation];
+
+        this._content.set_rotation_angle(Clutter.RotateAxis.Z_AXIS, angle);
+        this._content.set_scale(scaleX, scaleY);
+        this._layout.setTransposed(orientation >= 5);
+    }
+});
+
 const ImageRenderer = new Lang.Class({
     Name: 'ImageRenderer',
 
     _init : function(args) {
-        this._timeoutId = 0;
+        this._player = null;
+        this._rendered = false;
         this.moveOnClick = true;
         this.canFullScreen = true;
+        this.canPrefetch = true;
+        this._prefetched = false;
+    },
+
+    setPrefetched : function(prefetched) {
+        this._prefetched = prefetched;
+
+        if (this._loader)
+            this._loader.priority = this._getLoadPriority();
+    },
+
+    /* the image on screen is decoded before its neighbours */
+    _getLoadPriority : function() {
+        return this._prefetched ? GLib.PRIORITY_LOW : GLib.PRIORITY_DEFAULT;
     },
 
     prepare : function(file, mainWindow, callback) {
@@ -50,64 +451,283 @@ const ImageRenderer = new Lang.Class({
         this._file = file;
         this._callback = callback;
 
-        this._createImageTexture(file);
+        this._texture = null;
+        this._orientedImage = null;
+        this._tiledActor = null;
+        this._pixbuf = null;
+        this._stats = null;
+        this._decodedSize = [ 0, 0 ];
+        this._decoded = false;
+        this._decodeFailed = false;
+        this._previewShown = false;
+        this._exhausted = false;
+        this._wantedSize = null;
+        this._reloading = false;
+
+        /* everything still going on is dropped when we're cleared; the
+         * decode is dropped as well if the image is shown in tiles.
+         */
+        this._cancellable = new Gio.Cancellable();
+        this._loadCancellable = new Gio.Cancellable();
+
+        /* images too large to ever decode whole are shown in tiles
+         * instead; the decode starts meanwhile, and what it comes up
+         * with is held back until we know.
+         */
+        this._tiledImage = new Sushi.TiledImage({ file: file });
+        this._tiledImage.load_async(this._cancellable,
+                                    Lang.bind(this, this._onTiledImageLoaded));
+
+        this._startLoad();
+    },
+
+    _onTiledImageLoaded : function(image, res) {
+        let tiled = false;
+
+        try {
+            tiled = image.load_finish(res) &&
+                (image.width * image.height > Constants.TILED_IMAGE_MIN_PIXELS);
+        } catch (e) {
+            /* e.g. a remote file; the loader copes with those */
+        }
+
+        if (image != this._tiledImage)
+            return;
+
+        if (tiled) {
+            this._loadCancellable.cancel();
+            this._loader = null;
+            this._pixbuf = null;
+
+            this._tiledActor = new TiledImageActor(image);
+            this._texture = this._tiledActor.actor;
+            this._callback();
+            return;
+        }
+
+        this._tiledImage = null;
+
+        if (this._pixbuf)
+            this._showPixbuf(this._pixbuf);
+    },
+
+    _startLoad : function() {
+        let maxWidth = Constants.VIEW_MAX_W - 2 * Constants.VIEW_PADDING_X;
+        let maxHeight = Constants.VIEW_MAX_H - Constants.VIEW_PADDING_Y;
+
+        /* decode just enough to fill the window; fullscreen asks for
+         * more later, if it needs it.
+         */
+        this._loader = new Sushi.ImageLoader({ file: this._file,
+                                               priority: this._getLoadPriority() });
+        this._loader.connect('notify::progress',
+                             Lang.bind(this, this._onLoaderProgress));
+        this._loader.connect('partial-image',
+                             Lang.bind(this, this._onPartialImage));
+
+        this._reloading = true;
+        this._loader.load_async(maxWidth, maxHeight, this._loadCancellable,
+                                Lang.bind(this, this._onImageLoaded));
+
+        /* photos usually carry a preview, which shows up long before
+         * the image itself, or in its place if it can't be decoded at
+         * all; the loader declines it for raw files, where the preview
+         * is what it decodes as the image.
+         */
+        this._loader.load_preview_async(maxWidth, maxHeight, this._loadCancellable,
+                                        Lang.bind(this, this._onPreviewLoaded));
+    },
+
+    _onLoaderProgress : function(loader) {
+        if (loader == this._loader && !this._texture)
+            this._mainWindow.setLoadingProgress(this, loader.progress);
+    },
+
+    _onPartialImage : function(loader, pix) {
+        /* progressive images are worth showing half-way, unless
+         * there's something better up already.
+         */
+        if (loader != this._loader || this._decoded || this._previewShown)
+            return;
+
+        this._showPixbuf(pix);
     },
 
     render : function() {
+        this._rendered = true;
+        this._maybeStartAnimation();
+
         return this._texture;
     },
 
-    _createImageTexture : function(file) {
-        file.read_async
-        (GLib.PRIORITY_DEFAULT, null,
-         Lang.bind(this,
-                   function(obj, res) {
-                       try {
-                           let stream = obj.read_finish(res);
-                           this._textureFromStream(stream);
-                       } catch (e) {
-                       }
-                   }));
+    _onImageLoaded : function(loader, res) {
+        let pix;
+
+        this._reloading = false;
+
+        try {
+            pix = loader.load_finish(res);
+        } catch (e) {
+            if (e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED))
+                return;
+
+            /* the preview, if any, is as good as it gets */
+            this._decodeFailed = true;
+            log('Unable to load the image: ' + e.toString());
+            return;
+        }
+
+        if (loader != this._loader)
+            return;
+
+        /* nothing larger than what's shown came out of the file, e.g.
+         * the thumbnail of a raw file behind its preview: keep it.
+         */
+        let size = this._getOrientedSize(pix);
+        if ((this._decoded || this._previewShown) && !loader.scalable &&
+            size[0] <= this._decodedSize[0] && size[1] <= this._decodedSize[1]) {
+            this._exhausted = true;
+            return;
+        }
+
+        this._decoded = true;
+        this._showPixbuf(pix);
+
+        /* the size changed again while we were at it */
+        if (this._wantedSize) {
+            let size = this._wantedSize;
+            this._wantedSize = null;
+            this._maybeReload(size);
+        }
+    },
+
+    _onPreviewLoaded : function(loader, res) {
+        let pix;
+
+        try {
+            pix = loader.load_preview_finish(res);
+        } catch (e) {
+            return;
+        }
+
+        /* too late, the image itself is there already */
+        if (loader != this._loader || this._decoded)
+            return;
+
+        this._previewShown = true;
+        this._showPixbuf(pix);
     },
 
-    _textureFromStream : function(stream) {
-        GdkPixbuf.PixbufAnimation.new_from_stream_async
-        (stream, null,
-         Lang.bind(this, function(obj, res) {
-             let anim = GdkPixbuf.PixbufAnimation.new_from_stream_finish(res);
+    /* the size the image is shown at, once turned */
+    _getOrientedSize : function(pix) {
+        if (this._loader.orientation >= 5)
+            return [ pix.get_height(), pix.get_width() ];
 
-             this._iter = anim.get_iter(null);
-             let pix = this._iter.get_pixbuf().apply_embedded_orientation();
+        return [ pix.get_width(), pix.get_height() ];
+    },
+
+    _showPixbuf : function(pix) {
+        this._decodedSize = this._getOrientedSize(pix);
+        this._pixbuf = pix;
+
+        /* still waiting to know whether it's shown in tiles */
+        if (this._tiledImage)
+            return;
+
+        if (this._decoded && this._statsItem && this._statsItem.visible)
+            this._updateStats();
 
-             this._texture = new GtkClutter.Texture({ keep_aspect_ratio: true });
-             this._texture.set_from_pixbuf(pix);
+        if (this._texture) {
+            /* the image after its preview, or a sharper version for
+             * fullscreen.
+             */
+            this._orientedImage.setPixbuf(pix, this._loader.orientation);
+            this._mainWindow.refreshSize();
+        } else {
+            this._orientedImage = new OrientedImage();
+            this._orientedImage.setPixbuf(pix, this._loader.orientation);
+            this._texture = this._orientedImage.actor;
 
-             if (!anim.is_static_image())
-                 this._startTimeout();
+            /* we're ready now */
+            this._callback();
+        }
+
+        this._maybeStartAnimation();
+    },
 
-             /* we're ready now */
-             this._callback();
+    _maybeStartAnimation : function() {
+        /* not before we're on screen */
+        if (this._player || !this._rendered || !this._loader ||
+            !this._loader.animation)
+            return;
 
-             stream.close_async(GLib.PRIORITY_DEFAULT,
-                                null, function(object, res) {
-                                    try {
-                                        object.close_finish(res);
-                                    } catch (e) {
-                                        log('Unable to close the stream ' + e.toString());
-                                    }
-                                });
-         }));
+        this._player = new Sushi.AnimationPlayer({ animation: this._loader.animation });
+        this._player.start(this._mainWindow.getEmbed(), this._orientedImage.image);
+    },
+
+    _maybeReload : function(size) {
+        if (this._decodeFailed || this._exhausted || this._loader.animation)
+            return;
+
+        if (this._reloading) {
+            this._wantedSize = size;
+            return;
+        }
+
+        if (this._loader.scalable) {
+            /* drawn again at exactly the size it's shown at, which is
+             * cheap when it was shown at that size before.
+             */
+            if (size[0] == this._decodedSize[0] && size[1] == this._decodedSize[1])
+                return;
+        } else {
+            if (size[0] <= this._decodedSize[0] && size[1] <= this._decodedSize[1])
+                return;
+
+            /* nothing more to get out of the file */
+            if (this._decodedSize[0] >= this._loader.original_width &&
+                this._decodedSize[1] >= this._loader.original_height)
+                return;
+        }
+
+        this._reloading = true;
+        this._loader.load_async(size[0], size[1], this._loadCancellable,
+                                Lang.bind(this, this._onImageLoaded));
     },
 
     getSizeForAllocation : function(allocation, fullScreen) {
-        let baseSize = this._texture.get_base_size();
-        return Utils.getScaledSize(baseSize, allocation, fullScreen);
+        if (this._tiledActor) {
+            /* zooming and panning take the whole screen */
+            this._tiledActor.setZoomable(fullScreen);
+            this.moveOnClick = !fullScreen;
+
+            if (fullScreen)
+                return allocation;
+
+            return Utils.getScaledSize([ this._tiledImage.width,
+                                         this._tiledImage.height ],
+                                       allocation, false);
+        }
+
+        /* lay the image out by its real size, whatever it was decoded at */
+        let baseSize = [ this._loader.original_width,
+                         this._loader.original_height ];
+        let size = Utils.getScaledSize(baseSize, allocation, fullScreen);
+
+        if (fullScreen || this._loader.scalable)
+            this._maybeReload(size);
+
+        return size;
     },
 
-    _startTimeout : function() {
-        this._timeoutId = Mainloop.timeout_add(this._iter.get_delay_time(),
-                                               Lang.bind(this,
-                                                         this._advanceImage));
+    getPrefetchCost : function() {
+        /* what's held once prepared: the decode at the size of the
+         * window, or the tiles which fill it
+         */
+        if (this._pixbuf)
+            return this._pixbuf.get_rowstride() * this._pixbuf.get_height();
+
+        return Constants.VIEW_MAX_W * Constants.VIEW_MAX_H * 4;
     },
 
     createToolbar : function() {
@@ -121,32 +741,156 @@ const ImageRenderer = new Lang.Class({
         this._toolbarZoom = Utils.createFullScreenButton(this._mainWindow);
         this._mainToolbar.insert(this._toolbarZoom, 0);
 
+        /* huge images are never decoded whole */
+        if (!this._tiledActor) {
+            let separator = new Gtk.SeparatorToolItem();
+            separator.show();
+            this._mainToolbar.insert(separator, -1);
+
+            this._toolbarStats = new Gtk.ToggleToolButton({ icon_name: 'dialog-information-symbolic' });
+            this._toolbarStats.show();
+            this._toolbarStats.connect('toggled',
+                                       Lang.bind(this, this._onStatsToggled));
+            this._mainToolbar.insert(this._toolbarStats, -1);
+
+            this._mainToolbar.insert(this._createStatsItem(), -1);
+        }
+
         return this._toolbarActor;
     },
 
-    destroy : function () {
-        /* We should do the check here because it is possible
-         * that we never created a source if our image is
-         * not animated. */
-        if (this._timeoutId) {
-            Mainloop.source_remove(this._timeoutId);
-            this._timeoutId = 0;
+    _createStatsItem : function() {
+        this._histogram = new Gtk.DrawingArea({ width_request: HISTOGRAM_WIDTH,
+                                                height_request: HISTOGRAM_HEIGHT,
+                                                valign: Gtk.Align.CENTER });
+        this._histogram.connect('draw', Lang.bind(this, this._drawHistogram));
+
+        this._statsLabel = new Gtk.Label({ margin_start: 10,
+                                           margin_end: 10 });
+
+        let box = new Gtk.Box({ orientation: Gtk.Orientation.HORIZONTAL,
+                                spacing: 6 });
+        box.add(this._histogram);
+        box.add(this._statsLabel);
+        box.show_all();
+
+        /* shown on demand, so nothing is computed before it's asked for */
+        this._statsItem = new Gtk.ToolItem();
+        this._statsItem.add(box);
+
+        return this._statsItem;
+    },
+
+    _onStatsToggled : function(button) {
+        this._statsItem.visible = button.active;
+
+        if (button.active && !this._stats)
+            this._updateStats();
+    },
+
+    _updateStats : function() {
+        if (!this._pixbuf)
+            return;
+
+        this._stats = new Sushi.ImageStats({ pixbuf: this._pixbuf });
+        this._stats.compute_async(this._cancellable,
+                                  Lang.bind(this, this._onStatsComputed));
+    },
+
+    _onStatsComputed : function(stats, res) {
+        try {
+            stats.compute_finish(res);
+        } catch (e) {
+            if (!e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED))
+                log('Unable to compute the image statistics: ' + e.toString());
+            return;
         }
+
+        if (stats != this._stats)
+            return;
+
+        /* Translators: the size of the image in pixels */
+        let text = _("%d × %d").format(this._loader.original_width,
+                                        this._loader.original_height);
+        text += '\n';
+        /* Translators: how much of the image is pure black and pure white */
+        text += _("Clipped: %s%% shadows, %s%% highlights").format(
+            (stats.shadows_clipped * 100).toFixed(1),
+            (stats.highlights_clipped * 100).toFixed(1));
+
+        this._statsLabel.set_text(text);
+        this._histogram.queue_draw();
     },
 
-    _advanceImage : function () {
-        this._iter.advance(null);
-        let pix = this._iter.get_pixbuf().apply_embedded_orientation();
-        this._texture.set_from_pixbuf(pix);
-        return true;
+    _drawHistogram : function(area, cr) {
+        if (!this._stats || this._stats.n_samples == 0)
+            return false;
+
+        let width = area.get_allocated_width();
+        let height = area.get_allocated_height();
+
+        let channels = [ [ Sushi.ImageChannel.LUMA, 0.8, 0.8, 0.8 ],
+                         [ Sushi.ImageChannel.RED, 0.9, 0.2, 0.2 ],
+                         [ Sushi.ImageChannel.GREEN, 0.2, 0.9, 0.2 ],
+                         [ Sushi.ImageChannel.BLUE, 0.3, 0.3, 1.0 ] ];
+
+        /* the clipped ends would flatten everything else */
+        let luma = this._stats.get_histogram(Sushi.ImageChannel.LUMA);
+        let max = 1;
+        for (let idx = 1; idx < luma.length - 1; idx++)
+            max = Math.max(max, luma[idx]);
+
+        channels.forEach(function(channel) {
+            let bins = this._stats.get_histogram(channel[0]);
+
+            cr.setSourceRGBA(channel[1], channel[2], channel[3], 0.6);
+            cr.moveTo(0, height);
+
+            for (let idx = 0; idx < bins.length; idx++)
+                cr.lineTo(idx * width / (bins.length - 1),
+                          height - Math.min(bins[idx] / max, 1) * height);
+
+            if (channel[0] == Sushi.ImageChannel.LUMA) {
+                cr.lineTo(width, height);
+                cr.fill();
+            } else {
+                cr.setLineWidth(1);
+                cr.stroke();
+            }
+        }, this);
+
+        cr.$dispose();
+
+        return false;
+    },
+
+    clear : function() {
+        this.destroy();
+
+        if (this._cancellable) {
+            this._cancellable.cancel();
+            this._cancellable = null;
+        }
+
+        if (this._loadCancellable) {
+            this._loadCancellable.cancel();
+            this._loadCancellable = null;
+        }
+
+        this._loader = null;
+        this._tiledImage = null;
+        this._tiledActor = null;
+        this._orientedImage = null;
+        this._pixbuf = null;
+        this._stats = null;
     },
-});
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new ImageRenderer();
+    destroy : function () {
+        if (this._player) {
+            this._player.stop();
+            this._player = null;
+        }
+    },
+});
 
-let formats = GdkPixbuf.Pixbuf.get_formats();
-for (let idx in formats) {
-    let mimeTypes = formats[idx].get_mime_types();
-    handler.registerMimeTypes(mimeTypes, renderer);
-}
+const Renderer = ImageRenderer;
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+// Manifest: application/vnd.oasis.opendocument.spreadsheet
+// Manifest: application/vnd.openxmlformats-officedocument.spreadsheetml.sheet
+
+const GtkClutter = imports.gi.GtkClutter;
+const Gtk = imports.gi.Gtk;
+const Pango = imports.gi.Pango;
+const Sushi = imports.gi.Sushi;
+
+const Lang = imports.lang;
+
+const MimeHandler = imports.ui.mimeHandler;
+const Utils = imports.ui.utils;
+
+const CELL_WIDTH = 100;
+
+function _columnTitle(idx) {
+    let title = '';
+
+    do {
+        title = String.fromCharCode(65 + idx % 26) + title;
+        idx = Math.floor(idx / 26) - 1;
+    } while (idx >= 0);
+
+    return title;
+}
+
+const SpreadsheetRenderer = new Lang.Class({
+    Name: 'SpreadsheetRenderer',
+
+    _init : function(args) {
+        this.moveOnClick = false;
+        this.canFullScreen = true;
+        this.canPrefetch = true;
+    },
+
+    prepare : function(file, mainWindow, callback) {
+        this._mainWindow = mainWindow;
+        this._file = file;
+        this._callback = callback;
+        this._delegate = null;
+
+        this._loader = new Sushi.SpreadsheetLoader();
+        this._loader.connect('loaded',
+                             Lang.bind(this, this._onSheetLoaded));
+        this._loader.connect('error',
+                             Lang.bind(this, this._onLoadError));
+        this._loader.uri = file.get_uri();
+    },
+
+    render : function() {
+        if (this._delegate)
+            return this._delegate.render();
+
+        return this._actor;
+    },
+
+    _onSheetLoaded : function(loader, model) {
+        if (loader != this._loader)
+            return;
+
+        /* all the rows have the same height, so the view only has to
+         * measure and draw the ones which are scrolled into sight.
+         */
+        this._view = new Gtk.TreeView({ model: model,
+                                        fixed_height_mode: true,
+                                        enable_search: false,
+                                        enable_grid_lines: Gtk.TreeViewGridLines.BOTH });
+        this._view.get_selection().set_mode(Gtk.SelectionMode.NONE);
+
+        for (let idx = 0; idx < model.get_n_columns(); idx++) {
+            let renderer = new Gtk.CellRendererText({ ellipsize: Pango.EllipsizeMode.END,
+                                                      single_paragraph_mode: true });
+            let title = '';
+
+            if (idx == 0) {
+                renderer.xalign = 1.0;
+                renderer.sensitive = false;
+            } else {
+                title = _columnTitle(idx - 1);
+            }
+
+            let column = new Gtk.TreeViewColumn({ title: title,
+                                                  sizing: Gtk.TreeViewColumnSizing.FIXED,
+                                                  fixed_width: (idx == 0) ? -1 : CELL_WIDTH,
+                                                  resizable: true });
+            column.pack_start(renderer, true);
+            column.add_attribute(renderer, 'text', idx);
+            this._view.append_column(column);
+        }
+
+        this._scrolledWin = Gtk.ScrolledWindow.new(null, null);
+        this._scrolledWin.add(this._view);
+        this._scrolledWin.show_all();
+
+        this._actor = new GtkClutter.Actor({ contents: this._scrolledWin });
+        this._actor.set_reactive(true);
+        this._callback();
+    },
+
+    _onLoadError : function(loader, message) {
+        if (loader != this._loader)
+            return;
+
+        log('Unable to read the spreadsheet natively: ' + message);
+
+        /* let the office document path convert it instead */
+        let handler = new MimeHandler.MimeHandler();
+        this._delegate = handler.getObject('application/vnd.ms-excel');
+        this._delegate.prepare(this._file, this._mainWindow, this._callback);
+    },
+
+    getSizeForAllocation : function(allocation) {
+        if (this._delegate)
+            return this._delegate.getSizeForAllocation(allocation);
+
+        return allocation;
+    },
+
+    createToolbar : function() {
+        if (this._delegate)
+            return this._delegate.createToolbar();
+
+        this._mainToolbar = new Gtk.Toolbar({ icon_size: Gtk.IconSize.MENU });
+        this._mainToolbar.get_style_context().add_class('osd');
+        this._mainToolbar.set_show_arrow(false);
+
+        this._toolbarZoom = Utils.createFullScreenButton(this._mainWindow);
+        this._mainToolbar.insert(this._toolbarZoom, 0);
+
+        let separator = new Gtk.SeparatorToolItem();
+        separator.show();
+        this._mainToolbar.insert(separator, 1);
+
+        this._toolbarRun = Utils.createOpenButton(this._file, this._mainWindow);
+        this._mainToolbar.insert(this._toolbarRun, 2);
+
+        this._mainToolbar.show();
+
+        this._toolbarActor = new GtkClutter.Actor({ contents: this._mainToolbar });
+
+        return this._toolbarActor;
+    },
+
+    clear : function() {
+        if (this._delegate && this._delegate.clear)
+            this._delegate.clear();
+
+        this._delegate = null;
+        this._loader = null;
+        this._view = null;
+        this._actor = null;
+        this._toolbarActor = null;
+    }
+});
+
+const Renderer = SpreadsheetRenderer;
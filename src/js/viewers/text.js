@@ -23,6 +23,8 @@
  *
  */
 
+// Manifest: text/plain
+
 const Gdk = imports.gi.Gdk;
 const GtkClutter = imports.gi.GtkClutter;
 const Gtk = imports.gi.Gtk;
@@ -32,7 +34,6 @@ const Gio = imports.gi.Gio;
 const Lang = imports.lang;
 const Sushi = imports.gi.Sushi;
 
-const MimeHandler = imports.ui.mimeHandler;
 const Utils = imports.ui.utils;
 
 const TextRenderer = new Lang.Class({
@@ -41,6 +42,7 @@ const TextRenderer = new Lang.Class({
     _init : function(args) {
         this.moveOnClick = false;
         this.canFullScreen = true;
+        this.canPrefetch = true;
     },
 
     prepare : function(file, mainWindow, callback) {
@@ -123,14 +125,4 @@ const TextRenderer = new Lang.Class({
     }
 });
 
-let handler = new MimeHandler.MimeHandler();
-let renderer = new TextRenderer();
-
-/* register for text/plain and let the mime handler call us
- * for child types.
- */
-let mimeTypes = [
-    'text/plain'
-];
-
-handler.registerMimeTypes(mimeTypes, renderer);
+const Renderer = TextRenderer;
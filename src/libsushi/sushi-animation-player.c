@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+#include "sushi-animation-player.h"
+
+#include "sushi-utils.h"
+
+/* Plays a GdkPixbufAnimation into a ClutterImage: a thread composites
+ * the frames ahead of time into a small ring of buffers allocated once,
+ * and the frames are shown on the frame clock of a widget as their time
+ * comes; frames which are already late when a newer one is due are
+ * skipped. Like for still images, the orientation is left to the actor
+ * showing the image.
+ */
+
+/* how much memory the decoded frames may take */
+#define RING_BYTES (32 * 1024 * 1024)
+#define DEFAULT_RING_SIZE 8
+
+G_DEFINE_TYPE (SushiAnimationPlayer, sushi_animation_player, G_TYPE_OBJECT);
+
+enum {
+  PROP_ANIMATION = 1,
+  PROP_RING_SIZE,
+  NUM_PROPERTIES
+};
+
+static GParamSpec* properties[NUM_PROPERTIES] = { NULL, };
+
+typedef struct {
+  GdkPixbuf *pixbuf;
+
+  /* when it starts, in milliseconds from the start of the animation */
+  gint64 timestamp;
+} Frame;
+
+struct _SushiAnimationPlayerPrivate {
+  GdkPixbufAnimation *animation;
+  guint ring_size;
+
+  GtkWidget *widget;
+  ClutterImage *image;
+  guint tick_id;
+  gint64 start_time;
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+
+  /* protected by the lock; the frames from head on are decoded and
+   * not shown yet, the others are free for the thread.
+   */
+  Frame *ring;
+  guint n_frames;
+  guint head;
+  guint count;
+  gboolean stopping;
+  gboolean finished;
+};
+
+static gpointer
+decode_frames_thread (gpointer user_data)
+{
+  SushiAnimationPlayer *self = user_data;
+  GdkPixbufAnimationIter *iter;
+  GTimeVal time = { 0, 0 };
+  GdkPixbuf *pixbuf;
+  Frame *frame;
+  gint64 timestamp = 0;
+  gint delay;
+
+  /* the iterator follows the time it's given; walking it with the
+   * delays of the frames steps through them one by one, loops included.
+   */
+  iter = gdk_pixbuf_animation_get_iter (self->priv->animation, &time);
+
+  while (TRUE) {
+    g_mutex_lock (&self->priv->lock);
+
+    while (!self->priv->stopping &&
+           self->priv->count == self->priv->n_frames)
+      g_cond_wait (&self->priv->cond, &self->priv->lock);
+
+    if (self->priv->stopping) {
+      g_mutex_unlock (&self->priv->lock);
+      break;
+    }
+
+    frame = &self->priv->ring[(self->priv->head + self->priv->count) %
+                              self->priv->n_frames];
+    g_mutex_unlock (&self->priv->lock);
+
+    pixbuf = gdk_pixbuf_animation_iter_get_pixbuf (iter);
+    gdk_pixbuf_copy_area (pixbuf, 0, 0,
+                          MIN (gdk_pixbuf_get_width (pixbuf),
+                               gdk_pixbuf_get_width (frame->pixbuf)),
+                          MIN (gdk_pixbuf_get_height (pixbuf),
+                               gdk_pixbuf_get_height (frame->pixbuf)),
+                          frame->pixbuf, 0, 0);
+    frame->timestamp = timestamp;
+
+    g_mutex_lock (&self->priv->lock);
+    self->priv->count++;
+    g_mutex_unlock (&self->priv->lock);
+
+    /* the last frame of an animation which doesn't loop stays */
+    delay = gdk_pixbuf_animation_iter_get_delay_time (iter);
+    if (delay < 0)
+      break;
+
+    timestamp += delay;
+    g_time_val_add (&time, (glong) delay * 1000);
+    gdk_pixbuf_animation_iter_advance (iter, &time);
+  }
+
+  g_mutex_lock (&self->priv->lock);
+  self->priv->finished = TRUE;
+  g_mutex_unlock (&self->priv->lock);
+
+  g_object_unref (iter);
+
+  return NULL;
+}
+
+static gboolean
+tick_cb (GtkWidget *widget,
+         GdkFrameClock *frame_clock,
+         gpointer user_data)
+{
+  SushiAnimationPlayer *self = user_data;
+  Frame *frame;
+  gint64 frame_time, now;
+  gboolean finished;
+
+  frame_time = gdk_frame_clock_get_frame_time (frame_clock);
+
+  g_mutex_lock (&self->priv->lock);
+
+  if (self->priv->count == 0) {
+    finished = self->priv->finished;
+    g_mutex_unlock (&self->priv->lock);
+
+    if (finished)
+      self->priv->tick_id = 0;
+
+    return finished ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+  }
+
+  frame = &self->priv->ring[self->priv->head];
+
+  /* the first frame shows right away, and sets the pace */
+  if (self->priv->start_time < 0)
+    self->priv->start_time = frame_time - frame->timestamp * 1000;
+
+  now = (frame_time - self->priv->start_time) / 1000;
+
+  /* skip what's already too late */
+  while (self->priv->count > 1 &&
+         self->priv->ring[(self->priv->head + 1) % self->priv->n_frames].timestamp <= now) {
+    self->priv->head = (self->priv->head + 1) % self->priv->n_frames;
+    self->priv->count--;
+
+    g_cond_signal (&self->priv->cond);
+  }
+
+  frame = &self->priv->ring[self->priv->head];
+  g_mutex_unlock (&self->priv->lock);
+
+  if (frame->timestamp > now)
+    return G_SOURCE_CONTINUE;
+
+  /* the image keeps a copy, so the frame can go back to the thread */
+  sushi_clutter_image_set_pixbuf (self->priv->image, frame->pixbuf, NULL);
+
+  g_mutex_lock (&self->priv->lock);
+  self->priv->head = (self->priv->head + 1) % self->priv->n_frames;
+  self->priv->count--;
+  g_cond_signal (&self->priv->cond);
+  g_mutex_unlock (&self->priv->lock);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * sushi_animation_player_start:
+ * @self:
+ * @widget: the widget whose frame clock paces the animation
+ * @image: the image to show the frames in
+ *
+ * Starts playing the animation from its first frame.
+ */
+void
+sushi_animation_player_start (SushiAnimationPlayer *self,
+                              GtkWidget *widget,
+                              ClutterImage *image)
+{
+  GdkPixbuf *first;
+  gint width, height;
+  gsize frame_bytes;
+  guint idx;
+
+  sushi_animation_player_stop (self);
+
+  first = gdk_pixbuf_animation_get_static_image (self->priv->animation);
+  if (first == NULL)
+    return;
+
+  width = gdk_pixbuf_animation_get_width (self->priv->animation);
+  height = gdk_pixbuf_animation_get_height (self->priv->animation);
+
+  /* a couple of frames at least, so that decoding runs ahead */
+  frame_bytes = (gsize) width * height * 4;
+  self->priv->n_frames = CLAMP (RING_BYTES / MAX (frame_bytes, 1),
+                                2, MAX (self->priv->ring_size, 2));
+
+  self->priv->ring = g_new0 (Frame, self->priv->n_frames);
+  for (idx = 0; idx < self->priv->n_frames; idx++)
+    self->priv->ring[idx].pixbuf =
+      gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                      gdk_pixbuf_get_has_alpha (first), 8,
+                      width, height);
+
+  self->priv->widget = g_object_ref (widget);
+  self->priv->image = g_object_ref (image);
+  self->priv->start_time = -1;
+  self->priv->head = 0;
+  self->priv->count = 0;
+  self->priv->stopping = FALSE;
+  self->priv->finished = FALSE;
+
+  self->priv->thread = g_thread_new ("sushi-animation",
+                                     decode_frames_thread, self);
+  self->priv->tick_id = gtk_widget_add_tick_callback (widget, tick_cb,
+                                                      self, NULL);
+}
+
+/**
+ * sushi_animation_player_stop:
+ * @self:
+ *
+ * Stops playing, and lets go of the decoded frames.
+ */
+void
+sushi_animation_player_stop (SushiAnimationPlayer *self)
+{
+  guint idx;
+
+  if (self->priv->thread == NULL)
+    return;
+
+  if (self->priv->tick_id != 0) {
+    gtk_widget_remove_tick_callback (self->priv->widget, self->priv->tick_id);
+    self->priv->tick_id = 0;
+  }
+
+  g_mutex_lock (&self->priv->lock);
+  self->priv->stopping = TRUE;
+  g_cond_signal (&self->priv->cond);
+  g_mutex_unlock (&self->priv->lock);
+
+  g_thread_join (self->priv->thread);
+  self->priv->thread = NULL;
+
+  for (idx = 0; idx < self->priv->n_frames; idx++)
+    g_object_unref (self->priv->ring[idx].pixbuf);
+
+  g_clear_pointer (&self->priv->ring, g_free);
+  self->priv->n_frames = 0;
+
+  g_clear_object (&self->priv->widget);
+  g_clear_object (&self->priv->image);
+}
+
+static void
+sushi_animation_player_dispose (GObject *object)
+{
+  SushiAnimationPlayer *self = SUSHI_ANIMATION_PLAYER (object);
+
+  sushi_animation_player_stop (self);
+  g_clear_object (&self->priv->animation);
+
+  G_OBJECT_CLASS (sushi_animation_player_parent_class)->dispose (object);
+}
+
+static void
+sushi_animation_player_finalize (GObject *object)
+{
+  SushiAnimationPlayer *self = SUSHI_ANIMATION_PLAYER (object);
+
+  g_mutex_clear (&self->priv->lock);
+  g_cond_clear (&self->priv->cond);
+
+  G_OBJECT_CLASS (sushi_animation_player_parent_class)->finalize (object);
+}
+
+static void
+sushi_animation_player_get_property (GObject *object,
+                                     guint       prop_id,
+                                     GValue     *value,
+                                     GParamSpec *pspec)
+{
+  SushiAnimationPlayer *self = SUSHI_ANIMATION_PLAYER (object);
+
+  switch (prop_id) {
+  case PROP_ANIMATION:
+    g_value_set_object (value, self->priv->animation);
+    break;
+  case PROP_RING_SIZE:
+    g_value_set_uint (value, self->priv->ring_size);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_animation_player_set_property (GObject *object,
+                                     guint       prop_id,
+                                     const GValue *value,
+                                     GParamSpec *pspec)
+{
+  SushiAnimationPlayer *self = SUSHI_ANIMATION_PLAYER (object);
+
+  switch (prop_id) {
+  case PROP_ANIMATION:
+    self->priv->animation = g_value_dup_object (value);
+    break;
+  case PROP_RING_SIZE:
+    self->priv->ring_size = g_value_get_uint (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_animation_player_class_init (SushiAnimationPlayerClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->dispose = sushi_animation_player_dispose;
+  oclass->finalize = sushi_animation_player_finalize;
+  oclass->get_property = sushi_animation_player_get_property;
+  oclass->set_property = sushi_animation_player_set_property;
+
+  properties[PROP_ANIMATION] =
+    g_param_spec_object ("animation",
+                         "Animation",
+                         "The animation to play",
+                         GDK_TYPE_PIXBUF_ANIMATION,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  properties[PROP_RING_SIZE] =
+    g_param_spec_uint ("ring-size",
+                       "Ring size",
+                       "How many frames to decode ahead, at most",
+                       2, G_MAXUINT, DEFAULT_RING_SIZE,
+                       G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+
+  g_object_class_install_properties (oclass, NUM_PROPERTIES, properties);
+
+  g_type_class_add_private (klass, sizeof (SushiAnimationPlayerPrivate));
+}
+
+static void
+sushi_animation_player_init (SushiAnimationPlayer *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_ANIMATION_PLAYER,
+                                 SushiAnimationPlayerPrivate);
+
+  g_mutex_init (&self->priv->lock);
+  g_cond_init (&self->priv->cond);
+}
+
+/**
+ * sushi_animation_player_new:
+ * @animation: an animation
+ *
+ * Returns: (transfer full): a new #SushiAnimationPlayer for @animation
+ */
+SushiAnimationPlayer *
+sushi_animation_player_new (GdkPixbufAnimation *animation)
+{
+  return g_object_new (SUSHI_TYPE_ANIMATION_PLAYER,
+                       "animation", animation,
+                       NULL);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_ANIMATION_PLAYER_H__
+#define __SUSHI_ANIMATION_PLAYER_H__
+
+#include <glib-object.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gtk/gtk.h>
+#include <clutter/clutter.h>
+
+G_BEGIN_DECLS
+
+#define SUSHI_TYPE_ANIMATION_PLAYER            (sushi_animation_player_get_type ())
+#define SUSHI_ANIMATION_PLAYER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUSHI_TYPE_ANIMATION_PLAYER, SushiAnimationPlayer))
+#define SUSHI_IS_ANIMATION_PLAYER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SUSHI_TYPE_ANIMATION_PLAYER))
+#define SUSHI_ANIMATION_PLAYER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  SUSHI_TYPE_ANIMATION_PLAYER, SushiAnimationPlayerClass))
+#define SUSHI_IS_ANIMATION_PLAYER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  SUSHI_TYPE_ANIMATION_PLAYER))
+#define SUSHI_ANIMATION_PLAYER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  SUSHI_TYPE_ANIMATION_PLAYER, SushiAnimationPlayerClass))
+
+typedef struct _SushiAnimationPlayer          SushiAnimationPlayer;
+typedef struct _SushiAnimationPlayerPrivate   SushiAnimationPlayerPrivate;
+typedef struct _SushiAnimationPlayerClass     SushiAnimationPlayerClass;
+
+struct _SushiAnimationPlayer
+{
+  GObject parent_instance;
+
+  SushiAnimationPlayerPrivate *priv;
+};
+
+struct _SushiAnimationPlayerClass
+{
+  GObjectClass parent_class;
+};
+
+GType    sushi_animation_player_get_type     (void) G_GNUC_CONST;
+
+SushiAnimationPlayer *sushi_animation_player_new (GdkPixbufAnimation *animation);
+
+void sushi_animation_player_start (SushiAnimationPlayer *self,
+                                   GtkWidget *widget,
+                                   ClutterImage *image);
+void sushi_animation_player_stop  (SushiAnimationPlayer *self);
+
+G_END_DECLS
+
+#endif /* __SUSHI_ANIMATION_PLAYER_H__ */
@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+#include "sushi-exif-preview.h"
+
+#include <string.h>
+
+/* Finds the JPEG previews photos and camera raw files carry, by walking
+ * the TIFF structure they are stored in: IFD1 of the EXIF block of a
+ * JPEG, or the IFD chain and the SubIFDs of TIFF based raw formats
+ * (CR2, NEF, ARW, DNG, ORF, RW2, PEF...). Fujifilm's RAF points at its
+ * preview from the file header. Only the headers are looked at, so this
+ * is cheap on a mapped file whatever its size.
+ */
+
+#define MAX_IFDS 32
+
+#define TAG_COMPRESSION       0x0103
+#define TAG_STRIP_OFFSETS     0x0111
+#define TAG_ORIENTATION       0x0112
+#define TAG_STRIP_BYTE_COUNTS 0x0117
+#define TAG_SUB_IFDS          0x014a
+#define TAG_JPEG_OFFSET       0x0201
+#define TAG_JPEG_LENGTH       0x0202
+
+#define RAF_MAGIC "FUJIFILMCCD-RAW "
+
+typedef struct {
+  const guchar *data;
+  gsize length;
+  gsize base;
+  gboolean big_endian;
+
+  gint n_ifds;
+  gint orientation;
+  SushiExifPreview *best;
+} TiffReader;
+
+static guint
+read_u16 (const guchar *p,
+          gboolean big_endian)
+{
+  return big_endian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+static guint32
+read_u32 (const guchar *p,
+          gboolean big_endian)
+{
+  return big_endian ?
+    ((guint32) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]) :
+    ((guint32) p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+/* Walks the markers of a JPEG up to the image data, for the size of
+ * the frame and the TIFF block of its EXIF segment, if any.
+ */
+static gboolean
+scan_jpeg (const guchar *data,
+           gsize length,
+           gint *width,
+           gint *height,
+           gsize *tiff_offset,
+           gsize *tiff_length)
+{
+  gsize pos = 2;
+  guint marker, size;
+
+  *width = *height = 0;
+  *tiff_offset = *tiff_length = 0;
+
+  if (length < 4 || data[0] != 0xff || data[1] != 0xd8)
+    return FALSE;
+
+  while (pos + 4 <= length) {
+    if (data[pos] != 0xff)
+      return FALSE;
+
+    marker = data[pos + 1];
+
+    /* fill bytes */
+    if (marker == 0xff) {
+      pos++;
+      continue;
+    }
+
+    size = read_u16 (data + pos + 2, TRUE);
+    if (size < 2 || pos + 2 + size > length)
+      return FALSE;
+
+    if (marker == 0xe1 && size >= 8 &&
+        memcmp (data + pos + 4, "Exif\0\0", 6) == 0 &&
+        *tiff_offset == 0) {
+      *tiff_offset = pos + 10;
+      *tiff_length = size - 8;
+    } else if (marker == 0xc0 || marker == 0xc1 || marker == 0xc2) {
+      /* baseline, extended and progressive: what GdkPixbuf decodes */
+      if (size < 7)
+        return FALSE;
+
+      *height = read_u16 (data + pos + 5, TRUE);
+      *width = read_u16 (data + pos + 7, TRUE);
+
+      return (*width > 0 && *height > 0);
+    } else if ((marker >= 0xc3 && marker <= 0xcf &&
+                marker != 0xc4 && marker != 0xc8 && marker != 0xcc) ||
+               marker == 0xda) {
+      /* lossless or arithmetic coded, like raw sensor data */
+      return FALSE;
+    }
+
+    pos += 2 + size;
+  }
+
+  return FALSE;
+}
+
+static void
+consider_candidate (TiffReader *reader,
+                    gsize offset,
+                    gsize length)
+{
+  SushiExifPreview *best = reader->best;
+  gsize tiff_offset, tiff_length;
+  gint width, height;
+
+  if (offset == 0 || length == 0 ||
+      offset >= reader->length || length > reader->length - offset)
+    return;
+
+  if (!scan_jpeg (reader->data + offset, length, &width, &height,
+                  &tiff_offset, &tiff_length))
+    return;
+
+  if ((gint64) width * height <=
+      (gint64) best->preview_width * best->preview_height)
+    return;
+
+  best->offset = reader->base + offset;
+  best->length = length;
+  best->preview_width = width;
+  best->preview_height = height;
+}
+
+static void
+read_ifd (TiffReader *reader,
+          guint32 offset,
+          gint depth)
+{
+  const guchar *entry;
+  guint n_entries, tag, type, idx;
+  guint32 count, value;
+  guint32 jpeg_offset = 0, jpeg_length = 0;
+  guint32 strip_offset = 0, strip_length = 0;
+  guint32 sub_ifds = 0, n_sub_ifds = 0;
+  guint compression = 0;
+
+  while (offset != 0 && reader->n_ifds++ < MAX_IFDS) {
+    if (offset > reader->length - 2)
+      return;
+
+    n_entries = read_u16 (reader->data + offset, reader->big_endian);
+    if ((gsize) offset + 2 + n_entries * 12 + 4 > reader->length)
+      return;
+
+    for (idx = 0; idx < n_entries; idx++) {
+      entry = reader->data + offset + 2 + idx * 12;
+
+      tag = read_u16 (entry, reader->big_endian);
+      type = read_u16 (entry + 2, reader->big_endian);
+      count = read_u32 (entry + 4, reader->big_endian);
+
+      /* SHORT values are left-aligned in the field */
+      if (type == 3)
+        value = read_u16 (entry + 8, reader->big_endian);
+      else
+        value = read_u32 (entry + 8, reader->big_endian);
+
+      switch (tag) {
+      case TAG_COMPRESSION:
+        compression = value;
+        break;
+      case TAG_ORIENTATION:
+        if (reader->orientation == 0 && depth == 0)
+          reader->orientation = value;
+        break;
+      case TAG_STRIP_OFFSETS:
+        if (count == 1)
+          strip_offset = value;
+        break;
+      case TAG_STRIP_BYTE_COUNTS:
+        if (count == 1)
+          strip_length = value;
+        break;
+      case TAG_SUB_IFDS:
+        sub_ifds = value;
+        n_sub_ifds = count;
+        break;
+      case TAG_JPEG_OFFSET:
+        jpeg_offset = value;
+        break;
+      case TAG_JPEG_LENGTH:
+        jpeg_length = value;
+        break;
+      default:
+        break;
+      }
+    }
+
+    consider_candidate (reader, jpeg_offset, jpeg_length);
+
+    /* a single strip of old or new style JPEG; the lossless ones
+     * holding the sensor data are turned down when scanned.
+     */
+    if (compression == 6 || compression == 7)
+      consider_candidate (reader, strip_offset, strip_length);
+
+    if (depth < 2 && n_sub_ifds == 1) {
+      read_ifd (reader, sub_ifds, depth + 1);
+    } else if (depth < 2 && n_sub_ifds > 1 &&
+               sub_ifds < reader->length &&
+               (gsize) n_sub_ifds * 4 <= reader->length - sub_ifds) {
+      for (idx = 0; idx < n_sub_ifds; idx++)
+        read_ifd (reader,
+                  read_u32 (reader->data + sub_ifds + idx * 4, reader->big_endian),
+                  depth + 1);
+    }
+
+    offset = read_u32 (reader->data + offset + 2 + n_entries * 12,
+                       reader->big_endian);
+
+    jpeg_offset = jpeg_length = strip_offset = strip_length = 0;
+    sub_ifds = n_sub_ifds = 0;
+    compression = 0;
+  }
+}
+
+static gboolean
+read_tiff (const guchar *data,
+           gsize length,
+           gsize base,
+           SushiExifPreview *preview,
+           gint *orientation)
+{
+  TiffReader reader = { 0, };
+  guint magic;
+
+  if (length < 8)
+    return FALSE;
+
+  if (data[0] == 'I' && data[1] == 'I')
+    reader.big_endian = FALSE;
+  else if (data[0] == 'M' && data[1] == 'M')
+    reader.big_endian = TRUE;
+  else
+    return FALSE;
+
+  /* TIFF, and the variants of Olympus and Panasonic */
+  magic = read_u16 (data + 2, reader.big_endian);
+  if (magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55)
+    return FALSE;
+
+  /* offsets are relative to the TIFF header, which is @base bytes into
+   * the file.
+   */
+  reader.data = data;
+  reader.length = length;
+  reader.base = base;
+  reader.best = preview;
+
+  read_ifd (&reader, read_u32 (data + 4, reader.big_endian), 0);
+
+  if (reader.orientation != 0)
+    *orientation = reader.orientation;
+
+  return TRUE;
+}
+
+/**
+ * sushi_exif_preview_find: (skip)
+ * @data: the contents of the file
+ * @length: the length of @data
+ * @preview: (out caller-allocates): where to store the preview found
+ *
+ * Looks for the largest embedded JPEG preview of a photo or camera raw
+ * file, that GdkPixbuf can decode.
+ *
+ * Returns: %TRUE if one was found
+ */
+gboolean
+sushi_exif_preview_find (const guchar *data,
+                         gsize length,
+                         SushiExifPreview *preview)
+{
+  gsize tiff_offset, tiff_length;
+  gsize raf_offset, raf_length;
+  gint width, height;
+  gint orientation = 0;
+
+  memset (preview, 0, sizeof (SushiExifPreview));
+
+  if (scan_jpeg (data, length, &width, &height, &tiff_offset, &tiff_length) ||
+      tiff_offset != 0) {
+    /* a photo, with a thumbnail in its EXIF block */
+    preview->image_width = width;
+    preview->image_height = height;
+
+    if (tiff_offset != 0)
+      read_tiff (data + tiff_offset, tiff_length, tiff_offset,
+                 preview, &orientation);
+  } else if (length >= 92 &&
+             memcmp (data, RAF_MAGIC, strlen (RAF_MAGIC)) == 0) {
+    raf_offset = read_u32 (data + 84, TRUE);
+    raf_length = read_u32 (data + 88, TRUE);
+
+    if (raf_offset < length && raf_length <= length - raf_offset &&
+        scan_jpeg (data + raf_offset, raf_length, &width, &height,
+                   &tiff_offset, &tiff_length)) {
+      preview->offset = raf_offset;
+      preview->length = raf_length;
+      preview->preview_width = width;
+      preview->preview_height = height;
+    }
+  } else {
+    read_tiff (data, length, 0, preview, &orientation);
+  }
+
+  if (preview->length == 0)
+    return FALSE;
+
+  /* the preview itself may know how it's oriented */
+  if (orientation == 0 &&
+      scan_jpeg (data + preview->offset, preview->length,
+                 &width, &height, &tiff_offset, &tiff_length) &&
+      tiff_offset != 0) {
+    SushiExifPreview inner = { 0, };
+
+    read_tiff (data + preview->offset + tiff_offset, tiff_length, 0,
+               &inner, &orientation);
+  }
+
+  preview->orientation = CLAMP (orientation, 1, 8);
+
+  /* raw files don't say how large the developed image is, but their
+   * largest preview usually is full size.
+   */
+  if (preview->image_width == 0) {
+    preview->image_width = preview->preview_width;
+    preview->image_height = preview->preview_height;
+  }
+
+  return TRUE;
+}
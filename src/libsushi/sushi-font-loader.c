@@ -26,146 +26,319 @@
 #include "sushi-font-loader.h"
 
 #include <stdlib.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
 
-#include <gio/gio.h>
+/* One FreeType library for the whole process, and the latest faces
+ * opened with it, kept parsed along with their cairo font faces. A face
+ * stays valid as long as its cairo font face does; cached faces are
+ * found again by URI, modification time and face index, without reading
+ * the file again.
+ */
+
+/* how much font data the cache may keep */
+#define FONT_CACHE_SIZE (32 * 1024 * 1024)
+
+#define FONT_QUERY_ATTRIBUTES \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
 
 typedef struct {
-  FT_Library library;
-  FT_Long face_index;
-  GFile *file;
+  gchar *key;
+  FT_Face face;
+  cairo_font_face_t *font_face;
+  gsize size;
+} CachedFace;
 
-  gchar *face_contents;
-  gsize face_length;
-} FontLoadJob;
+/* FreeType wants faces to be created and released one at a time */
+static GMutex library_lock;
+static FT_Library library = NULL;
 
-static FontLoadJob *
-font_load_job_new (FT_Library library,
-                   const gchar *uri,
-                   GAsyncReadyCallback callback,
-                   gpointer user_data)
+static GMutex cache_lock;
+static GQueue cache_lru = G_QUEUE_INIT;
+static GHashTable *cache = NULL;
+static gsize cached_bytes = 0;
+
+static const cairo_user_data_key_t ft_face_key;
+
+/**
+ * sushi_font_loader_get_library: (skip)
+ *
+ * Returns: (transfer none): the FreeType library shared by all of
+ *   Sushi; it must not be used from several threads at once.
+ */
+FT_Library
+sushi_font_loader_get_library (void)
 {
-  FontLoadJob *job = g_slice_new0 (FontLoadJob);
+  static gsize initialized = 0;
 
-  job->library = library;
-  job->face_index = 0;
-  job->file = g_file_new_for_uri (uri);
+  if (g_once_init_enter (&initialized)) {
+    if (FT_Init_FreeType (&library) != FT_Err_Ok)
+      g_error ("Unable to initialize FreeType");
 
-  return job;
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return library;
 }
 
 static void
-font_load_job_free (FontLoadJob *job)
+free_face_contents (void *object)
 {
-  g_clear_object (&job->file);
+  FT_Face face = object;
 
-  g_slice_free (FontLoadJob, job);
+  g_free (face->generic.data);
+}
+
+static void
+done_face (void *user_data)
+{
+  FT_Face face = user_data;
+
+  g_mutex_lock (&library_lock);
+  FT_Done_Face (face);
+  g_mutex_unlock (&library_lock);
+}
+
+static void
+cached_face_free (CachedFace *cached)
+{
+  g_free (cached->key);
+  cairo_font_face_destroy (cached->font_face);
+  done_face (cached->face);
+
+  g_slice_free (CachedFace, cached);
+}
+
+/* Returns a new reference to the cairo font face for @key, if any. */
+static cairo_font_face_t *
+cache_lookup (const gchar *key,
+              FT_Face *face)
+{
+  cairo_font_face_t *font_face = NULL;
+  CachedFace *cached;
+  GList *link = NULL;
+
+  g_mutex_lock (&cache_lock);
+
+  if (cache != NULL)
+    link = g_hash_table_lookup (cache, key);
+
+  if (link != NULL) {
+    cached = link->data;
+
+    g_queue_unlink (&cache_lru, link);
+    g_queue_push_head_link (&cache_lru, link);
+
+    font_face = cairo_font_face_reference (cached->font_face);
+    *face = cached->face;
+  }
+
+  g_mutex_unlock (&cache_lock);
+
+  return font_face;
 }
 
-static FT_Face
-create_face_from_contents (FontLoadJob *job,
-                           gchar **contents,
-                           GError **error)
+/* Takes @cached over. */
+static void
+cache_insert (CachedFace *cached)
 {
+  CachedFace *old;
+  GList *link;
+
+  g_mutex_lock (&cache_lock);
+
+  if (cache == NULL)
+    cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  link = g_hash_table_lookup (cache, cached->key);
+  if (link != NULL) {
+    old = link->data;
+
+    g_hash_table_remove (cache, old->key);
+    cached_bytes -= old->size;
+    g_queue_delete_link (&cache_lru, link);
+    cached_face_free (old);
+  }
+
+  g_queue_push_head (&cache_lru, cached);
+  g_hash_table_insert (cache, cached->key, cache_lru.head);
+  cached_bytes += cached->size;
+
+  while (cached_bytes > FONT_CACHE_SIZE && cache_lru.length > 1) {
+    old = g_queue_pop_tail (&cache_lru);
+
+    g_hash_table_remove (cache, old->key);
+    cached_bytes -= old->size;
+
+    cached_face_free (old);
+  }
+
+  g_mutex_unlock (&cache_lock);
+}
+
+static CachedFace *
+open_face (GFile *file,
+           FT_Long face_index,
+           GCancellable *cancellable,
+           GError **error)
+{
+  CachedFace *cached;
   FT_Error ft_error;
-  FT_Face retval;
+  FT_Face face;
+  gchar *contents, *uri;
+  gsize length;
 
-  ft_error = FT_New_Memory_Face (job->library,
-                                 (const FT_Byte *) job->face_contents,
-                                 (FT_Long) job->face_length,
-                                 job->face_index,
-                                 &retval);
+  if (!g_file_load_contents (file, cancellable,
+                             &contents, &length, NULL, error))
+    return NULL;
+
+  g_mutex_lock (&library_lock);
+  ft_error = FT_New_Memory_Face (sushi_font_loader_get_library (),
+                                 (const FT_Byte *) contents,
+                                 (FT_Long) length,
+                                 face_index,
+                                 &face);
+  g_mutex_unlock (&library_lock);
 
   if (ft_error != 0) {
-    gchar *uri;
-    uri = g_file_get_uri (job->file);
+    uri = g_file_get_uri (file);
     g_set_error (error, G_IO_ERROR, 0,
                  "Unable to read the font face file '%s'", uri);
-    retval = NULL;
-    g_free (job->face_contents);
     g_free (uri);
-  } else {
-    *contents = job->face_contents;
+    g_free (contents);
+
+    return NULL;
   }
 
-  return retval;
+  /* the contents go away with the last reference to the face */
+  face->generic.data = contents;
+  face->generic.finalizer = free_face_contents;
+
+  cached = g_slice_new0 (CachedFace);
+  cached->face = face;
+  cached->size = length;
+
+  /* the cairo font face holds a reference of its own to the face */
+  cached->font_face = cairo_ft_font_face_create_for_ft_face (face, 0);
+  FT_Reference_Face (face);
+  cairo_font_face_set_user_data (cached->font_face, &ft_face_key,
+                                 face, done_face);
+
+  return cached;
 }
 
+typedef struct {
+  GFile *file;
+  FT_Long face_index;
+
+  FT_Face face;
+  cairo_font_face_t *font_face;
+} FontLoadJob;
+
 static void
-font_load_job_do_load (FontLoadJob *job,
-                       GError **error)
+font_load_job_free (FontLoadJob *job)
 {
-  gchar *contents;
-  gsize length;
+  g_clear_object (&job->file);
 
-  g_file_load_contents (job->file, NULL,
-                        &contents, &length, NULL, error);
+  if (job->font_face != NULL)
+    cairo_font_face_destroy (job->font_face);
 
-  if ((error != NULL) && (*error == NULL)) {
-    job->face_contents = contents;
-    job->face_length = length;
-  }
+  g_slice_free (FontLoadJob, job);
+}
+
+static gchar *
+build_cache_key (GFile *file,
+                 FT_Long face_index,
+                 GFileInfo *info)
+{
+  gchar *uri, *key;
+
+  uri = g_file_get_uri (file);
+  key = g_strdup_printf ("%s:%" G_GUINT64_FORMAT ".%u:%ld", uri,
+                         g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                         g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+                         (glong) face_index);
+  g_free (uri);
+
+  return key;
 }
 
 static void
 font_load_job (GTask *task,
-	       gpointer source_object,
-	       gpointer user_data,
+               gpointer source_object,
+               gpointer user_data,
                GCancellable *cancellable)
 {
   FontLoadJob *job = user_data;
+  CachedFace *cached;
+  GFileInfo *info;
+  gchar *key = NULL;
   GError *error = NULL;
 
-  font_load_job_do_load (job, &error);
+  /* files which can't tell when they changed aren't cached */
+  info = g_file_query_info (job->file, FONT_QUERY_ATTRIBUTES,
+                            G_FILE_QUERY_INFO_NONE, cancellable, NULL);
 
-  if (error != NULL)
-    g_task_return_error (task, error);
-  else
-    g_task_return_boolean (task, TRUE);
-}
+  if (info != NULL &&
+      g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+    key = build_cache_key (job->file, job->face_index, info);
+    job->font_face = cache_lookup (key, &job->face);
+  }
 
-/**
- * sushi_new_ft_face_from_uri: (skip)
- *
- */
-FT_Face
-sushi_new_ft_face_from_uri (FT_Library library,
-                            const gchar *uri,
-                            gchar **contents,
-                            GError **error)
-{
-  FontLoadJob *job = NULL;
-  FT_Face face;
+  g_clear_object (&info);
 
-  job = font_load_job_new (library, uri, NULL, NULL);
-  font_load_job_do_load (job, error);
+  if (job->font_face != NULL) {
+    g_free (key);
+    g_task_return_boolean (task, TRUE);
+    return;
+  }
 
-  if ((error != NULL) && (*error != NULL)) {
-    font_load_job_free (job);
-    return NULL;
+  cached = open_face (job->file, job->face_index, cancellable, &error);
+
+  if (cached == NULL) {
+    g_free (key);
+    g_task_return_error (task, error);
+    return;
   }
 
-  face = create_face_from_contents (job, contents, error);
-  font_load_job_free (job);
+  job->face = cached->face;
+  job->font_face = cairo_font_face_reference (cached->font_face);
+
+  if (key != NULL) {
+    cached->key = key;
+    cache_insert (cached);
+  } else {
+    cached_face_free (cached);
+  }
 
-  return face;
+  g_task_return_boolean (task, TRUE);
 }
 
 /**
  * sushi_new_ft_face_from_uri_async: (skip)
+ * @uri:
+ * @face_index: the index of the face in the file
+ * @cancellable: (allow-none):
+ * @callback:
+ * @user_data:
  *
+ * Opens a font face with the shared FreeType library, in a thread,
+ * unless it was opened recently and the file didn't change since.
  */
 void
-sushi_new_ft_face_from_uri_async (FT_Library library,
-                                  const gchar *uri,
+sushi_new_ft_face_from_uri_async (const gchar *uri,
+                                  gint face_index,
+                                  GCancellable *cancellable,
                                   GAsyncReadyCallback callback,
                                   gpointer user_data)
 {
-  FontLoadJob *job = font_load_job_new (library, uri, callback, user_data);
+  FontLoadJob *job;
   GTask *task;
 
-  task = g_task_new (NULL, NULL, callback, user_data);
+  job = g_slice_new0 (FontLoadJob);
+  job->file = g_file_new_for_uri (uri);
+  job->face_index = face_index;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
   g_task_set_task_data (task, job, (GDestroyNotify) font_load_job_free);
   g_task_run_in_thread (task, font_load_job);
   g_object_unref (task);
@@ -173,11 +346,16 @@ sushi_new_ft_face_from_uri_async (FT_Library library,
 
 /**
  * sushi_new_ft_face_from_uri_finish: (skip)
+ * @result:
+ * @font_face: (out): a new reference to the cairo font face for the face
+ * @error:
  *
+ * Returns: the face, which stays valid as long as @font_face does; it
+ *   must only be used from the main thread.
  */
 FT_Face
 sushi_new_ft_face_from_uri_finish (GAsyncResult *result,
-                                   gchar **contents,
+                                   cairo_font_face_t **font_face,
                                    GError **error)
 {
   FontLoadJob *job;
@@ -187,5 +365,8 @@ sushi_new_ft_face_from_uri_finish (GAsyncResult *result,
 
   job = g_task_get_task_data (G_TASK (result));
 
-  return create_face_from_contents (job, contents, error);
+  *font_face = job->font_face;
+  job->font_face = NULL;
+
+  return job->face;
 }
@@ -28,20 +28,19 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <cairo/cairo-ft.h>
 #include <gio/gio.h>
 
-FT_Face sushi_new_ft_face_from_uri (FT_Library library,
-                                    const gchar *uri,
-                                    gchar **contents,
-                                    GError **error);
+FT_Library sushi_font_loader_get_library (void);
 
-void sushi_new_ft_face_from_uri_async (FT_Library library,
-                                       const gchar *uri,
+void sushi_new_ft_face_from_uri_async (const gchar *uri,
+                                       gint face_index,
+                                       GCancellable *cancellable,
                                        GAsyncReadyCallback callback,
                                        gpointer user_data);
 
 FT_Face sushi_new_ft_face_from_uri_finish (GAsyncResult *result,
-                                           gchar **contents,
+                                           cairo_font_face_t **font_face,
                                            GError **error);
 
 #endif /* __SUSHI_FONT_LOADER_H__ */
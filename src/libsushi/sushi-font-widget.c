@@ -44,9 +44,10 @@ enum {
 struct _SushiFontWidgetPrivate {
   gchar *uri;
 
-  FT_Library library;
+  /* the face is valid as long as the font face is */
   FT_Face face;
-  gchar *face_contents;
+  cairo_font_face_t *font_face;
+  GCancellable *cancellable;
 
   const gchar *lowercase_text;
   const gchar *uppercase_text;
@@ -439,7 +440,6 @@ sushi_font_widget_size_request (GtkWidget *drawing_area,
   gint i, pixmap_width, pixmap_height;
   cairo_text_extents_t extents;
   cairo_font_extents_t font_extents;
-  cairo_font_face_t *font;
   gint *sizes = NULL, n_sizes, alpha_size, title_size;
   cairo_t *cr;
   cairo_surface_t *surface;
@@ -475,9 +475,7 @@ sushi_font_widget_size_request (GtkWidget *drawing_area,
   pixmap_width = padding.left + padding.right;
   pixmap_height = padding.top + padding.bottom;
 
-  font = cairo_ft_font_face_create_for_ft_face (face, 0);
-  cairo_set_font_face (cr, font);
-  cairo_font_face_destroy (font);
+  cairo_set_font_face (cr, priv->font_face);
 
   if (self->priv->font_name != NULL) {
       cairo_set_font_size (cr, title_size);
@@ -577,7 +575,6 @@ sushi_font_widget_draw (GtkWidget *drawing_area,
   SushiFontWidget *self = SUSHI_FONT_WIDGET (drawing_area);
   SushiFontWidgetPrivate *priv = self->priv;
   gint *sizes = NULL, n_sizes, alpha_size, title_size, pos_y = 0, i;
-  cairo_font_face_t *font;
   FT_Face face = priv->face;
   GtkStyleContext *context;
   GdkRGBA color;
@@ -604,9 +601,7 @@ sushi_font_widget_draw (GtkWidget *drawing_area,
 
   sizes = build_sizes_table (face, &n_sizes, &alpha_size, &title_size);
 
-  font = cairo_ft_font_face_create_for_ft_face (face, 0);
-  cairo_set_font_face (cr, font);
-  cairo_font_face_destroy (font);
+  cairo_set_font_face (cr, priv->font_face);
 
   /* draw text */
 
@@ -658,21 +653,30 @@ font_face_async_ready_cb (GObject *object,
                           gpointer user_data)
 {
   SushiFontWidget *self = user_data;
+  cairo_font_face_t *font_face = NULL;
+  FT_Face face;
   GError *error = NULL;
 
-  self->priv->face =
-    sushi_new_ft_face_from_uri_finish (result,
-                                       &self->priv->face_contents,
-                                       &error);
+  face = sushi_new_ft_face_from_uri_finish (result, &font_face, &error);
 
   if (error != NULL) {
-    g_signal_emit (self, signals[ERROR], 0, error->message);
-    g_print ("Can't load the font face: %s\n", error->message);
+    /* when cancelled, we may be gone already */
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_signal_emit (self, signals[ERROR], 0, error->message);
+      g_print ("Can't load the font face: %s\n", error->message);
+    }
+
     g_error_free (error);
 
     return;
   }
 
+  if (self->priv->font_face != NULL)
+    cairo_font_face_destroy (self->priv->font_face);
+
+  self->priv->face = face;
+  self->priv->font_face = font_face;
+
   build_strings_for_face (self);
 
   gtk_widget_queue_resize (GTK_WIDGET (self));
@@ -682,8 +686,16 @@ font_face_async_ready_cb (GObject *object,
 static void
 load_font_face (SushiFontWidget *self)
 {
-  sushi_new_ft_face_from_uri_async (self->priv->library,
-                                    self->priv->uri,
+  /* a font loaded for the previous URI isn't wanted anymore */
+  if (self->priv->cancellable != NULL) {
+    g_cancellable_cancel (self->priv->cancellable);
+    g_object_unref (self->priv->cancellable);
+  }
+
+  self->priv->cancellable = g_cancellable_new ();
+
+  sushi_new_ft_face_from_uri_async (self->priv->uri, 0,
+                                    self->priv->cancellable,
                                     font_face_async_ready_cb,
                                     self);
 }
@@ -701,16 +713,10 @@ sushi_font_widget_set_uri (SushiFontWidget *self,
 static void
 sushi_font_widget_init (SushiFontWidget *self)
 {
-  FT_Error err;
-
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, SUSHI_TYPE_FONT_WIDGET,
                                             SushiFontWidgetPrivate);
 
   self->priv->face = NULL;
-  err = FT_Init_FreeType (&self->priv->library);
-
-  if (err != FT_Err_Ok)
-    g_error ("Unable to initialize FreeType");
 
   gtk_style_context_add_class (gtk_widget_get_style_context (GTK_WIDGET (self)),
                                GTK_STYLE_CLASS_VIEW);
@@ -759,20 +765,23 @@ sushi_font_widget_finalize (GObject *object)
 
   g_free (self->priv->uri);
 
-  if (self->priv->face != NULL) {
-    FT_Done_Face (self->priv->face);
-    self->priv->face = NULL;
+  /* a load still running doesn't call back into us */
+  if (self->priv->cancellable != NULL) {
+    g_cancellable_cancel (self->priv->cancellable);
+    g_object_unref (self->priv->cancellable);
   }
 
-  g_free (self->priv->font_name);
-  g_free (self->priv->sample_string);
-  g_free (self->priv->face_contents);
+  /* the face goes with the font face, or stays in the cache */
+  self->priv->face = NULL;
 
-  if (self->priv->library != NULL) {
-    FT_Done_FreeType (self->priv->library);
-    self->priv->library = NULL;
+  if (self->priv->font_face != NULL) {
+    cairo_font_face_destroy (self->priv->font_face);
+    self->priv->font_face = NULL;
   }
 
+  g_free (self->priv->font_name);
+  g_free (self->priv->sample_string);
+
   G_OBJECT_CLASS (sushi_font_widget_parent_class)->finalize (object);
 }
 
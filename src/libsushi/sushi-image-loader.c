@@ -0,0 +1,1306 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-image-loader.h"
+
+#include "sushi-exif-preview.h"
+
+#include <gdk/gdk.h>
+#include <librsvg/rsvg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOAD_BUFFER_SIZE 65536
+
+/* decodes are heavy on memory; a few at a time is plenty, and the most
+ * recently asked for goes first.
+ */
+#define MAX_DECODERS 2
+
+/* the smallest step of progress worth telling about */
+#define PROGRESS_STEP 0.05
+
+/* how long a decode runs before what's there so far is shown, and how
+ * often that's updated, in microseconds.
+ */
+#define PARTIAL_IMAGE_DELAY (300 * G_TIME_SPAN_MILLISECOND)
+#define PARTIAL_IMAGE_INTERVAL (200 * G_TIME_SPAN_MILLISECOND)
+
+/* SVGs are drawn at the size they're shown at; the latest few of those
+ * are kept, shared by all loaders.
+ */
+#define SVG_CACHE_SIZE (32 * 1024 * 1024)
+
+#define SVG_QUERY_ATTRIBUTES \
+  G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED
+
+G_DEFINE_TYPE (SushiImageLoader, sushi_image_loader, G_TYPE_OBJECT);
+
+enum {
+  PROP_FILE = 1,
+  PROP_ORIGINAL_WIDTH,
+  PROP_ORIGINAL_HEIGHT,
+  PROP_ANIMATION,
+  PROP_PROGRESS,
+  PROP_SCALABLE,
+  PROP_ORIENTATION,
+  PROP_PRIORITY,
+  NUM_PROPERTIES
+};
+
+enum {
+  PARTIAL_IMAGE,
+  NUM_SIGNALS
+};
+
+static GParamSpec* properties[NUM_PROPERTIES] = { NULL, };
+static guint signals[NUM_SIGNALS] = { 0, };
+
+struct _SushiImageLoaderPrivate {
+  GFile *file;
+
+  gint original_width;
+  gint original_height;
+  GdkPixbufAnimation *animation;
+  gdouble progress;
+  gboolean scalable;
+  gint orientation;
+  gint priority;
+};
+
+typedef struct {
+  GTaskThreadFunc func;
+  guint serial;
+
+  gint max_width;
+  gint max_height;
+  gdouble progress;
+
+  /* the size the image is decoded at */
+  gint target_width;
+  gint target_height;
+  gint64 last_partial_time;
+
+  gint original_width;
+  gint original_height;
+  GdkPixbufAnimation *animation;
+  gboolean scalable;
+  gint orientation;
+} LoadData;
+
+static void
+load_data_free (LoadData *data)
+{
+  g_clear_object (&data->animation);
+  g_slice_free (LoadData, data);
+}
+
+typedef struct {
+  SushiImageLoader *loader;
+  gdouble progress;
+} ProgressUpdate;
+
+static gboolean
+progress_update_cb (gpointer user_data)
+{
+  ProgressUpdate *update = user_data;
+
+  update->loader->priv->progress = update->progress;
+  g_object_notify_by_pspec (G_OBJECT (update->loader), properties[PROP_PROGRESS]);
+
+  return FALSE;
+}
+
+static void
+progress_update_free (ProgressUpdate *update)
+{
+  g_object_unref (update->loader);
+  g_slice_free (ProgressUpdate, update);
+}
+
+/* called in the decoding thread */
+static void
+report_progress (GTask *task,
+                 gdouble progress)
+{
+  LoadData *data = g_task_get_task_data (task);
+  ProgressUpdate *update;
+
+  if (progress < 1.0 && progress - data->progress < PROGRESS_STEP)
+    return;
+
+  data->progress = progress;
+
+  update = g_slice_new0 (ProgressUpdate);
+  update->loader = g_object_ref (g_task_get_source_object (task));
+  update->progress = progress;
+
+  g_main_context_invoke_full (g_task_get_context (task), G_PRIORITY_DEFAULT,
+                              progress_update_cb, update,
+                              (GDestroyNotify) progress_update_free);
+}
+
+static void
+run_load_task (gpointer task_data,
+               gpointer user_data)
+{
+  GTask *task = task_data;
+  LoadData *data = g_task_get_task_data (task);
+
+  /* nobody wants it anymore */
+  if (!g_task_return_error_if_cancelled (task))
+    data->func (task, g_task_get_source_object (task), data,
+                g_task_get_cancellable (task));
+
+  g_object_unref (task);
+}
+
+static gint
+compare_load_tasks (gconstpointer a,
+                    gconstpointer b,
+                    gpointer user_data)
+{
+  SushiImageLoader *loader_a = g_task_get_source_object ((GTask *) a);
+  SushiImageLoader *loader_b = g_task_get_source_object ((GTask *) b);
+  LoadData *data_a = g_task_get_task_data ((GTask *) a);
+  LoadData *data_b = g_task_get_task_data ((GTask *) b);
+  gint priority_a, priority_b;
+
+  /* the image on screen goes before the ones prefetched around it */
+  priority_a = g_atomic_int_get (&loader_a->priv->priority);
+  priority_b = g_atomic_int_get (&loader_b->priv->priority);
+
+  if (priority_a != priority_b)
+    return (priority_a < priority_b) ? -1 : 1;
+
+  /* then newest first */
+  if (data_a->serial == data_b->serial)
+    return 0;
+
+  return (data_a->serial > data_b->serial) ? -1 : 1;
+}
+
+static GThreadPool *
+get_decoders (void)
+{
+  static gsize pool = 0;
+
+  if (g_once_init_enter (&pool)) {
+    GThreadPool *decoders;
+
+    decoders = g_thread_pool_new (run_load_task, NULL,
+                                  MAX_DECODERS, FALSE, NULL);
+    g_thread_pool_set_sort_function (decoders, compare_load_tasks, NULL);
+
+    g_once_init_leave (&pool, (gsize) decoders);
+  }
+
+  return (GThreadPool *) pool;
+}
+
+/* Like g_task_run_in_thread(), on a pool of our own. */
+static void
+run_in_decoder (GTask *task,
+                GTaskThreadFunc func)
+{
+  static guint serial = 0;
+  LoadData *data = g_task_get_task_data (task);
+
+  data->func = func;
+  data->serial = g_atomic_int_add (&serial, 1);
+
+  g_thread_pool_push (get_decoders (), g_object_ref (task), NULL);
+}
+
+static void
+set_priority (SushiImageLoader *self,
+              gint priority)
+{
+  if (self->priv->priority == priority)
+    return;
+
+  g_atomic_int_set (&self->priv->priority, priority);
+
+  /* the loads already queued move along */
+  g_thread_pool_set_sort_function (get_decoders (), compare_load_tasks, NULL);
+}
+
+/* the EXIF orientation of a decoded image; it's left to whoever shows
+ * the image to apply it, as a transformation rather than a copy.
+ */
+static gint
+get_orientation (GdkPixbuf *pixbuf)
+{
+  const gchar *orientation;
+
+  orientation = gdk_pixbuf_get_option (pixbuf, "orientation");
+  if (orientation == NULL)
+    return 1;
+
+  return CLAMP (atoi (orientation), 1, 8);
+}
+
+static void
+set_original_size (SushiImageLoader *self,
+                   gint width,
+                   gint height)
+{
+  if (self->priv->original_width == width &&
+      self->priv->original_height == height)
+    return;
+
+  self->priv->original_width = width;
+  self->priv->original_height = height;
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_ORIGINAL_WIDTH]);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_ORIGINAL_HEIGHT]);
+}
+
+static void
+set_orientation (SushiImageLoader *self,
+                 gint orientation)
+{
+  if (self->priv->orientation == orientation)
+    return;
+
+  self->priv->orientation = orientation;
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_ORIENTATION]);
+}
+
+static void
+size_prepared_cb (GdkPixbufLoader *loader,
+                  gint width,
+                  gint height,
+                  gpointer user_data)
+{
+  LoadData *data = user_data;
+  gdouble scale;
+
+  data->original_width = width;
+  data->original_height = height;
+  data->target_width = width;
+  data->target_height = height;
+
+  if (data->max_width <= 0 || data->max_height <= 0)
+    return;
+
+  /* the orientation isn't known before the image is decoded, so make
+   * sure it fills the box whichever way it ends up.
+   */
+  scale = MAX (MIN ((gdouble) data->max_width / width,
+                    (gdouble) data->max_height / height),
+               MIN ((gdouble) data->max_width / height,
+                    (gdouble) data->max_height / width));
+
+  /* the decoders which can, like JPEG's DCT scaling, decode straight
+   * to the requested size.
+   */
+  if (scale < 1.0) {
+    data->target_width = MAX ((gint) (width * scale + 0.5), 1);
+    data->target_height = MAX ((gint) (height * scale + 0.5), 1);
+
+    gdk_pixbuf_loader_set_size (loader,
+                                data->target_width, data->target_height);
+  }
+}
+
+static void
+area_prepared_cb (GdkPixbufLoader *loader,
+                  gpointer user_data)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+  /* what isn't decoded yet may be shown; make it blank */
+  if (pixbuf != NULL)
+    gdk_pixbuf_fill (pixbuf, 0x00000000);
+}
+
+typedef struct {
+  SushiImageLoader *loader;
+  GdkPixbuf *pixbuf;
+  gint orientation;
+  gint original_width;
+  gint original_height;
+} PartialImage;
+
+static gboolean
+partial_image_cb (gpointer user_data)
+{
+  PartialImage *partial = user_data;
+
+  /* the image may be shown, and laid out, from here on */
+  set_original_size (partial->loader,
+                     partial->original_width, partial->original_height);
+  set_orientation (partial->loader, partial->orientation);
+  g_signal_emit (partial->loader, signals[PARTIAL_IMAGE], 0, partial->pixbuf);
+
+  return FALSE;
+}
+
+static void
+partial_image_free (PartialImage *partial)
+{
+  g_object_unref (partial->pixbuf);
+  g_object_unref (partial->loader);
+  g_slice_free (PartialImage, partial);
+}
+
+/* Called in the decoding thread, between writes to the loader. This
+ * doesn't rely on GdkPixbufLoader::area-updated, which isn't emitted
+ * when the loader scales the image itself at the end.
+ */
+static void
+maybe_report_partial_image (GTask *task,
+                            GdkPixbufLoader *loader,
+                            gint64 start_time)
+{
+  LoadData *data = g_task_get_task_data (task);
+  PartialImage *partial;
+  GdkPixbuf *pixbuf, *scaled;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  if (now - start_time < PARTIAL_IMAGE_DELAY ||
+      now - data->last_partial_time < PARTIAL_IMAGE_INTERVAL)
+    return;
+
+  pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+  if (pixbuf == NULL || data->target_width <= 0)
+    return;
+
+  data->last_partial_time = now;
+
+  if (gdk_pixbuf_get_width (pixbuf) != data->target_width ||
+      gdk_pixbuf_get_height (pixbuf) != data->target_height)
+    scaled = gdk_pixbuf_scale_simple (pixbuf,
+                                      data->target_width, data->target_height,
+                                      GDK_INTERP_BILINEAR);
+  else
+    scaled = gdk_pixbuf_copy (pixbuf);
+
+  if (scaled == NULL)
+    return;
+
+  partial = g_slice_new0 (PartialImage);
+  partial->loader = g_object_ref (g_task_get_source_object (task));
+  partial->pixbuf = scaled;
+  partial->orientation = get_orientation (pixbuf);
+
+  /* EXIF orientations 5 to 8 swap the axes */
+  if (partial->orientation >= 5) {
+    partial->original_width = data->original_height;
+    partial->original_height = data->original_width;
+  } else {
+    partial->original_width = data->original_width;
+    partial->original_height = data->original_height;
+  }
+
+  g_main_context_invoke_full (g_task_get_context (task), G_PRIORITY_DEFAULT,
+                              partial_image_cb, partial,
+                              (GDestroyNotify) partial_image_free);
+}
+
+typedef struct {
+  gchar *key;
+  GdkPixbuf *pixbuf;
+  gint original_width;
+  gint original_height;
+} SvgRaster;
+
+static GMutex svg_cache_lock;
+static GQueue svg_cache_lru = G_QUEUE_INIT;
+static GHashTable *svg_cache = NULL;
+static gsize svg_cached_bytes = 0;
+
+static gsize
+pixbuf_get_byte_size (GdkPixbuf *pixbuf)
+{
+  return (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+}
+
+static void
+svg_raster_free (SvgRaster *raster)
+{
+  g_free (raster->key);
+  g_object_unref (raster->pixbuf);
+  g_slice_free (SvgRaster, raster);
+}
+
+/* Returns a copy of the cached raster for @key, if any. */
+static SvgRaster *
+svg_cache_lookup (const gchar *key)
+{
+  SvgRaster *raster, *copy = NULL;
+  GList *link = NULL;
+
+  g_mutex_lock (&svg_cache_lock);
+
+  if (svg_cache != NULL)
+    link = g_hash_table_lookup (svg_cache, key);
+
+  if (link != NULL) {
+    raster = link->data;
+
+    g_queue_unlink (&svg_cache_lru, link);
+    g_queue_push_head_link (&svg_cache_lru, link);
+
+    copy = g_slice_new0 (SvgRaster);
+    copy->key = g_strdup (key);
+    copy->pixbuf = g_object_ref (raster->pixbuf);
+    copy->original_width = raster->original_width;
+    copy->original_height = raster->original_height;
+  }
+
+  g_mutex_unlock (&svg_cache_lock);
+
+  return copy;
+}
+
+static void
+svg_cache_insert (const gchar *key,
+                  GdkPixbuf *pixbuf,
+                  gint original_width,
+                  gint original_height)
+{
+  SvgRaster *raster, *old;
+  GList *link;
+
+  raster = g_slice_new0 (SvgRaster);
+  raster->key = g_strdup (key);
+  raster->pixbuf = g_object_ref (pixbuf);
+  raster->original_width = original_width;
+  raster->original_height = original_height;
+
+  g_mutex_lock (&svg_cache_lock);
+
+  if (svg_cache == NULL)
+    svg_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  link = g_hash_table_lookup (svg_cache, key);
+  if (link != NULL) {
+    old = link->data;
+
+    g_hash_table_remove (svg_cache, old->key);
+    svg_cached_bytes -= pixbuf_get_byte_size (old->pixbuf);
+    g_queue_delete_link (&svg_cache_lru, link);
+    svg_raster_free (old);
+  }
+
+  g_queue_push_head (&svg_cache_lru, raster);
+  g_hash_table_insert (svg_cache, raster->key, svg_cache_lru.head);
+  svg_cached_bytes += pixbuf_get_byte_size (raster->pixbuf);
+
+  while (svg_cached_bytes > SVG_CACHE_SIZE && svg_cache_lru.length > 1) {
+    old = g_queue_pop_tail (&svg_cache_lru);
+
+    g_hash_table_remove (svg_cache, old->key);
+    svg_cached_bytes -= pixbuf_get_byte_size (old->pixbuf);
+
+    svg_raster_free (old);
+  }
+
+  g_mutex_unlock (&svg_cache_lock);
+}
+
+static GdkPixbuf *
+render_svg (GFile *file,
+            gint max_width,
+            gint max_height,
+            gint *original_width,
+            gint *original_height,
+            GCancellable *cancellable,
+            GError **error)
+{
+  RsvgHandle *handle;
+  RsvgDimensionData dimensions;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  GdkPixbuf *pixbuf;
+  gdouble scale = 1.0;
+  gint width, height;
+
+  handle = rsvg_handle_new_from_gfile_sync (file, RSVG_HANDLE_FLAGS_NONE,
+                                            cancellable, error);
+  if (handle == NULL)
+    return NULL;
+
+  rsvg_handle_get_dimensions (handle, &dimensions);
+
+  if (dimensions.width <= 0 || dimensions.height <= 0) {
+    g_object_unref (handle);
+
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "The image has no size");
+    return NULL;
+  }
+
+  /* unlike bitmaps, these are as sharp larger as they are smaller */
+  if (max_width > 0 && max_height > 0)
+    scale = MIN ((gdouble) max_width / dimensions.width,
+                 (gdouble) max_height / dimensions.height);
+
+  width = MAX ((gint) (dimensions.width * scale + 0.5), 1);
+  height = MAX ((gint) (dimensions.height * scale + 0.5), 1);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  cr = cairo_create (surface);
+  cairo_scale (cr,
+               (gdouble) width / dimensions.width,
+               (gdouble) height / dimensions.height);
+  rsvg_handle_render_cairo (handle, cr);
+  cairo_destroy (cr);
+
+  g_object_unref (handle);
+
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy (surface);
+
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Unable to draw the image");
+    return NULL;
+  }
+
+  pixbuf = gdk_pixbuf_get_from_surface (surface, 0, 0, width, height);
+  cairo_surface_destroy (surface);
+
+  if (pixbuf == NULL) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                         "Not enough memory to draw the image");
+    return NULL;
+  }
+
+  *original_width = dimensions.width;
+  *original_height = dimensions.height;
+
+  return pixbuf;
+}
+
+/* Called in the decoding thread. SVGs don't go through GdkPixbufLoader:
+ * they're drawn with librsvg at exactly the size asked for, and that
+ * raster is cached by the file's identity and the size.
+ */
+static void
+load_svg_thread (GTask *task,
+                 GFile *file,
+                 GFileInfo *info,
+                 GCancellable *cancellable)
+{
+  LoadData *data = g_task_get_task_data (task);
+  SvgRaster *raster;
+  GTimeVal mtime;
+  gchar *uri, *key;
+  GError *error = NULL;
+
+  g_file_info_get_modification_time (info, &mtime);
+
+  uri = g_file_get_uri (file);
+  key = g_strdup_printf ("%s:%ld.%ld:%dx%d", uri,
+                         (glong) mtime.tv_sec, (glong) mtime.tv_usec,
+                         data->max_width, data->max_height);
+  g_free (uri);
+
+  data->scalable = TRUE;
+  data->orientation = 1;
+
+  raster = svg_cache_lookup (key);
+
+  if (raster == NULL) {
+    raster = g_slice_new0 (SvgRaster);
+    raster->key = key;
+    raster->pixbuf = render_svg (file, data->max_width, data->max_height,
+                                 &raster->original_width,
+                                 &raster->original_height,
+                                 cancellable, &error);
+
+    if (raster->pixbuf == NULL) {
+      g_slice_free (SvgRaster, raster);
+      g_free (key);
+
+      g_task_return_error (task, error);
+      return;
+    }
+
+    svg_cache_insert (raster->key, raster->pixbuf,
+                      raster->original_width, raster->original_height);
+  } else {
+    g_free (key);
+  }
+
+  data->original_width = raster->original_width;
+  data->original_height = raster->original_height;
+
+  report_progress (task, 1.0);
+  g_task_return_pointer (task, g_object_ref (raster->pixbuf), g_object_unref);
+
+  svg_raster_free (raster);
+}
+
+static GdkPixbuf *decode_embedded_preview (SushiImageLoader *self,
+                                            LoadData *data,
+                                            GError **error);
+
+/* camera raw files, which GdkPixbuf mostly takes for TIFFs, and
+ * decodes the small thumbnail of
+ */
+static gboolean
+content_type_is_raw (const gchar *content_type)
+{
+  static const gchar *raw_types[] = {
+    "image/x-dcraw",
+    "image/x-adobe-dng",
+    "image/x-canon-cr2",
+    "image/x-fuji-raf",
+    "image/x-nikon-nef",
+    "image/x-nikon-nrw",
+    "image/x-olympus-orf",
+    "image/x-panasonic-rw2",
+    "image/x-pentax-pef",
+    "image/x-samsung-srw",
+    "image/x-sony-arw",
+    "image/x-sony-sr2"
+  };
+  guint idx;
+
+  if (content_type == NULL)
+    return FALSE;
+
+  for (idx = 0; idx < G_N_ELEMENTS (raw_types); idx++)
+    if (g_content_type_is_a (content_type, raw_types[idx]))
+      return TRUE;
+
+  return FALSE;
+}
+
+static void
+load_image_thread (GTask *task,
+                   gpointer source_object,
+                   gpointer task_data,
+                   GCancellable *cancellable)
+{
+  SushiImageLoader *self = source_object;
+  LoadData *data = task_data;
+  GFileInputStream *stream;
+  GdkPixbufLoader *loader;
+  GdkPixbufAnimation *animation;
+  GdkPixbuf *pixbuf;
+  GFileInfo *info;
+  const gchar *content_type = NULL;
+  guchar *buffer;
+  gssize bytes_read;
+  goffset size, total = 0;
+  gint64 start_time;
+  gint swap;
+  GError *error = NULL;
+
+  start_time = g_get_monotonic_time ();
+
+  info = g_file_query_info (self->priv->file, SVG_QUERY_ATTRIBUTES,
+                            G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+
+  if (info != NULL)
+    content_type = g_file_info_get_content_type (info);
+
+  if (content_type != NULL &&
+      (g_content_type_is_a (content_type, "image/svg+xml") ||
+       g_content_type_is_a (content_type, "image/svg+xml-compressed"))) {
+    load_svg_thread (task, self->priv->file, info, cancellable);
+    g_object_unref (info);
+    return;
+  }
+
+  /* the embedded preview is the largest image of a raw file there is
+   * to decode; the file itself only goes to GdkPixbuf without one.
+   */
+  if (content_type_is_raw (content_type)) {
+    pixbuf = decode_embedded_preview (self, data, NULL);
+
+    if (pixbuf != NULL) {
+      g_object_unref (info);
+
+      report_progress (task, 1.0);
+      g_task_return_pointer (task, pixbuf, g_object_unref);
+      return;
+    }
+  }
+
+  g_clear_object (&info);
+
+  stream = g_file_read (self->priv->file, cancellable, &error);
+  if (stream == NULL) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  info = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                         cancellable, NULL);
+  size = (info != NULL) ? g_file_info_get_size (info) : 0;
+  g_clear_object (&info);
+
+  loader = gdk_pixbuf_loader_new ();
+  g_signal_connect (loader, "size-prepared",
+                    G_CALLBACK (size_prepared_cb), data);
+  g_signal_connect (loader, "area-prepared",
+                    G_CALLBACK (area_prepared_cb), NULL);
+
+  buffer = g_malloc (LOAD_BUFFER_SIZE);
+
+  do {
+    bytes_read = g_input_stream_read (G_INPUT_STREAM (stream),
+                                      buffer, LOAD_BUFFER_SIZE,
+                                      cancellable, &error);
+
+    if (bytes_read > 0 && size > 0) {
+      total += bytes_read;
+      report_progress (task, MIN ((gdouble) total / size, 0.99));
+    }
+    if (bytes_read <= 0 ||
+        !gdk_pixbuf_loader_write (loader, buffer, bytes_read, &error))
+      break;
+
+    /* progressive and interlaced images sharpen as they go */
+    maybe_report_partial_image (task, loader, start_time);
+  } while (TRUE);
+
+  g_free (buffer);
+  g_object_unref (stream);
+
+  /* the loader must be closed even when giving up on it */
+  if (error != NULL) {
+    gdk_pixbuf_loader_close (loader, NULL);
+    g_object_unref (loader);
+
+    g_task_return_error (task, error);
+    return;
+  }
+
+  if (!gdk_pixbuf_loader_close (loader, &error)) {
+    g_object_unref (loader);
+
+    g_task_return_error (task, error);
+    return;
+  }
+
+  animation = gdk_pixbuf_loader_get_animation (loader);
+  if (animation != NULL && !gdk_pixbuf_animation_is_static_image (animation))
+    data->animation = g_object_ref (animation);
+
+  pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+  if (pixbuf != NULL) {
+    data->orientation = get_orientation (pixbuf);
+    g_object_ref (pixbuf);
+  }
+
+  /* EXIF orientations 5 to 8 swap the axes */
+  if (data->orientation >= 5) {
+    swap = data->original_width;
+    data->original_width = data->original_height;
+    data->original_height = swap;
+  }
+
+  g_object_unref (loader);
+
+  if (pixbuf == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "No image could be read from the file");
+    return;
+  }
+
+  g_task_return_pointer (task, pixbuf, g_object_unref);
+}
+
+/**
+ * sushi_image_loader_load_async:
+ * @self:
+ * @max_width: the width of the box the image is shown in, or 0
+ * @max_height: the height of the box the image is shown in, or 0
+ * @cancellable: (allow-none):
+ * @callback:
+ * @user_data:
+ *
+ * Decodes the image in a thread, no larger than it takes to fill a
+ * @max_width x @max_height box, once turned as
+ * #SushiImageLoader:orientation says. The orientation isn't applied to
+ * the pixels. A box of 0 x 0 decodes the image at its full size.
+ *
+ * Decodes share a small pool of threads, the latest asked for first;
+ * cancelling @cancellable drops a decode which didn't start yet, and
+ * stops a running one. #SushiImageLoader:progress follows the latter.
+ */
+void
+sushi_image_loader_load_async (SushiImageLoader *self,
+                               gint max_width,
+                               gint max_height,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+  LoadData *data;
+  GTask *task;
+
+  data = g_slice_new0 (LoadData);
+  data->max_width = max_width;
+  data->max_height = max_height;
+  data->orientation = 1;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task, data, (GDestroyNotify) load_data_free);
+  run_in_decoder (task, load_image_thread);
+
+  g_object_unref (task);
+}
+
+/**
+ * sushi_image_loader_load_finish:
+ * @self:
+ * @result:
+ * @error:
+ *
+ * Returns: (transfer full): the decoded image
+ */
+GdkPixbuf *
+sushi_image_loader_load_finish (SushiImageLoader *self,
+                                GAsyncResult *result,
+                                GError **error)
+{
+  LoadData *data;
+  GdkPixbuf *pixbuf;
+
+  pixbuf = g_task_propagate_pointer (G_TASK (result), error);
+  if (pixbuf == NULL)
+    return NULL;
+
+  data = g_task_get_task_data (G_TASK (result));
+
+  set_original_size (self, data->original_width, data->original_height);
+  set_orientation (self, data->orientation);
+
+  if (data->scalable != self->priv->scalable) {
+    self->priv->scalable = data->scalable;
+    g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_SCALABLE]);
+  }
+
+  if (self->priv->progress != 1.0) {
+    self->priv->progress = 1.0;
+    g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_PROGRESS]);
+  }
+
+  if (data->animation != NULL && self->priv->animation == NULL) {
+    self->priv->animation = g_object_ref (data->animation);
+    g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_ANIMATION]);
+  }
+
+  return pixbuf;
+}
+
+/* Decodes the JPEG preview embedded in the file, fitted to the box in
+ * @data; fails with %G_IO_ERROR_NOT_FOUND if there's none.
+ */
+static GdkPixbuf *
+decode_embedded_preview (SushiImageLoader *self,
+                         LoadData *data,
+                         GError **error)
+{
+  SushiExifPreview preview;
+  GMappedFile *mapped;
+  GdkPixbufLoader *loader;
+  GdkPixbuf *pixbuf;
+  const guchar *contents;
+  gchar *path;
+  gboolean res;
+  GError *local_error = NULL;
+
+  path = g_file_get_path (self->priv->file);
+  if (path == NULL) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Only local files are looked into for previews");
+    return NULL;
+  }
+
+  /* only the headers, and the preview itself, are paged in */
+  mapped = g_mapped_file_new (path, FALSE, error);
+  g_free (path);
+
+  if (mapped == NULL)
+    return NULL;
+
+  contents = (const guchar *) g_mapped_file_get_contents (mapped);
+
+  if (!sushi_exif_preview_find (contents, g_mapped_file_get_length (mapped),
+                                &preview)) {
+    g_mapped_file_unref (mapped);
+
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                         "The file has no embedded preview");
+    return NULL;
+  }
+
+  loader = gdk_pixbuf_loader_new_with_type ("jpeg", error);
+  if (loader == NULL) {
+    g_mapped_file_unref (mapped);
+    return NULL;
+  }
+
+  g_signal_connect (loader, "size-prepared",
+                    G_CALLBACK (size_prepared_cb), data);
+
+  res = gdk_pixbuf_loader_write (loader, contents + preview.offset,
+                                 preview.length, &local_error);
+
+  /* the loader must be closed even when giving up on it */
+  if (!gdk_pixbuf_loader_close (loader, res ? &local_error : NULL))
+    res = FALSE;
+
+  g_mapped_file_unref (mapped);
+
+  pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+  if (!res || pixbuf == NULL) {
+    g_object_unref (loader);
+
+    if (local_error == NULL)
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "The embedded preview could not be read");
+    else
+      g_propagate_error (error, local_error);
+    return NULL;
+  }
+
+  /* the size is the one of the image the preview stands for */
+  if (preview.orientation >= 5) {
+    data->original_width = preview.image_height;
+    data->original_height = preview.image_width;
+  } else {
+    data->original_width = preview.image_width;
+    data->original_height = preview.image_height;
+  }
+
+  data->orientation = CLAMP (preview.orientation, 1, 8);
+
+  g_object_ref (pixbuf);
+  g_object_unref (loader);
+
+  return pixbuf;
+}
+
+static void
+load_preview_thread (GTask *task,
+                     gpointer source_object,
+                     gpointer task_data,
+                     GCancellable *cancellable)
+{
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  pixbuf = decode_embedded_preview (source_object, task_data, &error);
+
+  if (pixbuf == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, pixbuf, g_object_unref);
+}
+
+static void
+preview_query_info_cb (GObject *source,
+                       GAsyncResult *res,
+                       gpointer user_data)
+{
+  GTask *task = user_data;
+  GFileInfo *info;
+  const gchar *content_type = NULL;
+
+  info = g_file_query_info_finish (G_FILE (source), res, NULL);
+  if (info != NULL)
+    content_type = g_file_info_get_content_type (info);
+
+  /* the same decode as the image itself, twice over */
+  if (content_type_is_raw (content_type))
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "The image of a raw file is its preview already");
+  else
+    run_in_decoder (task, load_preview_thread);
+
+  g_clear_object (&info);
+  g_object_unref (task);
+}
+
+/**
+ * sushi_image_loader_load_preview_async:
+ * @self:
+ * @max_width: the width of the box the image is shown in, or 0
+ * @max_height: the height of the box the image is shown in, or 0
+ * @cancellable: (allow-none):
+ * @callback:
+ * @user_data:
+ *
+ * Decodes the JPEG preview embedded in a photo or a camera raw file,
+ * which is much quicker than decoding the image itself, and possible
+ * even when GdkPixbuf can't decode the image. Fails with
+ * %G_IO_ERROR_NOT_FOUND if the file has none, and with
+ * %G_IO_ERROR_NOT_SUPPORTED for camera raw files, whose preview is
+ * what sushi_image_loader_load_async() decodes already.
+ */
+void
+sushi_image_loader_load_preview_async (SushiImageLoader *self,
+                                       gint max_width,
+                                       gint max_height,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
+{
+  LoadData *data;
+  GTask *task;
+
+  data = g_slice_new0 (LoadData);
+  data->max_width = max_width;
+  data->max_height = max_height;
+  data->orientation = 1;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task, data, (GDestroyNotify) load_data_free);
+
+  /* the decoders aren't tied up until we know it's worth it */
+  g_file_query_info_async (self->priv->file,
+                           G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+                           G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT,
+                           cancellable, preview_query_info_cb, task);
+}
+
+/**
+ * sushi_image_loader_load_preview_finish:
+ * @self:
+ * @result:
+ * @error:
+ *
+ * Returns: (transfer full): the decoded preview
+ */
+GdkPixbuf *
+sushi_image_loader_load_preview_finish (SushiImageLoader *self,
+                                        GAsyncResult *result,
+                                        GError **error)
+{
+  LoadData *data;
+  GdkPixbuf *pixbuf;
+
+  pixbuf = g_task_propagate_pointer (G_TASK (result), error);
+  if (pixbuf == NULL)
+    return NULL;
+
+  /* the image itself knows better, if it was decoded already */
+  data = g_task_get_task_data (G_TASK (result));
+
+  if (self->priv->original_width == 0) {
+    set_original_size (self, data->original_width, data->original_height);
+    set_orientation (self, data->orientation);
+  }
+
+  return pixbuf;
+}
+
+static void
+sushi_image_loader_dispose (GObject *object)
+{
+  SushiImageLoader *self = SUSHI_IMAGE_LOADER (object);
+
+  g_clear_object (&self->priv->file);
+  g_clear_object (&self->priv->animation);
+
+  G_OBJECT_CLASS (sushi_image_loader_parent_class)->dispose (object);
+}
+
+static void
+sushi_image_loader_get_property (GObject *object,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  SushiImageLoader *self = SUSHI_IMAGE_LOADER (object);
+
+  switch (prop_id) {
+  case PROP_FILE:
+    g_value_set_object (value, self->priv->file);
+    break;
+  case PROP_ORIGINAL_WIDTH:
+    g_value_set_int (value, self->priv->original_width);
+    break;
+  case PROP_ORIGINAL_HEIGHT:
+    g_value_set_int (value, self->priv->original_height);
+    break;
+  case PROP_ANIMATION:
+    g_value_set_object (value, self->priv->animation);
+    break;
+  case PROP_PROGRESS:
+    g_value_set_double (value, self->priv->progress);
+    break;
+  case PROP_SCALABLE:
+    g_value_set_boolean (value, self->priv->scalable);
+    break;
+  case PROP_ORIENTATION:
+    g_value_set_int (value, self->priv->orientation);
+    break;
+  case PROP_PRIORITY:
+    g_value_set_int (value, self->priv->priority);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_image_loader_set_property (GObject *object,
+                                 guint       prop_id,
+                                 const GValue *value,
+                                 GParamSpec *pspec)
+{
+  SushiImageLoader *self = SUSHI_IMAGE_LOADER (object);
+
+  switch (prop_id) {
+  case PROP_FILE:
+    self->priv->file = g_value_dup_object (value);
+    break;
+  case PROP_PRIORITY:
+    set_priority (self, g_value_get_int (value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_image_loader_class_init (SushiImageLoaderClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->dispose = sushi_image_loader_dispose;
+  oclass->get_property = sushi_image_loader_get_property;
+  oclass->set_property = sushi_image_loader_set_property;
+
+  properties[PROP_FILE] =
+    g_param_spec_object ("file",
+                         "File",
+                         "The image file",
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  properties[PROP_ORIGINAL_WIDTH] =
+    g_param_spec_int ("original-width",
+                      "Original width",
+                      "The full width of the image, once oriented",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE);
+
+  properties[PROP_ORIGINAL_HEIGHT] =
+    g_param_spec_int ("original-height",
+                      "Original height",
+                      "The full height of the image, once oriented",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE);
+
+  properties[PROP_ANIMATION] =
+    g_param_spec_object ("animation",
+                         "Animation",
+                         "The animation, if the image is animated",
+                         GDK_TYPE_PIXBUF_ANIMATION,
+                         G_PARAM_READABLE);
+
+  properties[PROP_PROGRESS] =
+    g_param_spec_double ("progress",
+                         "Progress",
+                         "How much of the file the current decode went through",
+                         0.0, 1.0, 0.0,
+                         G_PARAM_READABLE);
+
+  properties[PROP_SCALABLE] =
+    g_param_spec_boolean ("scalable",
+                          "Scalable",
+                          "Whether the image is drawn sharp at any size",
+                          FALSE,
+                          G_PARAM_READABLE);
+
+  properties[PROP_ORIENTATION] =
+    g_param_spec_int ("orientation",
+                      "Orientation",
+                      "The EXIF orientation the image is to be shown with",
+                      1, 8, 1,
+                      G_PARAM_READABLE);
+
+  properties[PROP_PRIORITY] =
+    g_param_spec_int ("priority",
+                      "Priority",
+                      "The priority of the loads of the image among all others, lowest first",
+                      G_MININT, G_MAXINT, G_PRIORITY_DEFAULT,
+                      G_PARAM_READWRITE);
+
+  /**
+   * SushiImageLoader::partial-image:
+   * @self: the loader
+   * @pixbuf: what is decoded so far, at the size of the final image and
+   *   to be turned as #SushiImageLoader:orientation says
+   *
+   * Emitted now and then while a progressive or interlaced image is
+   * being decoded.
+   */
+  signals[PARTIAL_IMAGE] =
+    g_signal_new ("partial-image",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1, GDK_TYPE_PIXBUF);
+
+  g_object_class_install_properties (oclass, NUM_PROPERTIES, properties);
+
+  g_type_class_add_private (klass, sizeof (SushiImageLoaderPrivate));
+}
+
+static void
+sushi_image_loader_init (SushiImageLoader *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_IMAGE_LOADER,
+                                 SushiImageLoaderPrivate);
+
+  self->priv->orientation = 1;
+  self->priv->priority = G_PRIORITY_DEFAULT;
+}
+
+/**
+ * sushi_image_loader_new:
+ * @file: an image file
+ *
+ * Returns: (transfer full): a new #SushiImageLoader for @file
+ */
+SushiImageLoader *
+sushi_image_loader_new (GFile *file)
+{
+  return g_object_new (SUSHI_TYPE_IMAGE_LOADER,
+                       "file", file,
+                       NULL);
+}
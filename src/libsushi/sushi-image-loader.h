@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_IMAGE_LOADER_H__
+#define __SUSHI_IMAGE_LOADER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+#define SUSHI_TYPE_IMAGE_LOADER            (sushi_image_loader_get_type ())
+#define SUSHI_IMAGE_LOADER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUSHI_TYPE_IMAGE_LOADER, SushiImageLoader))
+#define SUSHI_IS_IMAGE_LOADER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SUSHI_TYPE_IMAGE_LOADER))
+#define SUSHI_IMAGE_LOADER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  SUSHI_TYPE_IMAGE_LOADER, SushiImageLoaderClass))
+#define SUSHI_IS_IMAGE_LOADER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  SUSHI_TYPE_IMAGE_LOADER))
+#define SUSHI_IMAGE_LOADER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  SUSHI_TYPE_IMAGE_LOADER, SushiImageLoaderClass))
+
+typedef struct _SushiImageLoader          SushiImageLoader;
+typedef struct _SushiImageLoaderPrivate   SushiImageLoaderPrivate;
+typedef struct _SushiImageLoaderClass     SushiImageLoaderClass;
+
+struct _SushiImageLoader
+{
+  GObject parent_instance;
+
+  SushiImageLoaderPrivate *priv;
+};
+
+struct _SushiImageLoaderClass
+{
+  GObjectClass parent_class;
+};
+
+GType    sushi_image_loader_get_type     (void) G_GNUC_CONST;
+
+SushiImageLoader *sushi_image_loader_new (GFile *file);
+
+void sushi_image_loader_load_async (SushiImageLoader *self,
+                                    gint max_width,
+                                    gint max_height,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+GdkPixbuf *sushi_image_loader_load_finish (SushiImageLoader *self,
+                                           GAsyncResult *result,
+                                           GError **error);
+
+void sushi_image_loader_load_preview_async (SushiImageLoader *self,
+                                            gint max_width,
+                                            gint max_height,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data);
+GdkPixbuf *sushi_image_loader_load_preview_finish (SushiImageLoader *self,
+                                                   GAsyncResult *result,
+                                                   GError **error);
+
+G_END_DECLS
+
+#endif /* __SUSHI_IMAGE_LOADER_H__ */
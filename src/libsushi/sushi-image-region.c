@@ -0,0 +1,1020 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+#include "sushi-image-region.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <png.h>
+#include <tiffio.h>
+
+/* Decodes rectangles of large images at a power of two scale, without
+ * ever holding the whole image in memory: JPEG goes through the libjpeg
+ * DCT scaling and the cropping/skipping entry points, PNG is streamed
+ * row by row, and TIFF is read a strip or a tile at a time. Everything
+ * else (as well as progressive JPEG and interlaced PNG) falls back to a
+ * GdkPixbuf decode of the whole level, made coarser when needed to stay
+ * within FALLBACK_MAX_BYTES; GdkPixbuf mostly decodes the whole image
+ * before scaling it, so images which would take more than
+ * FALLBACK_MAX_DECODE_BYTES to decode are refused.
+ *
+ * A region of level L is given in the coordinates of the image scaled
+ * by 1/2^L, whose size is the original one divided by 2^L, rounded up.
+ */
+
+#define FALLBACK_MAX_BYTES (32 * 1024 * 1024)
+#define FALLBACK_MAX_DECODE_BYTES (256 * 1024 * 1024)
+
+/* the largest strip or tile of a TIFF image read at once */
+#define TIFF_MAX_BLOCK_BYTES (64 * 1024 * 1024)
+
+typedef enum {
+  REGION_FORMAT_JPEG,
+  REGION_FORMAT_PNG,
+  REGION_FORMAT_TIFF,
+  REGION_FORMAT_PIXBUF
+} RegionFormat;
+
+/* a PNG decode which is kept open between two reads, so that reading
+ * the regions of a level from top to bottom doesn't inflate the file
+ * from the start every time.
+ */
+typedef struct {
+  FILE *fp;
+  png_structp png;
+  png_infop info;
+  gint next_row;
+  guchar *row;
+} PngCursor;
+
+struct _SushiImageRegionReader {
+  gchar *path;
+  RegionFormat format;
+  gint width;
+  gint height;
+
+  GMutex lock;
+  PngCursor *cursor;
+  GdkPixbuf *fallback;
+  gint fallback_level;
+
+  /* what a GdkPixbuf decode of the whole image takes */
+  gsize decode_bytes;
+
+  /* strips are read as tiles as wide as the image */
+  TIFF *tiff;
+  gboolean tiff_tiled;
+  gboolean tiff_alpha;
+  guint32 block_width;
+  guint32 block_height;
+};
+
+/* Box-filters the rows of the decoded region into the destination,
+ * averaging each factor x factor block into a pixel.
+ */
+typedef struct {
+  guchar *pixels;
+  gint rowstride;
+  gint n_channels;
+  gint width;
+  gint height;
+
+  gint factor;
+  gint src_width;
+
+  guint32 *sums;
+  gint rows_in;
+  gint out_row;
+} RegionSink;
+
+static void
+region_sink_init (RegionSink *sink,
+                  guchar *pixels,
+                  gint rowstride,
+                  gint n_channels,
+                  gint width,
+                  gint height,
+                  gint factor,
+                  gint src_width)
+{
+  memset (sink, 0, sizeof (RegionSink));
+
+  sink->pixels = pixels;
+  sink->rowstride = rowstride;
+  sink->n_channels = n_channels;
+  sink->width = width;
+  sink->height = height;
+  sink->factor = factor;
+  sink->src_width = src_width;
+
+  if (factor > 1)
+    sink->sums = g_new0 (guint32, width * n_channels);
+}
+
+static void
+region_sink_flush (RegionSink *sink)
+{
+  guchar *dest;
+  gint col, c, cols;
+
+  if (sink->rows_in == 0 || sink->out_row >= sink->height)
+    return;
+
+  dest = sink->pixels + sink->out_row * sink->rowstride;
+
+  for (col = 0; col < sink->width; col++) {
+    cols = MIN (sink->factor, sink->src_width - col * sink->factor);
+
+    for (c = 0; c < sink->n_channels; c++) {
+      guint32 *sum = &sink->sums[col * sink->n_channels + c];
+
+      dest[col * sink->n_channels + c] = *sum / (cols * sink->rows_in);
+      *sum = 0;
+    }
+  }
+
+  sink->rows_in = 0;
+  sink->out_row++;
+}
+
+static void
+region_sink_push_row (RegionSink *sink,
+                      const guchar *row)
+{
+  gint col, c, x, x_end;
+
+  if (sink->factor == 1) {
+    if (sink->out_row < sink->height)
+      memcpy (sink->pixels + sink->out_row * sink->rowstride,
+              row, sink->width * sink->n_channels);
+    sink->out_row++;
+    return;
+  }
+
+  for (col = 0; col < sink->width; col++) {
+    guint32 *sum = &sink->sums[col * sink->n_channels];
+
+    x_end = MIN ((col + 1) * sink->factor, sink->src_width);
+
+    for (x = col * sink->factor; x < x_end; x++)
+      for (c = 0; c < sink->n_channels; c++)
+        sum[c] += row[x * sink->n_channels + c];
+  }
+
+  if (++sink->rows_in == sink->factor)
+    region_sink_flush (sink);
+}
+
+static void
+region_sink_finish (RegionSink *sink)
+{
+  region_sink_flush (sink);
+  g_free (sink->sums);
+  sink->sums = NULL;
+}
+
+static gint
+level_size (gint size,
+            gint level)
+{
+  return MAX (1, (size + (1 << level) - 1) >> level);
+}
+
+/* JPEG */
+
+#define JPEG_REGION_MARGIN 16
+
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+  gchar message[JMSG_LENGTH_MAX];
+} JpegError;
+
+static void
+jpeg_error_exit_cb (j_common_ptr cinfo)
+{
+  JpegError *error = (JpegError *) cinfo->err;
+
+  cinfo->err->format_message (cinfo, error->message);
+  longjmp (error->setjmp_buffer, 1);
+}
+
+static void
+jpeg_output_message_cb (j_common_ptr cinfo)
+{
+  /* warnings about recoverable corruption aren't interesting here */
+}
+
+static FILE *
+jpeg_open (const gchar *path,
+           struct jpeg_decompress_struct *cinfo,
+           JpegError *jerr,
+           GError **error)
+{
+  FILE *fp;
+
+  fp = fopen (path, "rb");
+  if (fp == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to open %s", path);
+    return NULL;
+  }
+
+  cinfo->err = jpeg_std_error (&jerr->pub);
+  jerr->pub.error_exit = jpeg_error_exit_cb;
+  jerr->pub.output_message = jpeg_output_message_cb;
+
+  jpeg_create_decompress (cinfo);
+  jpeg_stdio_src (cinfo, fp);
+
+  return fp;
+}
+
+static gboolean
+jpeg_read_size (SushiImageRegionReader *reader,
+                GError **error)
+{
+  struct jpeg_decompress_struct cinfo;
+  JpegError jerr;
+  FILE *fp;
+
+  fp = jpeg_open (reader->path, &cinfo, &jerr, error);
+  if (fp == NULL)
+    return FALSE;
+
+  if (setjmp (jerr.setjmp_buffer)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to read the JPEG header: %s", jerr.message);
+    jpeg_destroy_decompress (&cinfo);
+    fclose (fp);
+    return FALSE;
+  }
+
+  jpeg_read_header (&cinfo, TRUE);
+
+  reader->width = cinfo.image_width;
+  reader->height = cinfo.image_height;
+
+  /* libjpeg can't convert these to RGB itself, and can't skip through
+   * progressive scans without buffering all of their coefficients
+   */
+  if (cinfo.jpeg_color_space == JCS_CMYK ||
+      cinfo.jpeg_color_space == JCS_YCCK ||
+      cinfo.progressive_mode)
+    reader->format = REGION_FORMAT_PIXBUF;
+
+  /* the 16-bit coefficients of every component, or a decode scaled
+   * down by 8 by libjpeg
+   */
+  if (cinfo.progressive_mode)
+    reader->decode_bytes = (gsize) reader->width * reader->height *
+      cinfo.num_components * 2;
+  else
+    reader->decode_bytes = (gsize) reader->width * reader->height * 4 / 64;
+
+  jpeg_destroy_decompress (&cinfo);
+  fclose (fp);
+
+  return TRUE;
+}
+
+static gboolean
+jpeg_read_region (SushiImageRegionReader *reader,
+                  gint level,
+                  gint x,
+                  gint y,
+                  gint width,
+                  gint height,
+                  guchar *pixels,
+                  gint rowstride,
+                  GCancellable *cancellable,
+                  GError **error)
+{
+  struct jpeg_decompress_struct cinfo;
+  JpegError jerr;
+  RegionSink sink;
+  FILE *fp;
+  gboolean res = TRUE;
+  guint32 * volatile sums = NULL;
+  guchar * volatile row = NULL;
+  gint denom, factor;
+  gint src_x0, src_y0, src_x1, src_y1;
+  JDIMENSION crop_x, crop_width;
+
+  /* libjpeg scales down by up to 8 while decoding; the rest is
+   * box-filtered.
+   */
+  denom = 1 << MIN (level, 3);
+  factor = 1 << (level - MIN (level, 3));
+
+  fp = jpeg_open (reader->path, &cinfo, &jerr, error);
+  if (fp == NULL)
+    return FALSE;
+
+  if (setjmp (jerr.setjmp_buffer)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to decode the JPEG image: %s", jerr.message);
+    g_free (row);
+    g_free (sums);
+    jpeg_destroy_decompress (&cinfo);
+    fclose (fp);
+    return FALSE;
+  }
+
+  jpeg_read_header (&cinfo, TRUE);
+
+  if (cinfo.progressive_mode) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Regions of progressive JPEG images can't be decoded");
+    jpeg_destroy_decompress (&cinfo);
+    fclose (fp);
+    return FALSE;
+  }
+
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  cinfo.out_color_space = JCS_RGB;
+
+  jpeg_start_decompress (&cinfo);
+
+  src_x0 = x * factor;
+  src_y0 = y * factor;
+  src_x1 = MIN ((x + width) * factor, (gint) cinfo.output_width);
+  src_y1 = MIN ((y + height) * factor, (gint) cinfo.output_height);
+
+  /* the chroma upsampling of the pixels at the edges of the region
+   * depends on their neighbours; decoding a margin around it keeps
+   * adjacent regions seamless. The crop is widened further to the iMCU
+   * boundaries by libjpeg.
+   */
+  crop_x = MAX (src_x0 - JPEG_REGION_MARGIN, 0);
+  crop_width = MIN (src_x1 + JPEG_REGION_MARGIN,
+                    (gint) cinfo.output_width) - crop_x;
+  jpeg_crop_scanline (&cinfo, &crop_x, &crop_width);
+
+  region_sink_init (&sink, pixels, rowstride, 3,
+                    width, height, factor, src_x1 - src_x0);
+  sums = sink.sums;
+  row = g_malloc (crop_width * 3);
+
+  if (src_y0 > JPEG_REGION_MARGIN)
+    jpeg_skip_scanlines (&cinfo, src_y0 - JPEG_REGION_MARGIN);
+
+  while ((gint) cinfo.output_scanline < src_y1) {
+    JSAMPROW rows[1] = { row };
+    gboolean in_region = ((gint) cinfo.output_scanline >= src_y0);
+
+    if (cinfo.output_scanline % 64 == 0 &&
+        g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      res = FALSE;
+      break;
+    }
+
+    jpeg_read_scanlines (&cinfo, rows, 1);
+
+    if (in_region)
+      region_sink_push_row (&sink, row + (src_x0 - crop_x) * 3);
+  }
+
+  region_sink_finish (&sink);
+  g_free (row);
+
+  jpeg_abort_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+  fclose (fp);
+
+  return res;
+}
+
+/* PNG */
+
+static void
+png_error_cb (png_structp png,
+              png_const_charp message)
+{
+  g_warning ("Unable to decode the PNG image: %s", message);
+  png_longjmp (png, 1);
+}
+
+static void
+png_warning_cb (png_structp png,
+                png_const_charp message)
+{
+}
+
+static void
+png_cursor_free (PngCursor *cursor)
+{
+  png_destroy_read_struct (&cursor->png, &cursor->info, NULL);
+  g_free (cursor->row);
+
+  if (cursor->fp != NULL)
+    fclose (cursor->fp);
+
+  g_slice_free (PngCursor, cursor);
+}
+
+static PngCursor *
+png_cursor_new (const gchar *path,
+                GError **error)
+{
+  PngCursor *cursor;
+  png_byte color_type;
+
+  cursor = g_slice_new0 (PngCursor);
+
+  cursor->fp = fopen (path, "rb");
+  if (cursor->fp == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to open %s", path);
+    g_slice_free (PngCursor, cursor);
+    return NULL;
+  }
+
+  cursor->png = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL,
+                                        png_error_cb, png_warning_cb);
+  cursor->info = png_create_info_struct (cursor->png);
+
+  if (setjmp (png_jmpbuf (cursor->png))) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to read the PNG header");
+    png_cursor_free (cursor);
+    return NULL;
+  }
+
+  png_init_io (cursor->png, cursor->fp);
+  png_read_info (cursor->png, cursor->info);
+
+  /* everything is turned into 8-bit RGBA */
+  color_type = png_get_color_type (cursor->png, cursor->info);
+
+  png_set_expand (cursor->png);
+  png_set_strip_16 (cursor->png);
+
+  if (color_type == PNG_COLOR_TYPE_GRAY ||
+      color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+    png_set_gray_to_rgb (cursor->png);
+
+  if (!(color_type & PNG_COLOR_MASK_ALPHA) &&
+      !png_get_valid (cursor->png, cursor->info, PNG_INFO_tRNS))
+    png_set_filler (cursor->png, 0xff, PNG_FILLER_AFTER);
+
+  png_read_update_info (cursor->png, cursor->info);
+
+  cursor->row = g_malloc (png_get_rowbytes (cursor->png, cursor->info));
+
+  return cursor;
+}
+
+static gboolean
+png_read_size (SushiImageRegionReader *reader,
+               GError **error)
+{
+  PngCursor *cursor;
+
+  cursor = png_cursor_new (reader->path, error);
+  if (cursor == NULL)
+    return FALSE;
+
+  reader->width = png_get_image_width (cursor->png, cursor->info);
+  reader->height = png_get_image_height (cursor->png, cursor->info);
+
+  /* rows of interlaced images only come out complete at the last pass */
+  if (png_get_interlace_type (cursor->png, cursor->info) != PNG_INTERLACE_NONE) {
+    reader->format = REGION_FORMAT_PIXBUF;
+    png_cursor_free (cursor);
+  } else {
+    reader->cursor = cursor;
+  }
+
+  return TRUE;
+}
+
+/* must be called with the reader lock held */
+static gboolean
+png_read_region (SushiImageRegionReader *reader,
+                 gint level,
+                 gint x,
+                 gint y,
+                 gint width,
+                 gint height,
+                 guchar *pixels,
+                 gint rowstride,
+                 GCancellable *cancellable,
+                 GError **error)
+{
+  PngCursor *cursor;
+  RegionSink sink;
+  gboolean res = TRUE;
+  gint factor;
+  gint src_x0, src_y0, src_x1, src_y1;
+
+  factor = 1 << level;
+
+  src_x0 = x * factor;
+  src_y0 = y * factor;
+  src_x1 = MIN ((x + width) * factor, reader->width);
+  src_y1 = MIN ((y + height) * factor, reader->height);
+
+  /* rows can only be read forward */
+  if (reader->cursor != NULL && reader->cursor->next_row > src_y0)
+    g_clear_pointer (&reader->cursor, png_cursor_free);
+
+  if (reader->cursor == NULL) {
+    reader->cursor = png_cursor_new (reader->path, error);
+    if (reader->cursor == NULL)
+      return FALSE;
+  }
+
+  cursor = reader->cursor;
+  region_sink_init (&sink, pixels, rowstride, 4,
+                    width, height, factor, src_x1 - src_x0);
+
+  if (setjmp (png_jmpbuf (cursor->png))) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to decode the PNG image");
+    g_free (sink.sums);
+    g_clear_pointer (&reader->cursor, png_cursor_free);
+    return FALSE;
+  }
+
+  while (cursor->next_row < src_y1) {
+    if (cursor->next_row % 64 == 0 &&
+        g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      res = FALSE;
+      break;
+    }
+
+    png_read_row (cursor->png, cursor->row, NULL);
+
+    if (cursor->next_row >= src_y0)
+      region_sink_push_row (&sink, cursor->row + src_x0 * 4);
+
+    cursor->next_row++;
+  }
+
+  region_sink_finish (&sink);
+
+  return res;
+}
+
+/* TIFF */
+
+static gboolean
+tiff_read_size (SushiImageRegionReader *reader,
+                GError **error)
+{
+  gchar message[1024];
+  guint32 width, height, rows_per_strip;
+  guint16 n_extra, *extra;
+
+  reader->tiff = TIFFOpen (reader->path, "r");
+  if (reader->tiff == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to read the TIFF header");
+    return FALSE;
+  }
+
+  TIFFGetField (reader->tiff, TIFFTAG_IMAGEWIDTH, &width);
+  TIFFGetField (reader->tiff, TIFFTAG_IMAGELENGTH, &height);
+
+  reader->width = width;
+  reader->height = height;
+
+  reader->tiff_tiled = TIFFIsTiled (reader->tiff);
+  if (reader->tiff_tiled) {
+    TIFFGetField (reader->tiff, TIFFTAG_TILEWIDTH, &reader->block_width);
+    TIFFGetField (reader->tiff, TIFFTAG_TILELENGTH, &reader->block_height);
+  } else {
+    TIFFGetFieldDefaulted (reader->tiff, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    reader->block_width = width;
+    reader->block_height = MIN (rows_per_strip, height);
+  }
+
+  TIFFGetFieldDefaulted (reader->tiff, TIFFTAG_EXTRASAMPLES, &n_extra, &extra);
+  reader->tiff_alpha = (n_extra > 0);
+
+  /* e.g. a single strip for the whole image, or a layout libtiff can't
+   * turn into RGBA
+   */
+  if ((gsize) reader->block_width * reader->block_height * 4 > TIFF_MAX_BLOCK_BYTES ||
+      !TIFFRGBAImageOK (reader->tiff, message)) {
+    reader->format = REGION_FORMAT_PIXBUF;
+    g_clear_pointer (&reader->tiff, TIFFClose);
+  }
+
+  return TRUE;
+}
+
+/* must be called with the reader lock held */
+static gboolean
+tiff_read_region (SushiImageRegionReader *reader,
+                  gint level,
+                  gint x,
+                  gint y,
+                  gint width,
+                  gint height,
+                  guchar *pixels,
+                  gint rowstride,
+                  GCancellable *cancellable,
+                  GError **error)
+{
+  guint32 *raster;
+  guint64 *sums, *sum;
+  gboolean res = TRUE;
+  gint n_channels, factor;
+  gint src_x0, src_y0, src_x1, src_y1;
+  gint bx, by, rows, row, col, c, block_x1, block_y1, n;
+  guint32 pixel;
+  guchar *dest;
+
+  factor = 1 << level;
+
+  src_x0 = x * factor;
+  src_y0 = y * factor;
+  src_x1 = MIN ((x + width) * factor, reader->width);
+  src_y1 = MIN ((y + height) * factor, reader->height);
+
+  raster = g_try_malloc ((gsize) reader->block_width * reader->block_height * 4);
+  if (raster == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Not enough memory to read the TIFF image");
+    return FALSE;
+  }
+
+  /* premultiplied, as libtiff hands it out, so that transparent
+   * pixels don't bleed into their neighbours
+   */
+  sums = g_new0 (guint64, (gsize) width * height * 4);
+
+  for (by = src_y0 - src_y0 % reader->block_height;
+       res && by < src_y1; by += reader->block_height) {
+    rows = MIN ((gint) reader->block_height, reader->height - by);
+    block_y1 = MIN (by + rows, src_y1);
+
+    for (bx = src_x0 - src_x0 % reader->block_width;
+         bx < src_x1; bx += reader->block_width) {
+      if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+        res = FALSE;
+        break;
+      }
+
+      if (reader->tiff_tiled)
+        res = TIFFReadRGBATile (reader->tiff, bx, by, raster);
+      else
+        res = TIFFReadRGBAStrip (reader->tiff, by, raster);
+
+      if (!res) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                     "Unable to decode the TIFF image");
+        break;
+      }
+
+      block_x1 = MIN (bx + (gint) reader->block_width, src_x1);
+
+      /* rows come bottom up, over a whole tile or what the strip has */
+      for (row = MAX (by, src_y0); row < block_y1; row++) {
+        const guint32 *line = raster + (gsize) reader->block_width *
+          ((reader->tiff_tiled ? (gint) reader->block_height : rows) - 1 - (row - by));
+
+        sum = sums + (gsize) ((row - src_y0) >> level) * width * 4;
+
+        for (col = MAX (bx, src_x0); col < block_x1; col++) {
+          guint64 *s = sum + ((col - src_x0) >> level) * 4;
+
+          pixel = line[col - bx];
+          s[0] += TIFFGetR (pixel);
+          s[1] += TIFFGetG (pixel);
+          s[2] += TIFFGetB (pixel);
+          s[3] += TIFFGetA (pixel);
+        }
+      }
+    }
+  }
+
+  n_channels = reader->tiff_alpha ? 4 : 3;
+
+  for (row = 0; res && row < height; row++) {
+    dest = pixels + row * rowstride;
+    sum = sums + (gsize) row * width * 4;
+
+    for (col = 0; col < width; col++, sum += 4) {
+      n = (MIN ((col + 1) * factor, src_x1 - src_x0) - col * factor) *
+        (MIN ((row + 1) * factor, src_y1 - src_y0) - row * factor);
+
+      for (c = 0; c < 3; c++)
+        dest[col * n_channels + c] =
+          (sum[3] == 0) ? 0 : MIN (sum[c] * 255 / sum[3], 255);
+
+      if (n_channels == 4)
+        dest[col * 4 + 3] = sum[3] / n;
+    }
+  }
+
+  g_free (sums);
+  g_free (raster);
+
+  return res;
+}
+
+/* everything else */
+
+static gint
+fallback_level (SushiImageRegionReader *reader,
+                gint level)
+{
+  while ((gsize) level_size (reader->width, level) *
+         level_size (reader->height, level) * 4 > FALLBACK_MAX_BYTES)
+    level++;
+
+  return level;
+}
+
+/* must be called with the reader lock held */
+static GdkPixbuf *
+pixbuf_read_region (SushiImageRegionReader *reader,
+                    gint level,
+                    gint x,
+                    gint y,
+                    gint width,
+                    gint height,
+                    GError **error)
+{
+  GdkPixbuf *region;
+  gint decode_level, scale;
+
+  /* levels which don't fit are scaled up from the largest one that
+   * does, as the decode is kept around outside of the tile cache
+   */
+  decode_level = fallback_level (reader, level);
+
+  if (reader->fallback == NULL || reader->fallback_level != decode_level) {
+    g_clear_object (&reader->fallback);
+
+    reader->fallback =
+      gdk_pixbuf_new_from_file_at_scale (reader->path,
+                                         level_size (reader->width, decode_level),
+                                         level_size (reader->height, decode_level),
+                                         FALSE, error);
+    if (reader->fallback == NULL)
+      return NULL;
+
+    reader->fallback_level = decode_level;
+  }
+
+  scale = 1 << (decode_level - level);
+
+  /* the loader may round differently */
+  width = MIN (width, gdk_pixbuf_get_width (reader->fallback) * scale - x);
+  height = MIN (height, gdk_pixbuf_get_height (reader->fallback) * scale - y);
+
+  if (width <= 0 || height <= 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "Region out of the image");
+    return NULL;
+  }
+
+  if (decode_level == level) {
+    GdkPixbuf *sub;
+
+    sub = gdk_pixbuf_new_subpixbuf (reader->fallback, x, y, width, height);
+    region = gdk_pixbuf_copy (sub);
+    g_object_unref (sub);
+
+    return region;
+  }
+
+  region = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                           gdk_pixbuf_get_has_alpha (reader->fallback),
+                           8, width, height);
+  gdk_pixbuf_scale (reader->fallback, region,
+                    0, 0, width, height,
+                    -x, -y, (gdouble) scale, (gdouble) scale,
+                    GDK_INTERP_BILINEAR);
+
+  return region;
+}
+
+/**
+ * sushi_image_region_reader_open: (skip)
+ * @path: the local path of an image
+ * @error:
+ *
+ * Reads the header of the image at @path; this is cheap, whatever the
+ * size of the image.
+ *
+ * Returns: a new #SushiImageRegionReader, or %NULL
+ */
+SushiImageRegionReader *
+sushi_image_region_reader_open (const gchar *path,
+                                GError **error)
+{
+  SushiImageRegionReader *reader;
+  guchar magic[8] = { 0, };
+  gboolean res;
+  FILE *fp;
+
+  fp = fopen (path, "rb");
+  if (fp == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to open %s", path);
+    return NULL;
+  }
+
+  res = (fread (magic, 1, sizeof (magic), fp) == sizeof (magic));
+  fclose (fp);
+
+  if (!res) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Unable to read %s", path);
+    return NULL;
+  }
+
+  reader = g_slice_new0 (SushiImageRegionReader);
+  reader->path = g_strdup (path);
+  reader->fallback_level = -1;
+  g_mutex_init (&reader->lock);
+
+  if (magic[0] == 0xff && magic[1] == 0xd8 && magic[2] == 0xff) {
+    reader->format = REGION_FORMAT_JPEG;
+    res = jpeg_read_size (reader, error);
+  } else if (png_sig_cmp (magic, 0, sizeof (magic)) == 0) {
+    reader->format = REGION_FORMAT_PNG;
+    res = png_read_size (reader, error);
+  } else if ((magic[0] == 'I' && magic[1] == 'I' && (magic[2] == 42 || magic[2] == 43)) ||
+             (magic[0] == 'M' && magic[1] == 'M' && (magic[3] == 42 || magic[3] == 43))) {
+    reader->format = REGION_FORMAT_TIFF;
+    res = tiff_read_size (reader, error);
+  } else {
+    reader->format = REGION_FORMAT_PIXBUF;
+    res = (gdk_pixbuf_get_file_info (path, &reader->width,
+                                     &reader->height) != NULL);
+
+    if (!res)
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Unknown image format");
+  }
+
+  if (res && reader->decode_bytes == 0)
+    reader->decode_bytes = (gsize) reader->width * reader->height * 4;
+
+  if (res && reader->format == REGION_FORMAT_PIXBUF &&
+      reader->decode_bytes > FALLBACK_MAX_DECODE_BYTES) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "The image is too large to be decoded whole");
+    res = FALSE;
+  }
+
+  if (!res) {
+    sushi_image_region_reader_free (reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+/**
+ * sushi_image_region_reader_free: (skip)
+ * @reader:
+ */
+void
+sushi_image_region_reader_free (SushiImageRegionReader *reader)
+{
+  g_clear_pointer (&reader->cursor, png_cursor_free);
+  g_clear_pointer (&reader->tiff, TIFFClose);
+  g_clear_object (&reader->fallback);
+  g_mutex_clear (&reader->lock);
+  g_free (reader->path);
+
+  g_slice_free (SushiImageRegionReader, reader);
+}
+
+/**
+ * sushi_image_region_reader_get_size: (skip)
+ * @reader:
+ * @width: (out): the width of the image
+ * @height: (out): the height of the image
+ */
+void
+sushi_image_region_reader_get_size (SushiImageRegionReader *reader,
+                                    gint *width,
+                                    gint *height)
+{
+  if (width != NULL)
+    *width = reader->width;
+  if (height != NULL)
+    *height = reader->height;
+}
+
+/**
+ * sushi_image_region_reader_is_sequential: (skip)
+ * @reader:
+ *
+ * Returns: %TRUE if regions are read fastest from top to bottom
+ */
+gboolean
+sushi_image_region_reader_is_sequential (SushiImageRegionReader *reader)
+{
+  return (reader->format == REGION_FORMAT_PNG);
+}
+
+/**
+ * sushi_image_region_reader_read: (skip)
+ * @reader:
+ * @level: the image is scaled down by 2^@level
+ * @x: the left edge of the region, in the scaled image
+ * @y: the top edge of the region, in the scaled image
+ * @width: the width of the region
+ * @height: the height of the region
+ * @cancellable: (allow-none):
+ * @error:
+ *
+ * Decodes a region of the image scaled down by 2^@level, clipped to
+ * the scaled image. This can be called from any thread; reads of a PNG
+ * or a TIFF image are serialized, and PNG is fastest from top to bottom.
+ *
+ * Returns: (transfer full): the region, or %NULL
+ */
+GdkPixbuf *
+sushi_image_region_reader_read (SushiImageRegionReader *reader,
+                                gint level,
+                                gint x,
+                                gint y,
+                                gint width,
+                                gint height,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+  GdkPixbuf *region;
+  gboolean res;
+
+  width = MIN (x + width, level_size (reader->width, level)) - x;
+  height = MIN (y + height, level_size (reader->height, level)) - y;
+
+  if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "Region out of the image");
+    return NULL;
+  }
+
+  if (reader->format == REGION_FORMAT_PIXBUF) {
+    g_mutex_lock (&reader->lock);
+    region = pixbuf_read_region (reader, level, x, y, width, height, error);
+    g_mutex_unlock (&reader->lock);
+
+    return region;
+  }
+
+  region = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+                           reader->format == REGION_FORMAT_PNG ||
+                           (reader->format == REGION_FORMAT_TIFF && reader->tiff_alpha),
+                           8, width, height);
+
+  if (reader->format == REGION_FORMAT_JPEG) {
+    res = jpeg_read_region (reader, level, x, y, width, height,
+                            gdk_pixbuf_get_pixels (region),
+                            gdk_pixbuf_get_rowstride (region),
+                            cancellable, error);
+  } else if (reader->format == REGION_FORMAT_TIFF) {
+    g_mutex_lock (&reader->lock);
+    res = tiff_read_region (reader, level, x, y, width, height,
+                            gdk_pixbuf_get_pixels (region),
+                            gdk_pixbuf_get_rowstride (region),
+                            cancellable, error);
+    g_mutex_unlock (&reader->lock);
+  } else {
+    g_mutex_lock (&reader->lock);
+    res = png_read_region (reader, level, x, y, width, height,
+                           gdk_pixbuf_get_pixels (region),
+                           gdk_pixbuf_get_rowstride (region),
+                           cancellable, error);
+    g_mutex_unlock (&reader->lock);
+  }
+
+  if (!res)
+    g_clear_object (&region);
+
+  return region;
+}
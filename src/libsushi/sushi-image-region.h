@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_IMAGE_REGION_H__
+#define __SUSHI_IMAGE_REGION_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SushiImageRegionReader SushiImageRegionReader;
+
+SushiImageRegionReader *sushi_image_region_reader_open     (const gchar *path,
+                                                            GError **error);
+void                    sushi_image_region_reader_free     (SushiImageRegionReader *reader);
+
+void                    sushi_image_region_reader_get_size (SushiImageRegionReader *reader,
+                                                            gint *width,
+                                                            gint *height);
+gboolean                sushi_image_region_reader_is_sequential (SushiImageRegionReader *reader);
+
+GdkPixbuf *             sushi_image_region_reader_read     (SushiImageRegionReader *reader,
+                                                            gint level,
+                                                            gint x,
+                                                            gint y,
+                                                            gint width,
+                                                            gint height,
+                                                            GCancellable *cancellable,
+                                                            GError **error);
+
+G_END_DECLS
+
+#endif /* __SUSHI_IMAGE_REGION_H__ */
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-image-stats.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Histograms of the red, green, blue and luma values of a decoded
+ * image, and how much of it is clipped, computed in a thread. Images
+ * larger than MAX_SAMPLES pixels are sampled every few rows, and fully
+ * transparent pixels, whatever their color, are left out.
+ */
+
+#define MAX_SAMPLES (4 * 1024 * 1024)
+
+/* how many rows go by between looks at the cancellable */
+#define ROWS_PER_CHECK 64
+
+/* Rec. 601 luma, in 8 bits of fraction; the weights add up to 256 */
+#define LUMA_R 77
+#define LUMA_G 150
+#define LUMA_B 29
+
+#define N_CHANNELS 4
+
+G_DEFINE_TYPE (SushiImageStats, sushi_image_stats, G_TYPE_OBJECT);
+
+enum {
+  PROP_PIXBUF = 1,
+  PROP_N_SAMPLES,
+  PROP_MEAN_LUMA,
+  PROP_SHADOWS_CLIPPED,
+  PROP_HIGHLIGHTS_CLIPPED,
+  NUM_PROPERTIES
+};
+
+static GParamSpec* properties[NUM_PROPERTIES] = { NULL, };
+
+typedef struct {
+  guint32 histograms[N_CHANNELS][SUSHI_IMAGE_STATS_N_BINS];
+  guint64 luma_sum;
+  guint64 shadows;
+  guint64 highlights;
+  guint64 n_samples;
+} Accumulator;
+
+struct _SushiImageStatsPrivate {
+  GdkPixbuf *pixbuf;
+
+  Accumulator *result;
+};
+
+static void
+accumulate_pixel (const guchar *p,
+                  Accumulator *acc)
+{
+  guint luma;
+
+  acc->n_samples++;
+
+  acc->histograms[SUSHI_IMAGE_CHANNEL_RED][p[0]]++;
+  acc->histograms[SUSHI_IMAGE_CHANNEL_GREEN][p[1]]++;
+  acc->histograms[SUSHI_IMAGE_CHANNEL_BLUE][p[2]]++;
+
+  luma = (LUMA_R * p[0] + LUMA_G * p[1] + LUMA_B * p[2]) >> 8;
+  acc->histograms[SUSHI_IMAGE_CHANNEL_LUMA][luma]++;
+  acc->luma_sum += luma;
+
+  /* a pixel is clipped as soon as one of its channels is */
+  if (p[0] == 0 || p[1] == 0 || p[2] == 0)
+    acc->shadows++;
+  if (p[0] == 255 || p[1] == 255 || p[2] == 255)
+    acc->highlights++;
+}
+
+static void
+accumulate_row_c (const guchar *row,
+                  gint width,
+                  gint n_channels,
+                  Accumulator *acc)
+{
+  gint x;
+
+  for (x = 0; x < width; x++, row += n_channels)
+    if (n_channels < 4 || row[3] != 0)
+      accumulate_pixel (row, acc);
+}
+
+#ifdef __SSE2__
+
+/* the number of pixels among four with a bit set in @mask, which has
+ * a bit per byte of RGBA pixels.
+ */
+static inline guint
+count_pixels (guint mask)
+{
+  return ((mask & 0x000f) != 0) + ((mask & 0x00f0) != 0) +
+    ((mask & 0x0f00) != 0) + ((mask & 0xf000) != 0);
+}
+
+/* Four RGBA pixels at a time: luma and clipping are computed in the
+ * vector registers, leaving only the histogram counts to do one by one.
+ */
+static gint
+accumulate_row_sse2 (const guchar *row,
+                     gint width,
+                     Accumulator *acc)
+{
+  const __m128i weights = _mm_set_epi16 (0, LUMA_B, LUMA_G, LUMA_R,
+                                         0, LUMA_B, LUMA_G, LUMA_R);
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i full = _mm_set1_epi8 ((gchar) 0xff);
+  __m128i pixels, lo, hi, even, odd, luma, sum, transparent;
+  guint32 lumas[4];
+  guint32 sums[4];
+  guint zeros, hidden, shown;
+  gint x, idx;
+
+  sum = _mm_setzero_si128 ();
+
+  for (x = 0; x + 4 <= width; x += 4, row += 16) {
+    pixels = _mm_loadu_si128 ((const __m128i *) row);
+
+    /* R * wr + G * wg and B * wb + A * 0, for each pixel */
+    lo = _mm_madd_epi16 (_mm_unpacklo_epi8 (pixels, zero), weights);
+    hi = _mm_madd_epi16 (_mm_unpackhi_epi8 (pixels, zero), weights);
+
+    even = _mm_castps_si128 (_mm_shuffle_ps (_mm_castsi128_ps (lo),
+                                             _mm_castsi128_ps (hi),
+                                             _MM_SHUFFLE (2, 0, 2, 0)));
+    odd = _mm_castps_si128 (_mm_shuffle_ps (_mm_castsi128_ps (lo),
+                                            _mm_castsi128_ps (hi),
+                                            _MM_SHUFFLE (3, 1, 3, 1)));
+
+    /* alpha is the top byte of each pixel */
+    transparent = _mm_cmpeq_epi32 (_mm_srli_epi32 (pixels, 24), zero);
+
+    luma = _mm_srli_epi32 (_mm_add_epi32 (even, odd), 8);
+    sum = _mm_add_epi32 (sum, _mm_andnot_si128 (transparent, luma));
+    _mm_storeu_si128 ((__m128i *) lumas, luma);
+
+    /* the color channels of the pixels which aren't transparent */
+    zeros = _mm_movemask_epi8 (_mm_cmpeq_epi8 (pixels, zero));
+    hidden = zeros & 0x8888;
+    shown = 0x7777 & ~((hidden >> 1) | (hidden >> 2) | (hidden >> 3));
+
+    acc->n_samples += 4 - count_pixels (hidden);
+    acc->shadows += count_pixels (zeros & shown);
+    acc->highlights +=
+      count_pixels (_mm_movemask_epi8 (_mm_cmpeq_epi8 (pixels, full)) & shown);
+
+    for (idx = 0; idx < 4; idx++) {
+      if (hidden & (0x8 << (idx * 4)))
+        continue;
+
+      acc->histograms[SUSHI_IMAGE_CHANNEL_RED][row[idx * 4]]++;
+      acc->histograms[SUSHI_IMAGE_CHANNEL_GREEN][row[idx * 4 + 1]]++;
+      acc->histograms[SUSHI_IMAGE_CHANNEL_BLUE][row[idx * 4 + 2]]++;
+      acc->histograms[SUSHI_IMAGE_CHANNEL_LUMA][lumas[idx]]++;
+    }
+  }
+
+  /* a lane adds up at most 255 for every fourth pixel of a row */
+  _mm_storeu_si128 ((__m128i *) sums, sum);
+  acc->luma_sum += (guint64) sums[0] + sums[1] + sums[2] + sums[3];
+
+  return x;
+}
+
+#endif /* __SSE2__ */
+
+static void
+accumulate_row (const guchar *row,
+                gint width,
+                gint n_channels,
+                Accumulator *acc)
+{
+  gint done = 0;
+
+#ifdef __SSE2__
+  if (n_channels == 4)
+    done = accumulate_row_sse2 (row, width, acc);
+#endif
+
+  accumulate_row_c (row + done * n_channels, width - done, n_channels, acc);
+}
+
+static void
+compute_stats_thread (GTask *task,
+                      gpointer source_object,
+                      gpointer task_data,
+                      GCancellable *cancellable)
+{
+  GdkPixbuf *pixbuf = task_data;
+  Accumulator *acc;
+  const guchar *pixels;
+  gint width, height, rowstride, n_channels;
+  gint y, step;
+  guint64 n_pixels;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+  if (gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 || n_channels < 3) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Only 8-bit RGB images are supported");
+    return;
+  }
+
+  /* whole rows are sampled, which keeps the reads sequential */
+  n_pixels = (guint64) width * height;
+  step = (gint) MAX ((n_pixels + MAX_SAMPLES - 1) / MAX_SAMPLES, 1);
+
+  acc = g_new0 (Accumulator, 1);
+
+  for (y = 0; y < height; y += step) {
+    if ((y / step) % ROWS_PER_CHECK == 0 &&
+        g_cancellable_is_cancelled (cancellable)) {
+      g_free (acc);
+      g_task_return_error_if_cancelled (task);
+      return;
+    }
+
+    accumulate_row (pixels + (gsize) y * rowstride, width, n_channels, acc);
+  }
+
+  g_task_return_pointer (task, acc, g_free);
+}
+
+/**
+ * sushi_image_stats_compute_async:
+ * @self:
+ * @cancellable: (allow-none):
+ * @callback:
+ * @user_data:
+ *
+ * Computes the histograms and the statistics of the image in a thread.
+ */
+void
+sushi_image_stats_compute_async (SushiImageStats *self,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+  GTask *task;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task, g_object_ref (self->priv->pixbuf), g_object_unref);
+  g_task_run_in_thread (task, compute_stats_thread);
+
+  g_object_unref (task);
+}
+
+/**
+ * sushi_image_stats_compute_finish:
+ * @self:
+ * @result:
+ * @error:
+ *
+ * Returns: %TRUE if the histograms and the statistics are ready
+ */
+gboolean
+sushi_image_stats_compute_finish (SushiImageStats *self,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+  Accumulator *acc;
+
+  acc = g_task_propagate_pointer (G_TASK (result), error);
+  if (acc == NULL)
+    return FALSE;
+
+  g_free (self->priv->result);
+  self->priv->result = acc;
+
+  g_object_freeze_notify (G_OBJECT (self));
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_N_SAMPLES]);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_MEAN_LUMA]);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_SHADOWS_CLIPPED]);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_HIGHLIGHTS_CLIPPED]);
+  g_object_thaw_notify (G_OBJECT (self));
+
+  return TRUE;
+}
+
+/**
+ * sushi_image_stats_get_histogram:
+ * @self:
+ * @channel:
+ * @n_bins: (out):
+ *
+ * Returns: (array length=n_bins) (transfer none): how many of the
+ *   sampled pixels have each value of @channel, or %NULL before the
+ *   statistics are computed
+ */
+const guint32 *
+sushi_image_stats_get_histogram (SushiImageStats *self,
+                                 SushiImageChannel channel,
+                                 guint *n_bins)
+{
+  g_return_val_if_fail (channel <= SUSHI_IMAGE_CHANNEL_LUMA, NULL);
+
+  if (self->priv->result == NULL) {
+    *n_bins = 0;
+    return NULL;
+  }
+
+  *n_bins = SUSHI_IMAGE_STATS_N_BINS;
+  return self->priv->result->histograms[channel];
+}
+
+static gdouble
+get_average (SushiImageStats *self,
+              guint64 count)
+{
+  if (self->priv->result == NULL || self->priv->result->n_samples == 0)
+    return 0.0;
+
+  return (gdouble) count / self->priv->result->n_samples;
+}
+
+static void
+sushi_image_stats_dispose (GObject *object)
+{
+  SushiImageStats *self = SUSHI_IMAGE_STATS (object);
+
+  g_clear_object (&self->priv->pixbuf);
+
+  G_OBJECT_CLASS (sushi_image_stats_parent_class)->dispose (object);
+}
+
+static void
+sushi_image_stats_finalize (GObject *object)
+{
+  SushiImageStats *self = SUSHI_IMAGE_STATS (object);
+
+  g_free (self->priv->result);
+
+  G_OBJECT_CLASS (sushi_image_stats_parent_class)->finalize (object);
+}
+
+static void
+sushi_image_stats_get_property (GObject *object,
+                                guint prop_id,
+                                GValue *value,
+                                GParamSpec *pspec)
+{
+  SushiImageStats *self = SUSHI_IMAGE_STATS (object);
+  Accumulator *acc = self->priv->result;
+
+  switch (prop_id) {
+  case PROP_PIXBUF:
+    g_value_set_object (value, self->priv->pixbuf);
+    break;
+  case PROP_N_SAMPLES:
+    g_value_set_uint64 (value, (acc != NULL) ? acc->n_samples : 0);
+    break;
+  case PROP_MEAN_LUMA:
+    g_value_set_double (value, (acc != NULL) ?
+                        get_average (self, acc->luma_sum) : 0.0);
+    break;
+  case PROP_SHADOWS_CLIPPED:
+    g_value_set_double (value, (acc != NULL) ?
+                        get_average (self, acc->shadows) : 0.0);
+    break;
+  case PROP_HIGHLIGHTS_CLIPPED:
+    g_value_set_double (value, (acc != NULL) ?
+                        get_average (self, acc->highlights) : 0.0);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_image_stats_set_property (GObject *object,
+                                guint prop_id,
+                                const GValue *value,
+                                GParamSpec *pspec)
+{
+  SushiImageStats *self = SUSHI_IMAGE_STATS (object);
+
+  switch (prop_id) {
+  case PROP_PIXBUF:
+    self->priv->pixbuf = g_value_dup_object (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_image_stats_class_init (SushiImageStatsClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->dispose = sushi_image_stats_dispose;
+  oclass->finalize = sushi_image_stats_finalize;
+  oclass->get_property = sushi_image_stats_get_property;
+  oclass->set_property = sushi_image_stats_set_property;
+
+  properties[PROP_PIXBUF] =
+    g_param_spec_object ("pixbuf",
+                         "Pixbuf",
+                         "The decoded image",
+                         GDK_TYPE_PIXBUF,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  properties[PROP_N_SAMPLES] =
+    g_param_spec_uint64 ("n-samples",
+                         "Samples",
+                         "How many pixels were looked at",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE);
+
+  properties[PROP_MEAN_LUMA] =
+    g_param_spec_double ("mean-luma",
+                         "Mean luma",
+                         "The average luma, from 0 to 255",
+                         0.0, 255.0, 0.0,
+                         G_PARAM_READABLE);
+
+  properties[PROP_SHADOWS_CLIPPED] =
+    g_param_spec_double ("shadows-clipped",
+                         "Shadows clipped",
+                         "The fraction of pixels with a channel at 0",
+                         0.0, 1.0, 0.0,
+                         G_PARAM_READABLE);
+
+  properties[PROP_HIGHLIGHTS_CLIPPED] =
+    g_param_spec_double ("highlights-clipped",
+                         "Highlights clipped",
+                         "The fraction of pixels with a channel at 255",
+                         0.0, 1.0, 0.0,
+                         G_PARAM_READABLE);
+
+  g_object_class_install_properties (oclass, NUM_PROPERTIES, properties);
+
+  g_type_class_add_private (klass, sizeof (SushiImageStatsPrivate));
+}
+
+static void
+sushi_image_stats_init (SushiImageStats *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_IMAGE_STATS,
+                                 SushiImageStatsPrivate);
+}
+
+SushiImageStats *
+sushi_image_stats_new (GdkPixbuf *pixbuf)
+{
+  return g_object_new (SUSHI_TYPE_IMAGE_STATS,
+                       "pixbuf", pixbuf,
+                       NULL);
+}
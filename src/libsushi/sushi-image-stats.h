@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+
+#ifndef __SUSHI_IMAGE_STATS_H__
+#define __SUSHI_IMAGE_STATS_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+#define SUSHI_TYPE_IMAGE_STATS            (sushi_image_stats_get_type ())
+#define SUSHI_IMAGE_STATS(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUSHI_TYPE_IMAGE_STATS, SushiImageStats))
+#define SUSHI_IS_IMAGE_STATS(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SUSHI_TYPE_IMAGE_STATS))
+#define SUSHI_IMAGE_STATS_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  SUSHI_TYPE_IMAGE_STATS, SushiImageStatsClass))
+#define SUSHI_IS_IMAGE_STATS_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  SUSHI_TYPE_IMAGE_STATS))
+#define SUSHI_IMAGE_STATS_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  SUSHI_TYPE_IMAGE_STATS, SushiImageStatsClass))
+
+typedef struct _SushiImageStats          SushiImageStats;
+typedef struct _SushiImageStatsPrivate   SushiImageStatsPrivate;
+typedef struct _SushiImageStatsClass     SushiImageStatsClass;
+
+typedef enum
+{
+  SUSHI_IMAGE_CHANNEL_RED   = 0,
+  SUSHI_IMAGE_CHANNEL_GREEN = 1,
+  SUSHI_IMAGE_CHANNEL_BLUE  = 2,
+  SUSHI_IMAGE_CHANNEL_LUMA  = 3
+} SushiImageChannel;
+
+#define SUSHI_IMAGE_STATS_N_BINS 256
+
+struct _SushiImageStats
+{
+  GObject parent_instance;
+
+  SushiImageStatsPrivate *priv;
+};
+
+struct _SushiImageStatsClass
+{
+  GObjectClass parent_class;
+};
+
+GType    sushi_image_stats_get_type     (void) G_GNUC_CONST;
+
+SushiImageStats *sushi_image_stats_new (GdkPixbuf *pixbuf);
+
+void sushi_image_stats_compute_async (SushiImageStats *self,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data);
+gboolean sushi_image_stats_compute_finish (SushiImageStats *self,
+                                           GAsyncResult *result,
+                                           GError **error);
+
+const guint32 *sushi_image_stats_get_histogram (SushiImageStats *self,
+                                                SushiImageChannel channel,
+                                                guint *n_bins);
+
+G_END_DECLS
+
+#endif /* __SUSHI_IMAGE_STATS_H__ */
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-mime-registry.h"
+
+#include <gio/gio.h>
+
+G_DEFINE_TYPE (SushiMimeRegistry, sushi_mime_registry, G_TYPE_OBJECT);
+
+struct _SushiMimeRegistryPrivate {
+  GMutex lock;
+
+  /* registered types, in registration order, and their renderers;
+   * the first renderer registered for a type keeps it.
+   */
+  GPtrArray *content_types;
+  GHashTable *renderers;
+
+  /* every type looked up so far and what it resolved to; types
+   * without a renderer map to the empty string.
+   */
+  GHashTable *resolved;
+};
+
+static const gchar *
+resolve_content_type (SushiMimeRegistry *self,
+                      const gchar *content_type)
+{
+  const gchar *renderer_id;
+  const gchar *registered;
+  guint idx;
+
+  renderer_id = g_hash_table_lookup (self->priv->renderers, content_type);
+  if (renderer_id != NULL)
+    return renderer_id;
+
+  /* GIO doesn't expose the parents of a type, so find the first
+   * registered type this one is a subclass of.
+   */
+  for (idx = 0; idx < self->priv->content_types->len; idx++) {
+    registered = g_ptr_array_index (self->priv->content_types, idx);
+
+    if (g_content_type_is_a (content_type, registered))
+      return g_hash_table_lookup (self->priv->renderers, registered);
+  }
+
+  return "";
+}
+
+/**
+ * sushi_mime_registry_lookup:
+ * @self:
+ * @content_type: a content type
+ *
+ * Finds the renderer registered for @content_type, or for the first
+ * registered type it is a subclass of. The result is remembered, so
+ * that previewing another file of the same type costs a single hash
+ * table lookup.
+ *
+ * Returns: (transfer full) (allow-none): the renderer ID, or %NULL if
+ *   no renderer can handle @content_type
+ */
+gchar *
+sushi_mime_registry_lookup (SushiMimeRegistry *self,
+                            const gchar *content_type)
+{
+  const gchar *renderer_id;
+  gchar *retval = NULL;
+
+  g_return_val_if_fail (SUSHI_IS_MIME_REGISTRY (self), NULL);
+
+  if (content_type == NULL)
+    return NULL;
+
+  g_mutex_lock (&self->priv->lock);
+
+  renderer_id = g_hash_table_lookup (self->priv->resolved, content_type);
+  if (renderer_id == NULL) {
+    renderer_id = resolve_content_type (self, content_type);
+    g_hash_table_insert (self->priv->resolved,
+                         g_strdup (content_type), g_strdup (renderer_id));
+  }
+
+  /* a registration may drop what's remembered once the lock is gone */
+  if (renderer_id[0] != '\0')
+    retval = g_strdup (renderer_id);
+
+  g_mutex_unlock (&self->priv->lock);
+
+  return retval;
+}
+
+/**
+ * sushi_mime_registry_register:
+ * @self:
+ * @content_type: a content type
+ * @renderer_id: the renderer which previews @content_type
+ *
+ * Registers @renderer_id for @content_type, unless another renderer
+ * was registered for it before: like subclasses of registered types,
+ * exact matches go to the first renderer which claims them.
+ */
+void
+sushi_mime_registry_register (SushiMimeRegistry *self,
+                              const gchar *content_type,
+                              const gchar *renderer_id)
+{
+  g_return_if_fail (SUSHI_IS_MIME_REGISTRY (self));
+  g_return_if_fail (content_type != NULL && renderer_id != NULL);
+
+  g_mutex_lock (&self->priv->lock);
+
+  if (!g_hash_table_contains (self->priv->renderers, content_type)) {
+    g_ptr_array_add (self->priv->content_types, g_strdup (content_type));
+    g_hash_table_insert (self->priv->renderers,
+                         g_strdup (content_type), g_strdup (renderer_id));
+
+    /* registrations happen at startup; don't bother to be smart */
+    g_hash_table_remove_all (self->priv->resolved);
+  }
+
+  g_mutex_unlock (&self->priv->lock);
+}
+
+/**
+ * sushi_mime_registry_register_types:
+ * @self:
+ * @content_types: (array zero-terminated=1): the content types
+ * @renderer_id: the renderer which previews @content_types
+ *
+ * Registers @renderer_id for each of @content_types.
+ */
+void
+sushi_mime_registry_register_types (SushiMimeRegistry *self,
+                                    const gchar **content_types,
+                                    const gchar *renderer_id)
+{
+  gint idx;
+
+  if (content_types == NULL)
+    return;
+
+  for (idx = 0; content_types[idx] != NULL; idx++)
+    sushi_mime_registry_register (self, content_types[idx], renderer_id);
+}
+
+static void
+sushi_mime_registry_finalize (GObject *object)
+{
+  SushiMimeRegistry *self = SUSHI_MIME_REGISTRY (object);
+
+  g_ptr_array_unref (self->priv->content_types);
+  g_hash_table_destroy (self->priv->renderers);
+  g_hash_table_destroy (self->priv->resolved);
+  g_mutex_clear (&self->priv->lock);
+
+  G_OBJECT_CLASS (sushi_mime_registry_parent_class)->finalize (object);
+}
+
+static void
+sushi_mime_registry_class_init (SushiMimeRegistryClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->finalize = sushi_mime_registry_finalize;
+
+  g_type_class_add_private (klass, sizeof (SushiMimeRegistryPrivate));
+}
+
+static void
+sushi_mime_registry_init (SushiMimeRegistry *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_MIME_REGISTRY,
+                                 SushiMimeRegistryPrivate);
+
+  g_mutex_init (&self->priv->lock);
+
+  self->priv->content_types = g_ptr_array_new_with_free_func (g_free);
+  self->priv->renderers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+  self->priv->resolved = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, g_free);
+}
+
+/**
+ * sushi_mime_registry_new:
+ *
+ * Returns: (transfer full): a new, empty #SushiMimeRegistry
+ */
+SushiMimeRegistry *
+sushi_mime_registry_new (void)
+{
+  return g_object_new (SUSHI_TYPE_MIME_REGISTRY, NULL);
+}
+
+/**
+ * sushi_mime_registry_get_default:
+ *
+ * Returns: (transfer none): the registry the viewers register their
+ *   content types with
+ */
+SushiMimeRegistry *
+sushi_mime_registry_get_default (void)
+{
+  static gsize initialized = 0;
+  static SushiMimeRegistry *registry = NULL;
+
+  if (g_once_init_enter (&initialized)) {
+    registry = sushi_mime_registry_new ();
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return registry;
+}
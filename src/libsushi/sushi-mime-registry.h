@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_MIME_REGISTRY_H__
+#define __SUSHI_MIME_REGISTRY_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define SUSHI_TYPE_MIME_REGISTRY            (sushi_mime_registry_get_type ())
+#define SUSHI_MIME_REGISTRY(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUSHI_TYPE_MIME_REGISTRY, SushiMimeRegistry))
+#define SUSHI_IS_MIME_REGISTRY(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SUSHI_TYPE_MIME_REGISTRY))
+#define SUSHI_MIME_REGISTRY_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  SUSHI_TYPE_MIME_REGISTRY, SushiMimeRegistryClass))
+#define SUSHI_IS_MIME_REGISTRY_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  SUSHI_TYPE_MIME_REGISTRY))
+#define SUSHI_MIME_REGISTRY_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  SUSHI_TYPE_MIME_REGISTRY, SushiMimeRegistryClass))
+
+typedef struct _SushiMimeRegistry          SushiMimeRegistry;
+typedef struct _SushiMimeRegistryPrivate   SushiMimeRegistryPrivate;
+typedef struct _SushiMimeRegistryClass     SushiMimeRegistryClass;
+
+struct _SushiMimeRegistry
+{
+  GObject parent_instance;
+
+  SushiMimeRegistryPrivate *priv;
+};
+
+struct _SushiMimeRegistryClass
+{
+  GObjectClass parent_class;
+};
+
+GType    sushi_mime_registry_get_type     (void) G_GNUC_CONST;
+
+SushiMimeRegistry *sushi_mime_registry_new (void);
+SushiMimeRegistry *sushi_mime_registry_get_default (void);
+
+void sushi_mime_registry_register (SushiMimeRegistry *self,
+                                   const gchar *content_type,
+                                   const gchar *renderer_id);
+void sushi_mime_registry_register_types (SushiMimeRegistry *self,
+                                         const gchar **content_types,
+                                         const gchar *renderer_id);
+
+gchar *sushi_mime_registry_lookup (SushiMimeRegistry *self,
+                                   const gchar *content_type);
+
+G_END_DECLS
+
+#endif /* __SUSHI_MIME_REGISTRY_H__ */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-office-text.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sushi-zip-reader.h"
+
+#define READ_CHUNK_SIZE 16384
+
+typedef struct {
+  GString *text;
+  gsize max_length;
+  gboolean done;
+
+  /* namespace prefix of the text elements, "w" or "text" */
+  const gchar *prefix;
+  gint in_body;
+  gint in_paragraph;
+  gint in_run_text;
+  gint skipping;
+} TextData;
+
+static const gchar *
+local_name (const gchar *name,
+            const gchar *prefix)
+{
+  gsize len = strlen (prefix);
+
+  if (strncmp (name, prefix, len) == 0 && name[len] == ':')
+    return name + len + 1;
+
+  return NULL;
+}
+
+static gboolean
+is_element (const gchar *name,
+            const gchar *qualified)
+{
+  return (g_strcmp0 (name, qualified) == 0);
+}
+
+static void
+append_text (TextData *data,
+             const gchar *text,
+             gsize len)
+{
+  g_string_append_len (data->text, text, len);
+
+  if (data->text->len >= data->max_length)
+    data->done = TRUE;
+}
+
+static void
+text_start_element (GMarkupParseContext *context,
+                    const gchar *element_name,
+                    const gchar **attribute_names,
+                    const gchar **attribute_values,
+                    gpointer user_data,
+                    GError **error)
+{
+  TextData *data = user_data;
+  const gchar *name;
+  gint idx, count;
+
+  if (data->done)
+    return;
+
+  /* text boxes in DOCX come twice, once as a fallback for old readers;
+   * ODT notes and tracked changes would end up in the middle of the
+   * surrounding paragraph.
+   */
+  if (is_element (element_name, "mc:Fallback") ||
+      is_element (element_name, "w:instrText") ||
+      is_element (element_name, "office:annotation") ||
+      is_element (element_name, "text:note") ||
+      is_element (element_name, "text:tracked-changes")) {
+    data->skipping++;
+    return;
+  }
+
+  if (is_element (element_name, "w:body") ||
+      is_element (element_name, "office:text")) {
+    data->in_body++;
+    return;
+  }
+
+  name = local_name (element_name, data->prefix);
+  if (name == NULL || data->in_body == 0 || data->skipping > 0)
+    return;
+
+  if (g_strcmp0 (name, "p") == 0 || g_strcmp0 (name, "h") == 0) {
+    data->in_paragraph++;
+  } else if (data->in_paragraph == 0) {
+    return;
+  } else if (g_strcmp0 (name, "t") == 0) {
+    data->in_run_text++;
+  } else if (g_strcmp0 (name, "tab") == 0) {
+    append_text (data, "\t", 1);
+  } else if (g_strcmp0 (name, "br") == 0 ||
+             g_strcmp0 (name, "cr") == 0 ||
+             g_strcmp0 (name, "line-break") == 0) {
+    append_text (data, "\n", 1);
+  } else if (g_strcmp0 (name, "s") == 0) {
+    count = 1;
+
+    for (idx = 0; attribute_names[idx] != NULL; idx++) {
+      if (g_strcmp0 (attribute_names[idx], "text:c") == 0)
+        count = CLAMP (atoi (attribute_values[idx]), 1, 256);
+    }
+
+    for (idx = 0; idx < count; idx++)
+      append_text (data, " ", 1);
+  }
+}
+
+static void
+text_end_element (GMarkupParseContext *context,
+                  const gchar *element_name,
+                  gpointer user_data,
+                  GError **error)
+{
+  TextData *data = user_data;
+  const gchar *name;
+
+  if (data->done)
+    return;
+
+  if (is_element (element_name, "mc:Fallback") ||
+      is_element (element_name, "w:instrText") ||
+      is_element (element_name, "office:annotation") ||
+      is_element (element_name, "text:note") ||
+      is_element (element_name, "text:tracked-changes")) {
+    data->skipping--;
+    return;
+  }
+
+  if (is_element (element_name, "w:body") ||
+      is_element (element_name, "office:text")) {
+    data->in_body--;
+    if (data->in_body == 0)
+      data->done = TRUE;
+
+    return;
+  }
+
+  name = local_name (element_name, data->prefix);
+  if (name == NULL || data->in_body == 0 || data->skipping > 0)
+    return;
+
+  if (g_strcmp0 (name, "p") == 0 || g_strcmp0 (name, "h") == 0) {
+    data->in_paragraph--;
+    append_text (data, "\n", 1);
+  } else if (g_strcmp0 (name, "t") == 0) {
+    data->in_run_text--;
+  }
+}
+
+static void
+text_text (GMarkupParseContext *context,
+           const gchar *text,
+           gsize text_len,
+           gpointer user_data,
+           GError **error)
+{
+  TextData *data = user_data;
+
+  if (data->done || data->skipping > 0 || data->in_paragraph == 0)
+    return;
+
+  /* WordprocessingML keeps the text in w:t runs, while in ODF any
+   * character data inside a paragraph is text.
+   */
+  if (g_strcmp0 (data->prefix, "w") == 0 && data->in_run_text == 0)
+    return;
+
+  append_text (data, text, text_len);
+}
+
+/**
+ * sushi_office_text_extract: (skip)
+ * @path: the local path of a DOCX or ODT document
+ * @max_length: the amount of text after which to stop, in bytes
+ * @cancellable:
+ * @error:
+ *
+ * Reads the paragraphs at the start of the body of @path, one per
+ * line, decompressing and parsing the document only as far as needed
+ * to collect @max_length bytes of text.
+ *
+ * Returns: the text, or %NULL on error
+ */
+gchar *
+sushi_office_text_extract (const gchar *path,
+                           gsize max_length,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+  const GMarkupParser parser = { text_start_element,
+                                 text_end_element,
+                                 text_text, NULL, NULL };
+  SushiZipReader *reader;
+  GMarkupParseContext *context;
+  GInputStream *stream = NULL;
+  gchar buffer[READ_CHUNK_SIZE];
+  TextData data = { NULL, };
+  gssize len;
+  gboolean retval = TRUE;
+
+  reader = sushi_zip_reader_new (path, error);
+  if (reader == NULL)
+    return NULL;
+
+  if (sushi_zip_reader_has_entry (reader, "word/document.xml")) {
+    data.prefix = "w";
+    stream = sushi_zip_reader_open_entry (reader, "word/document.xml", error);
+  } else if (sushi_zip_reader_has_entry (reader, "content.xml")) {
+    data.prefix = "text";
+    stream = sushi_zip_reader_open_entry (reader, "content.xml", error);
+  } else {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Not a DOCX or ODT document");
+  }
+
+  sushi_zip_reader_free (reader);
+
+  if (stream == NULL)
+    return NULL;
+
+  data.text = g_string_new (NULL);
+  data.max_length = max_length;
+  context = g_markup_parse_context_new (&parser, 0, &data, NULL);
+
+  while (retval && !data.done) {
+    len = g_input_stream_read (stream, buffer, sizeof (buffer),
+                               cancellable, error);
+
+    if (len < 0)
+      retval = FALSE;
+    else if (len == 0)
+      retval = g_markup_parse_context_end_parse (context, error);
+    else
+      retval = g_markup_parse_context_parse (context, buffer, len, error);
+
+    if (len == 0)
+      break;
+  }
+
+  g_markup_parse_context_free (context);
+  g_object_unref (stream);
+
+  if (!retval) {
+    g_string_free (data.text, TRUE);
+    return NULL;
+  }
+
+  return g_string_free (data.text, FALSE);
+}
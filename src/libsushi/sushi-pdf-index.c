@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-pdf-index.h"
+
+#include <string.h>
+
+/* indexes of recently previewed documents, most recent first */
+#define MAX_CACHED_INDEXES 4
+
+struct _SushiPdfIndex {
+  volatile gint ref_count;
+  GMutex mutex;
+  gint n_pages;
+
+  /* the folded text of every indexed page, each followed by a nul
+   * byte so that matches never span pages, and where each page starts
+   */
+  GString *text;
+  GArray *offsets;
+};
+
+typedef struct {
+  gchar *key;
+  SushiPdfIndex *index;
+} CacheEntry;
+
+static GQueue cache = G_QUEUE_INIT;
+
+/**
+ * sushi_pdf_index_new: (skip)
+ * @n_pages: the number of pages of the document
+ *
+ * Returns: a new, empty #SushiPdfIndex
+ */
+SushiPdfIndex *
+sushi_pdf_index_new (gint n_pages)
+{
+  SushiPdfIndex *self;
+
+  self = g_slice_new0 (SushiPdfIndex);
+  self->ref_count = 1;
+  self->n_pages = n_pages;
+  self->text = g_string_new (NULL);
+  self->offsets = g_array_sized_new (FALSE, FALSE, sizeof (gsize), n_pages);
+  g_mutex_init (&self->mutex);
+
+  return self;
+}
+
+/**
+ * sushi_pdf_index_ref: (skip)
+ * @self:
+ *
+ */
+SushiPdfIndex *
+sushi_pdf_index_ref (SushiPdfIndex *self)
+{
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+/**
+ * sushi_pdf_index_unref: (skip)
+ * @self:
+ *
+ */
+void
+sushi_pdf_index_unref (SushiPdfIndex *self)
+{
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  g_mutex_clear (&self->mutex);
+  g_string_free (self->text, TRUE);
+  g_array_unref (self->offsets);
+
+  g_slice_free (SushiPdfIndex, self);
+}
+
+/**
+ * sushi_pdf_index_fold_text: (skip)
+ * @text: a UTF-8 string
+ *
+ * Normalizes @text for case-insensitive matching, on a single line.
+ *
+ * Returns: the folded text
+ */
+gchar *
+sushi_pdf_index_fold_text (const gchar *text)
+{
+  gchar *normalized, *folded, *ptr;
+
+  normalized = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+  if (normalized == NULL)
+    return g_strdup ("");
+
+  folded = g_utf8_casefold (normalized, -1);
+  g_free (normalized);
+
+  for (ptr = folded; *ptr != '\0'; ptr++) {
+    if (*ptr == '\n' || *ptr == '\r')
+      *ptr = ' ';
+  }
+
+  return folded;
+}
+
+/**
+ * sushi_pdf_index_add_page: (skip)
+ * @self:
+ * @document: the indexed document
+ *
+ * Extracts the text of the next page of @document into the index.
+ * This is meant to be called from a worker thread.
+ *
+ * Returns: %FALSE if all the pages were already indexed
+ */
+gboolean
+sushi_pdf_index_add_page (SushiPdfIndex *self,
+                          EvDocument *document)
+{
+  EvPage *page;
+  gchar *text = NULL, *folded;
+  gsize offset;
+  gint idx;
+
+  /* only the indexing thread ever adds pages */
+  idx = self->offsets->len;
+  if (idx >= self->n_pages)
+    return FALSE;
+
+  ev_document_doc_mutex_lock ();
+
+  if (EV_IS_DOCUMENT_TEXT (document)) {
+    page = ev_document_get_page (document, idx);
+    text = ev_document_text_get_text (EV_DOCUMENT_TEXT (document), page);
+    g_object_unref (page);
+  }
+
+  ev_document_doc_mutex_unlock ();
+
+  folded = sushi_pdf_index_fold_text ((text != NULL) ? text : "");
+
+  g_mutex_lock (&self->mutex);
+
+  offset = self->text->len;
+  g_string_append (self->text, folded);
+  g_string_append_c (self->text, '\0');
+  g_array_append_val (self->offsets, offset);
+
+  g_mutex_unlock (&self->mutex);
+
+  g_free (folded);
+  g_free (text);
+
+  return TRUE;
+}
+
+/**
+ * sushi_pdf_index_get_n_indexed_pages: (skip)
+ * @self:
+ *
+ * Returns: the number of pages which can be searched so far
+ */
+gint
+sushi_pdf_index_get_n_indexed_pages (SushiPdfIndex *self)
+{
+  gint n_pages;
+
+  g_mutex_lock (&self->mutex);
+  n_pages = self->offsets->len;
+  g_mutex_unlock (&self->mutex);
+
+  return n_pages;
+}
+
+/**
+ * sushi_pdf_index_get_n_pages: (skip)
+ * @self:
+ *
+ * Returns: the number of pages of the indexed document
+ */
+gint
+sushi_pdf_index_get_n_pages (SushiPdfIndex *self)
+{
+  return self->n_pages;
+}
+
+/**
+ * sushi_pdf_index_count_matches: (skip)
+ * @self:
+ * @page: an indexed page
+ * @folded_query: the text to look for, as returned by
+ *   sushi_pdf_index_fold_text()
+ *
+ * Returns: the number of times @folded_query appears on @page
+ */
+guint
+sushi_pdf_index_count_matches (SushiPdfIndex *self,
+                               gint page,
+                               const gchar *folded_query)
+{
+  const gchar *ptr;
+  gsize len;
+  guint n_matches = 0;
+
+  len = strlen (folded_query);
+  if (len == 0)
+    return 0;
+
+  g_mutex_lock (&self->mutex);
+
+  if (page >= 0 && page < (gint) self->offsets->len) {
+    ptr = self->text->str + g_array_index (self->offsets, gsize, page);
+
+    while ((ptr = strstr (ptr, folded_query)) != NULL) {
+      n_matches++;
+      ptr += len;
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  return n_matches;
+}
+
+static GList *
+cache_find (const gchar *key)
+{
+  GList *l;
+  CacheEntry *entry;
+
+  for (l = cache.head; l != NULL; l = l->next) {
+    entry = l->data;
+    if (g_strcmp0 (entry->key, key) == 0)
+      return l;
+  }
+
+  return NULL;
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_free (entry->key);
+  sushi_pdf_index_unref (entry->index);
+  g_slice_free (CacheEntry, entry);
+}
+
+/**
+ * sushi_pdf_index_lookup: (skip)
+ * @key: identifies a version of a document
+ *
+ * Returns: a new reference to the index stored for @key, or %NULL
+ */
+SushiPdfIndex *
+sushi_pdf_index_lookup (const gchar *key)
+{
+  GList *l;
+  CacheEntry *entry;
+
+  l = cache_find (key);
+  if (l == NULL)
+    return NULL;
+
+  entry = l->data;
+  g_queue_unlink (&cache, l);
+  g_queue_push_head_link (&cache, l);
+
+  return sushi_pdf_index_ref (entry->index);
+}
+
+/**
+ * sushi_pdf_index_store: (skip)
+ * @key: identifies a version of a document
+ * @self: a complete index of that document
+ *
+ * Keeps @self around for later previews of the same document,
+ * evicting the least recently used index if needed.
+ */
+void
+sushi_pdf_index_store (const gchar *key,
+                       SushiPdfIndex *self)
+{
+  GList *l;
+  CacheEntry *entry;
+
+  l = cache_find (key);
+  if (l != NULL) {
+    cache_entry_free (l->data);
+    g_queue_delete_link (&cache, l);
+  }
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->key = g_strdup (key);
+  entry->index = sushi_pdf_index_ref (self);
+  g_queue_push_head (&cache, entry);
+
+  while (cache.length > MAX_CACHED_INDEXES)
+    cache_entry_free (g_queue_pop_tail (&cache));
+}
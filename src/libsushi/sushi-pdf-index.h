@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_PDF_INDEX_H__
+#define __SUSHI_PDF_INDEX_H__
+
+#include <evince-document.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SushiPdfIndex SushiPdfIndex;
+
+SushiPdfIndex *sushi_pdf_index_new (gint n_pages);
+SushiPdfIndex *sushi_pdf_index_ref (SushiPdfIndex *self);
+void sushi_pdf_index_unref (SushiPdfIndex *self);
+
+gboolean sushi_pdf_index_add_page (SushiPdfIndex *self,
+                                   EvDocument *document);
+gint sushi_pdf_index_get_n_indexed_pages (SushiPdfIndex *self);
+gint sushi_pdf_index_get_n_pages (SushiPdfIndex *self);
+gchar *sushi_pdf_index_fold_text (const gchar *text);
+guint sushi_pdf_index_count_matches (SushiPdfIndex *self,
+                                     gint page,
+                                     const gchar *folded_query);
+
+SushiPdfIndex *sushi_pdf_index_lookup (const gchar *key);
+void sushi_pdf_index_store (const gchar *key,
+                            SushiPdfIndex *self);
+
+G_END_DECLS
+
+#endif /* __SUSHI_PDF_INDEX_H__ */
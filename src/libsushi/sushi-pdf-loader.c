@@ -25,29 +25,92 @@
 
 #include "sushi-pdf-loader.h"
 
+#include "sushi-mime-registry.h"
+#include "sushi-office-text.h"
+#include "sushi-pdf-index.h"
+#include "sushi-trace.h"
 #include "sushi-utils.h"
+#include "sushi-zip-reader.h"
 #include <evince-document.h>
 #include <evince-view.h>
 #include <glib/gstdio.h>
 #include <gdk/gdkx.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 G_DEFINE_TYPE (SushiPdfLoader, sushi_pdf_loader, G_TYPE_OBJECT);
 
 enum {
   PROP_DOCUMENT = 1,
-  PROP_URI
+  PROP_URI,
+  PROP_THUMBNAIL,
+  PROP_TARGET_WIDTH,
+  PROP_TEXT
 };
 
+enum {
+  SEARCH_MATCH,
+  SEARCH_PROGRESS,
+  CONVERSION_FAILED,
+  NUM_SIGNALS
+};
+
+static guint signals[NUM_SIGNALS] = { 0, };
+
+/* about a screenful of reflowed text */
+#define TEXT_PREVIEW_LENGTH 16384
+
+/* LibreOffice needs several seconds just to start up; on top of that,
+ * give larger documents proportionally longer to convert.
+ */
+#define CONVERSION_BASE_TIMEOUT 20
+#define CONVERSION_TIMEOUT_PER_MB 4
+#define CONVERSION_MAX_TIMEOUT 180
+
+/* conversions are written to the runtime directory, which is usually
+ * in memory, and only copied to the cache when they took long enough
+ * to be worth keeping across sessions.
+ */
+#define CACHE_MIN_CONVERSION_TIME (3 * G_USEC_PER_SEC)
+#define CACHE_MAX_PDF_SIZE (64 * 1024 * 1024)
+#define CACHE_MAX_PDFS 32
+
 static void load_libreoffice (SushiPdfLoader *self);
+static void load_text (SushiPdfLoader *self);
 
 struct _SushiPdfLoaderPrivate {
   EvDocument *document;
   gchar *uri;
   gchar *pdf_path;
+  gchar *conversion_dir;
+  gboolean pdf_is_cached;
+  GdkPixbuf *thumbnail;
+  gint target_width;
+  gchar *text;
+  gchar *cache_key;
+
+  SushiPdfIndex *index;
+  GCancellable *index_cancellable;
+  gint index_progress_pending;
+  gchar *search_query;
+  gint search_page;
 
   gboolean checked_libreoffice_flatpak;
   gboolean have_libreoffice_flatpak;
   GPid libreoffice_pid;
+  guint child_watch_id;
+  guint watchdog_id;
+  goffset file_size;
+
+  /* timings of the last conversion, in microseconds */
+  gint64 conversion_start;
+  gint64 conversion_deadline;
+  gint64 conversion_time;
+  gint64 conversion_cpu_time;
+  gboolean conversion_timed_out;
+  gboolean conversion_failed;
 };
 
 static void
@@ -66,15 +129,147 @@ load_job_done (EvJob *job,
   self->priv->document = g_object_ref (job->document);
   g_object_unref (job);
 
+  sushi_trace_mark (self->priv->uri, "document-loaded");
+
   g_object_notify (G_OBJECT (self), "document");
 }
 
+static void
+set_thumbnail (SushiPdfLoader *self,
+               GdkPixbuf *pixbuf)
+{
+  /* the document already won the race */
+  if (self->priv->document != NULL)
+    return;
+
+  g_clear_object (&self->priv->thumbnail);
+  self->priv->thumbnail = g_object_ref (pixbuf);
+
+  sushi_trace_mark (self->priv->uri, "thumbnail-loaded");
+
+  g_object_notify (G_OBJECT (self), "thumbnail");
+}
+
+typedef struct {
+  gchar *uri;
+  gint target_width;
+} FirstPageJob;
+
+static void
+first_page_job_free (gpointer data)
+{
+  FirstPageJob *job = data;
+
+  g_free (job->uri);
+  g_slice_free (FirstPageJob, job);
+}
+
+static void
+render_first_page_thread (GTask *task,
+                          gpointer source_object,
+                          gpointer task_data,
+                          GCancellable *cancellable)
+{
+  FirstPageJob *job = task_data;
+  EvDocument *document;
+  EvRenderContext *rc;
+  EvPage *page;
+  GdkPixbuf *pixbuf = NULL;
+  gdouble width = 0, height = 0;
+  GError *error = NULL;
+
+  /* skip the page cache setup that makes loading large documents
+   * slow: we only need a single page here.
+   */
+  ev_document_fc_mutex_lock ();
+  document = ev_document_factory_get_document_full (job->uri,
+                                                    EV_DOCUMENT_LOAD_FLAG_NO_CACHE,
+                                                    &error);
+  ev_document_fc_mutex_unlock ();
+
+  if (document == NULL) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  ev_document_doc_mutex_lock ();
+
+  if (ev_document_get_n_pages (document) > 0)
+    ev_document_get_page_size (document, 0, &width, &height);
+
+  if (width > 0) {
+    page = ev_document_get_page (document, 0);
+    rc = ev_render_context_new (page, 0, (gdouble) job->target_width / width);
+    pixbuf = ev_document_get_thumbnail (document, rc);
+
+    g_object_unref (rc);
+    g_object_unref (page);
+  }
+
+  ev_document_doc_mutex_unlock ();
+  g_object_unref (document);
+
+  if (pixbuf != NULL)
+    g_task_return_pointer (task, pixbuf, g_object_unref);
+  else
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Unable to render the first page");
+}
+
+static void
+render_first_page_ready_cb (GObject *source,
+                            GAsyncResult *res,
+                            gpointer user_data)
+{
+  SushiPdfLoader *self = SUSHI_PDF_LOADER (source);
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  pixbuf = g_task_propagate_pointer (G_TASK (res), &error);
+
+  if (pixbuf == NULL) {
+    g_debug ("Can't render the first page of %s: %s",
+             self->priv->uri, error->message);
+    g_error_free (error);
+
+    return;
+  }
+
+  set_thumbnail (self, pixbuf);
+  g_object_unref (pixbuf);
+}
+
+static void
+render_first_page (SushiPdfLoader *self,
+                   const gchar *uri)
+{
+  FirstPageJob *job;
+  GTask *task;
+
+  if (self->priv->target_width <= 0)
+    return;
+
+  job = g_slice_new0 (FirstPageJob);
+  job->uri = g_strdup (uri);
+  job->target_width = self->priv->target_width;
+
+  task = g_task_new (self, NULL, render_first_page_ready_cb, NULL);
+  g_task_set_task_data (task, job, first_page_job_free);
+  g_task_run_in_thread (task, render_first_page_thread);
+  g_object_unref (task);
+}
+
 static void
 load_pdf (SushiPdfLoader *self,
           const gchar *uri)
 {
   EvJob *job;
 
+  /* the full load computes the size of every page before the view
+   * can show anything; race it with a quick render of the first page.
+   */
+  render_first_page (self, uri);
+
   job = ev_job_load_new (uri);
   g_signal_connect (job, "finished",
                     G_CALLBACK (load_job_done), self);
@@ -135,6 +330,357 @@ libreoffice_missing (SushiPdfLoader *self)
                           self);
 }
 
+/* processes started by the libreoffice wrapper don't nest deeper
+ * than this; it bounds the walk should a pid be reused under it.
+ */
+#define CONVERTER_TREE_MAX_DEPTH 8
+
+/* The CPU time, in clock ticks, used so far by @pid and its live
+ * descendants; the ones which already exited are accounted for once
+ * reaped by their parent.
+ */
+static guint64
+get_process_tree_ticks (GPid pid,
+                        guint depth)
+{
+  GDir *dir;
+  const gchar *name;
+  gchar *path, *contents, *fields;
+  gchar **tokens, **children;
+  guint64 ticks = 0;
+  gint idx;
+
+  path = g_strdup_printf ("/proc/%d/stat", pid);
+
+  if (g_file_get_contents (path, &contents, NULL, NULL)) {
+    /* the command name may contain spaces; fields after it are
+     * state, ppid, pgrp, ..., utime, stime, cutime, cstime
+     */
+    fields = strrchr (contents, ')');
+    tokens = (fields != NULL) ? g_strsplit (fields + 2, " ", 16) : NULL;
+
+    if (tokens != NULL && g_strv_length (tokens) >= 15)
+      ticks += g_ascii_strtoull (tokens[11], NULL, 10) +
+        g_ascii_strtoull (tokens[12], NULL, 10) +
+        g_ascii_strtoull (tokens[13], NULL, 10) +
+        g_ascii_strtoull (tokens[14], NULL, 10);
+
+    g_strfreev (tokens);
+    g_free (contents);
+  }
+
+  g_free (path);
+
+  if (depth >= CONVERTER_TREE_MAX_DEPTH)
+    return ticks;
+
+  /* children are listed by the thread which started them */
+  path = g_strdup_printf ("/proc/%d/task", pid);
+  dir = g_dir_open (path, 0, NULL);
+  g_free (path);
+
+  if (dir == NULL)
+    return ticks;
+
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    path = g_strdup_printf ("/proc/%d/task/%s/children", pid, name);
+
+    if (g_file_get_contents (path, &contents, NULL, NULL)) {
+      children = g_strsplit (g_strstrip (contents), " ", -1);
+
+      for (idx = 0; children[idx] != NULL; idx++)
+        if (g_ascii_isdigit (children[idx][0]))
+          ticks += get_process_tree_ticks (atoi (children[idx]), depth + 1);
+
+      g_strfreev (children);
+      g_free (contents);
+    }
+
+    g_free (path);
+  }
+
+  g_dir_close (dir);
+
+  return ticks;
+}
+
+/* The CPU time used so far by the converter, which includes the
+ * soffice processes started by the libreoffice wrapper. Only its own
+ * process tree is read, as this runs every second from the main loop.
+ */
+static gint64
+get_converter_cpu_time (GPid pid)
+{
+  return get_process_tree_ticks (pid, 0) * G_USEC_PER_SEC / sysconf (_SC_CLK_TCK);
+}
+
+static void
+kill_libreoffice (SushiPdfLoader *self)
+{
+  /* the child may not have moved to its own group yet */
+  if (kill (-self->priv->libreoffice_pid, SIGKILL) < 0)
+    kill (self->priv->libreoffice_pid, SIGKILL);
+}
+
+static void
+stop_watchdog (SushiPdfLoader *self)
+{
+  if (self->priv->watchdog_id != 0) {
+    g_source_remove (self->priv->watchdog_id);
+    self->priv->watchdog_id = 0;
+  }
+}
+
+static gboolean
+conversion_watchdog_cb (gpointer user_data)
+{
+  SushiPdfLoader *self = user_data;
+  gint64 cpu_time;
+
+  cpu_time = get_converter_cpu_time (self->priv->libreoffice_pid);
+  self->priv->conversion_cpu_time = MAX (self->priv->conversion_cpu_time, cpu_time);
+
+  if (g_get_monotonic_time () < self->priv->conversion_deadline)
+    return TRUE;
+
+  g_warning ("LibreOffice did not convert %s in time, giving up",
+             self->priv->uri);
+
+  /* the child watch takes it from here */
+  self->priv->conversion_timed_out = TRUE;
+  kill_libreoffice (self);
+
+  self->priv->watchdog_id = 0;
+  return FALSE;
+}
+
+static gchar *
+get_cached_pdf_path (SushiPdfLoader *self)
+{
+  gchar *checksum, *name, *path;
+
+  if (self->priv->cache_key == NULL)
+    return NULL;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1,
+                                            self->priv->cache_key, -1);
+  name = g_strconcat (checksum, ".pdf", NULL);
+  path = g_build_filename (g_get_user_cache_dir (), "sushi", name, NULL);
+
+  g_free (name);
+  g_free (checksum);
+
+  return path;
+}
+
+static gint
+compare_mtime (gconstpointer a,
+               gconstpointer b)
+{
+  GFileInfo *info_a = *((GFileInfo **) a);
+  GFileInfo *info_b = *((GFileInfo **) b);
+  guint64 mtime_a, mtime_b;
+
+  mtime_a = g_file_info_get_attribute_uint64 (info_a, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  mtime_b = g_file_info_get_attribute_uint64 (info_b, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  return (mtime_a > mtime_b) - (mtime_a < mtime_b);
+}
+
+static void
+prune_pdf_cache (GFile *cache_dir,
+                 GCancellable *cancellable)
+{
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+  GPtrArray *infos;
+  GFile *child;
+  guint idx;
+
+  enumerator = g_file_enumerate_children (cache_dir,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                          G_FILE_QUERY_INFO_NONE,
+                                          cancellable, NULL);
+  if (enumerator == NULL)
+    return;
+
+  infos = g_ptr_array_new_with_free_func (g_object_unref);
+
+  while ((info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL) {
+    if (g_str_has_suffix (g_file_info_get_name (info), ".pdf"))
+      g_ptr_array_add (infos, info);
+    else
+      g_object_unref (info);
+  }
+
+  g_object_unref (enumerator);
+
+  /* evict the least recently used conversions first */
+  g_ptr_array_sort (infos, compare_mtime);
+
+  for (idx = 0; idx + CACHE_MAX_PDFS < infos->len; idx++) {
+    info = g_ptr_array_index (infos, idx);
+    child = g_file_get_child (cache_dir, g_file_info_get_name (info));
+    g_file_delete (child, cancellable, NULL);
+    g_object_unref (child);
+  }
+
+  g_ptr_array_unref (infos);
+}
+
+static void
+cache_pdf_thread (GTask *task,
+                  gpointer source_object,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+  gchar **paths = task_data;
+  GFile *source, *tmp, *dest, *cache_dir;
+  gchar *tmp_path;
+  GError *error = NULL;
+
+  source = g_file_new_for_path (paths[0]);
+  dest = g_file_new_for_path (paths[1]);
+  cache_dir = g_file_get_parent (dest);
+
+  g_file_make_directory_with_parents (cache_dir, cancellable, NULL);
+
+  /* copy next to the final name, so that the cache never contains
+   * partial documents
+   */
+  tmp_path = g_strconcat (paths[1], ".part", NULL);
+  tmp = g_file_new_for_path (tmp_path);
+
+  if (g_file_copy (source, tmp, G_FILE_COPY_OVERWRITE,
+                   cancellable, NULL, NULL, &error) &&
+      g_file_move (tmp, dest, G_FILE_COPY_OVERWRITE,
+                   cancellable, NULL, NULL, &error))
+    prune_pdf_cache (cache_dir, cancellable);
+
+  if (error != NULL) {
+    g_debug ("Unable to cache the converted document: %s", error->message);
+    g_error_free (error);
+    g_file_delete (tmp, NULL, NULL);
+  }
+
+  g_object_unref (tmp);
+  g_object_unref (cache_dir);
+  g_object_unref (dest);
+  g_object_unref (source);
+  g_free (tmp_path);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+maybe_cache_pdf (SushiPdfLoader *self)
+{
+  GStatBuf buf;
+  gchar **paths;
+  GTask *task;
+
+  if (self->priv->conversion_time < CACHE_MIN_CONVERSION_TIME)
+    return;
+
+  if (g_stat (self->priv->pdf_path, &buf) != 0 ||
+      buf.st_size > CACHE_MAX_PDF_SIZE)
+    return;
+
+  paths = g_new0 (gchar *, 3);
+  paths[0] = g_strdup (self->priv->pdf_path);
+  paths[1] = get_cached_pdf_path (self);
+
+  if (paths[1] == NULL) {
+    g_strfreev (paths);
+    return;
+  }
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_task_data (task, paths, (GDestroyNotify) g_strfreev);
+  g_task_run_in_thread (task, cache_pdf_thread);
+  g_object_unref (task);
+}
+
+/* cached conversions are left for later previews */
+static void
+clear_conversion (SushiPdfLoader *self)
+{
+  if (self->priv->pdf_path != NULL) {
+    if (!self->priv->pdf_is_cached)
+      g_unlink (self->priv->pdf_path);
+
+    g_clear_pointer (&self->priv->pdf_path, g_free);
+  }
+
+  if (self->priv->conversion_dir != NULL) {
+    g_rmdir (self->priv->conversion_dir);
+    g_clear_pointer (&self->priv->conversion_dir, g_free);
+  }
+}
+
+static gboolean
+load_cached_pdf (SushiPdfLoader *self)
+{
+  gchar *path, *uri;
+
+  path = get_cached_pdf_path (self);
+  if (path == NULL || !g_file_test (path, G_FILE_TEST_EXISTS)) {
+    g_free (path);
+    return FALSE;
+  }
+
+  g_debug ("Using the cached conversion of %s", self->priv->uri);
+
+  /* keep recently used conversions in the cache */
+  g_utime (path, NULL);
+
+  clear_conversion (self);
+
+  self->priv->pdf_path = path;
+  self->priv->pdf_is_cached = TRUE;
+
+  uri = g_filename_to_uri (path, NULL, NULL);
+  load_pdf (self, uri);
+  g_free (uri);
+
+  return TRUE;
+}
+
+static gchar *
+create_conversion_dir (void)
+{
+  gchar *parent, *dir;
+
+  parent = g_build_filename (g_get_user_runtime_dir (), "sushi", NULL);
+  g_mkdir_with_parents (parent, 0700);
+
+  /* each conversion gets a directory of its own, as the name of the
+   * output file depends on the name of the input
+   */
+  dir = g_build_filename (parent, "convert-XXXXXX", NULL);
+  g_free (parent);
+
+  if (g_mkdtemp (dir) == NULL) {
+    g_free (dir);
+    return NULL;
+  }
+
+  return dir;
+}
+
+static void
+conversion_failed (SushiPdfLoader *self)
+{
+  self->priv->conversion_failed = TRUE;
+
+  /* fall back to whatever can be shown without LibreOffice */
+  if (self->priv->thumbnail == NULL && self->priv->text == NULL)
+    load_text (self);
+  else
+    g_signal_emit (self, signals[CONVERSION_FAILED], 0);
+}
+
 static void
 libreoffice_child_watch_cb (GPid pid,
                             gint status,
@@ -143,13 +689,47 @@ libreoffice_child_watch_cb (GPid pid,
   SushiPdfLoader *self = user_data;
   GFile *file;
   gchar *uri;
+  GError *error = NULL;
 
   g_spawn_close_pid (pid);
   self->priv->libreoffice_pid = -1;
+  self->priv->child_watch_id = 0;
+
+  stop_watchdog (self);
+  self->priv->conversion_time =
+    g_get_monotonic_time () - self->priv->conversion_start;
+
+  g_debug ("LibreOffice ran for %" G_GINT64_FORMAT " ms, using %" G_GINT64_FORMAT " ms of CPU time",
+           self->priv->conversion_time / 1000,
+           self->priv->conversion_cpu_time / 1000);
+
+  if (self->priv->conversion_timed_out) {
+    conversion_failed (self);
+    return;
+  }
+
+  if (!g_spawn_check_exit_status (status, &error)) {
+    g_warning ("LibreOffice failed to convert %s: %s",
+               self->priv->uri, error->message);
+    g_error_free (error);
+
+    conversion_failed (self);
+    return;
+  }
+
+  if (!g_file_test (self->priv->pdf_path, G_FILE_TEST_EXISTS)) {
+    g_warning ("LibreOffice did not produce a PDF for %s", self->priv->uri);
+
+    conversion_failed (self);
+    return;
+  }
+
+  sushi_trace_mark (self->priv->uri, "conversion-done");
 
   file = g_file_new_for_path (self->priv->pdf_path);
   uri = g_file_get_uri (file);
   load_pdf (self, uri);
+  maybe_cache_pdf (self);
 
   g_object_unref (file);
   g_free (uri);
@@ -195,6 +775,15 @@ check_libreoffice_flatpak (SushiPdfLoader *self,
   return self->priv->have_libreoffice_flatpak;
 }
 
+static void
+libreoffice_child_setup (gpointer user_data)
+{
+  /* put the converter and everything it starts in a group of their
+   * own, so that they can be killed together
+   */
+  setpgid (0, 0);
+}
+
 static void
 load_libreoffice (SushiPdfLoader *self)
 {
@@ -207,6 +796,11 @@ load_libreoffice (SushiPdfLoader *self)
   GPid pid;
   GError *error = NULL;
   const gchar *argv = NULL;
+  goffset timeout;
+
+  /* a previous preview of the same file may have been worth keeping */
+  if (load_cached_pdf (self))
+    return;
 
   flatpak_path = g_find_program_in_path ("flatpak");
   if (flatpak_path != NULL)
@@ -230,18 +824,42 @@ load_libreoffice (SushiPdfLoader *self)
   tmp_name = g_strrstr (doc_name, ".");
   if (tmp_name)
     *tmp_name = '\0';
-  tmp_name = g_strdup_printf ("%s.pdf", tmp_name);
+  tmp_name = g_strdup_printf ("%s.pdf", doc_name);
   g_free (doc_name);
 
-  pdf_dir = g_build_filename (g_get_user_cache_dir (), "sushi", NULL);
+  pdf_dir = create_conversion_dir ();
+  if (pdf_dir == NULL) {
+    g_warning ("Unable to create a directory for the conversion of %s",
+               self->priv->uri);
+
+    g_free (tmp_name);
+    g_free (doc_path);
+    g_free (libreoffice_path);
+    g_free (flatpak_path);
+
+    conversion_failed (self);
+    return;
+  }
+
+  /* whatever an earlier attempt left behind */
+  clear_conversion (self);
+
+  self->priv->conversion_dir = g_strdup (pdf_dir);
   self->priv->pdf_path = g_build_filename (pdf_dir, tmp_name, NULL);
-  g_mkdir_with_parents (pdf_dir, 0700);
+  self->priv->pdf_is_cached = FALSE;
 
   g_free (tmp_name);
 
   if (use_flatpak) {
     flatpak_doc = g_strdup_printf ("--filesystem=%s:ro", doc_path);
-    flatpak_dir = g_strdup_printf ("--filesystem=%s", pdf_dir);
+
+    /* host paths under /run can't be shared by path */
+    if (g_str_has_prefix (pdf_dir, g_get_user_runtime_dir ()) &&
+        g_strcmp0 (g_get_user_runtime_dir (), g_get_user_cache_dir ()) != 0)
+      flatpak_dir = g_strdup_printf ("--filesystem=xdg-run%s",
+                                     pdf_dir + strlen (g_get_user_runtime_dir ()));
+    else
+      flatpak_dir = g_strdup_printf ("--filesystem=%s", pdf_dir);
 
     const gchar *flatpak_argv[] = {
       NULL, /* to be replaced with flatpak binary */
@@ -285,7 +903,7 @@ load_libreoffice (SushiPdfLoader *self)
 
   res = g_spawn_async (NULL, (gchar **) argv, NULL,
                        G_SPAWN_DO_NOT_REAP_CHILD,
-                       NULL, NULL,
+                       libreoffice_child_setup, NULL,
                        &pid, &error);
 
   g_free (pdf_dir);
@@ -300,31 +918,396 @@ load_libreoffice (SushiPdfLoader *self)
                error->message);
     g_error_free (error);
 
+    clear_conversion (self);
+    conversion_failed (self);
     return;
   }
 
-  g_child_watch_add (pid, libreoffice_child_watch_cb, self);
+  self->priv->child_watch_id =
+    g_child_watch_add (pid, libreoffice_child_watch_cb, self);
   self->priv->libreoffice_pid = pid;
+
+  timeout = CONVERSION_BASE_TIMEOUT +
+    CONVERSION_TIMEOUT_PER_MB * self->priv->file_size / (1024 * 1024);
+  timeout = MIN (timeout, CONVERSION_MAX_TIMEOUT);
+
+  self->priv->conversion_start = g_get_monotonic_time ();
+  self->priv->conversion_deadline =
+    self->priv->conversion_start + timeout * G_USEC_PER_SEC;
+  self->priv->conversion_time = 0;
+  self->priv->conversion_cpu_time = 0;
+  self->priv->conversion_timed_out = FALSE;
+  self->priv->watchdog_id =
+    g_timeout_add_seconds (1, conversion_watchdog_cb, self);
 }
 
-static gboolean
-content_type_is_native (const gchar *content_type)
+/* OpenDocument files always carry a PNG preview of the first page;
+ * Office Open XML files have one when saved with "Save thumbnail".
+ */
+static const gchar *embedded_thumbnails[] = {
+  "Thumbnails/thumbnail.png",
+  "docProps/thumbnail.jpeg",
+  "docProps/thumbnail.png",
+  NULL
+};
+
+static void
+load_thumbnail_thread (GTask *task,
+                       gpointer source_object,
+                       gpointer task_data,
+                       GCancellable *cancellable)
 {
-  gchar **native_types;
+  const gchar *path = task_data;
+  SushiZipReader *reader;
+  GInputStream *stream;
+  GdkPixbuf *pixbuf = NULL;
+  GError *error = NULL;
   gint idx;
-  gboolean found = FALSE;
 
-  native_types = sushi_query_supported_document_types ();
+  reader = sushi_zip_reader_new (path, &error);
+
+  if (reader == NULL) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  for (idx = 0; embedded_thumbnails[idx] != NULL && pixbuf == NULL; idx++) {
+    if (!sushi_zip_reader_has_entry (reader, embedded_thumbnails[idx]))
+      continue;
+
+    stream = sushi_zip_reader_open_entry (reader, embedded_thumbnails[idx], &error);
+    if (stream != NULL) {
+      pixbuf = gdk_pixbuf_new_from_stream (stream, cancellable, &error);
+      g_object_unref (stream);
+    }
+
+    if (error != NULL) {
+      g_debug ("Unable to load embedded thumbnail %s: %s",
+               embedded_thumbnails[idx], error->message);
+      g_clear_error (&error);
+    }
+  }
+
+  sushi_zip_reader_free (reader);
+
+  if (pixbuf != NULL)
+    g_task_return_pointer (task, pixbuf, g_object_unref);
+  else
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                             "No embedded thumbnail found");
+}
+
+static void
+load_thumbnail_ready_cb (GObject *source,
+                         GAsyncResult *res,
+                         gpointer user_data)
+{
+  SushiPdfLoader *self = SUSHI_PDF_LOADER (source);
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  pixbuf = g_task_propagate_pointer (G_TASK (res), &error);
+
+  if (pixbuf == NULL) {
+    g_debug ("No thumbnail for %s: %s", self->priv->uri, error->message);
+    g_error_free (error);
+
+    return;
+  }
+
+  set_thumbnail (self, pixbuf);
+  g_object_unref (pixbuf);
+}
+
+static void
+load_thumbnail (SushiPdfLoader *self)
+{
+  GFile *file;
+  gchar *path;
+  GTask *task;
+
+  file = g_file_new_for_uri (self->priv->uri);
+  path = g_file_get_path (file);
+  g_object_unref (file);
+
+  /* mapping the archive only makes sense for local files */
+  if (path == NULL)
+    return;
+
+  task = g_task_new (self, NULL, load_thumbnail_ready_cb, NULL);
+  g_task_set_task_data (task, path, g_free);
+  g_task_run_in_thread (task, load_thumbnail_thread);
+  g_object_unref (task);
+}
+
+static void
+load_office_document (SushiPdfLoader *self)
+{
+  /* show the embedded thumbnail, if any, while LibreOffice converts
+   * the whole document in the background.
+   */
+  load_thumbnail (self);
+  load_libreoffice (self);
+}
+
+static void
+load_text_thread (GTask *task,
+                  gpointer source_object,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+  const gchar *path = task_data;
+  gchar *text;
+  GError *error = NULL;
+
+  text = sushi_office_text_extract (path, TEXT_PREVIEW_LENGTH,
+                                    cancellable, &error);
+
+  if (text == NULL) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  if (g_strstrip (text)[0] == '\0') {
+    g_free (text);
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                             "The document has no text");
+    return;
+  }
+
+  g_task_return_pointer (task, text, g_free);
+}
+
+static void
+load_text_ready_cb (GObject *source,
+                    GAsyncResult *res,
+                    gpointer user_data)
+{
+  SushiPdfLoader *self = SUSHI_PDF_LOADER (source);
+  gchar *text;
+  GError *error = NULL;
+
+  text = g_task_propagate_pointer (G_TASK (res), &error);
+
+  if (text == NULL) {
+    g_debug ("Can't read the text of %s: %s", self->priv->uri, error->message);
+    g_error_free (error);
+
+    if (self->priv->conversion_failed)
+      g_signal_emit (self, signals[CONVERSION_FAILED], 0);
+    else
+      load_office_document (self);
+
+    return;
+  }
+
+  g_free (self->priv->text);
+  self->priv->text = text;
+
+  sushi_trace_mark (self->priv->uri, "text-extracted");
+  g_object_notify (G_OBJECT (self), "text");
+}
+
+static void
+load_text (SushiPdfLoader *self)
+{
+  GFile *file;
+  gchar *path;
+  GTask *task;
+
+  file = g_file_new_for_uri (self->priv->uri);
+  path = g_file_get_path (file);
+  g_object_unref (file);
+
+  if (path == NULL) {
+    if (self->priv->conversion_failed)
+      g_signal_emit (self, signals[CONVERSION_FAILED], 0);
+    else
+      load_office_document (self);
+
+    return;
+  }
+
+  task = g_task_new (self, NULL, load_text_ready_cb, NULL);
+  g_task_set_task_data (task, path, g_free);
+  g_task_run_in_thread (task, load_text_thread);
+  g_object_unref (task);
+}
+
+static gboolean
+content_type_is_text_document (const gchar *content_type)
+{
+  return g_content_type_is_a (content_type,
+                              "application/vnd.oasis.opendocument.text") ||
+    g_content_type_is_a (content_type,
+                         "application/vnd.openxmlformats-officedocument.wordprocessingml.document");
+}
+
+static void
+search_indexed_pages (SushiPdfLoader *self)
+{
+  gint n_indexed;
+  guint n_matches;
+
+  if (self->priv->search_query == NULL || self->priv->index == NULL)
+    return;
+
+  n_indexed = sushi_pdf_index_get_n_indexed_pages (self->priv->index);
+  if (self->priv->search_page >= n_indexed)
+    return;
+
+  while (self->priv->search_page < n_indexed) {
+    n_matches = sushi_pdf_index_count_matches (self->priv->index,
+                                               self->priv->search_page,
+                                               self->priv->search_query);
+    if (n_matches > 0)
+      g_signal_emit (self, signals[SEARCH_MATCH], 0,
+                     self->priv->search_page, n_matches);
+
+    self->priv->search_page++;
+  }
+
+  g_signal_emit (self, signals[SEARCH_PROGRESS], 0, n_indexed);
+}
+
+typedef struct {
+  SushiPdfIndex *index;
+  EvDocument *document;
+} IndexJob;
+
+static void
+index_job_free (gpointer data)
+{
+  IndexJob *job = data;
+
+  sushi_pdf_index_unref (job->index);
+  g_object_unref (job->document);
+  g_slice_free (IndexJob, job);
+}
+
+static gboolean
+index_progress_idle (gpointer user_data)
+{
+  SushiPdfLoader *self = user_data;
+
+  g_atomic_int_set (&self->priv->index_progress_pending, FALSE);
+  search_indexed_pages (self);
 
-  for (idx = 0; native_types[idx] != NULL; idx++) {
-    found = g_content_type_is_a (content_type, native_types[idx]);
-    if (found)
-      break;
+  return FALSE;
+}
+
+static void
+build_index_thread (GTask *task,
+                    gpointer source_object,
+                    gpointer task_data,
+                    GCancellable *cancellable)
+{
+  SushiPdfLoader *self = source_object;
+  IndexJob *job = task_data;
+
+  while (!g_cancellable_is_cancelled (cancellable) &&
+         sushi_pdf_index_add_page (job->index, job->document)) {
+    /* let the running search catch up with the new pages, without
+     * queueing more than one update at a time
+     */
+    if (g_atomic_int_compare_and_exchange (&self->priv->index_progress_pending,
+                                           FALSE, TRUE))
+      g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                       index_progress_idle,
+                       g_object_ref (self),
+                       g_object_unref);
   }
 
-  g_strfreev (native_types);
+  g_task_return_boolean (task, !g_cancellable_is_cancelled (cancellable));
+}
+
+static void
+build_index_ready_cb (GObject *source,
+                      GAsyncResult *res,
+                      gpointer user_data)
+{
+  SushiPdfLoader *self = SUSHI_PDF_LOADER (source);
+  IndexJob *job = g_task_get_task_data (G_TASK (res));
 
-  return found;
+  if (!g_task_propagate_boolean (G_TASK (res), NULL))
+    return;
+
+  /* a later preview of the same file can search it right away */
+  if (self->priv->cache_key != NULL)
+    sushi_pdf_index_store (self->priv->cache_key, job->index);
+
+  search_indexed_pages (self);
+}
+
+static void
+ensure_index (SushiPdfLoader *self)
+{
+  IndexJob *job;
+  GTask *task;
+
+  if (self->priv->index != NULL)
+    return;
+
+  if (self->priv->cache_key != NULL)
+    self->priv->index = sushi_pdf_index_lookup (self->priv->cache_key);
+
+  if (self->priv->index != NULL)
+    return;
+
+  self->priv->index =
+    sushi_pdf_index_new (ev_document_get_n_pages (self->priv->document));
+  self->priv->index_cancellable = g_cancellable_new ();
+
+  job = g_slice_new0 (IndexJob);
+  job->index = sushi_pdf_index_ref (self->priv->index);
+  job->document = g_object_ref (self->priv->document);
+
+  task = g_task_new (self, self->priv->index_cancellable,
+                     build_index_ready_cb, NULL);
+  g_task_set_task_data (task, job, index_job_free);
+  g_task_run_in_thread (task, build_index_thread);
+  g_object_unref (task);
+}
+
+static void
+clear_index (SushiPdfLoader *self)
+{
+  if (self->priv->index_cancellable != NULL) {
+    g_cancellable_cancel (self->priv->index_cancellable);
+    g_clear_object (&self->priv->index_cancellable);
+  }
+
+  g_clear_pointer (&self->priv->index, sushi_pdf_index_unref);
+  g_clear_pointer (&self->priv->search_query, g_free);
+}
+
+static gboolean
+content_type_is_native (const gchar *content_type)
+{
+  static gsize initialized = 0;
+  static SushiMimeRegistry *native_types = NULL;
+  gchar **types, *renderer_id;
+  gboolean native;
+
+  /* the backends don't change while running; resolve against them
+   * once, and remember the answer for each type.
+   */
+  if (g_once_init_enter (&initialized)) {
+    native_types = sushi_mime_registry_new ();
+
+    types = sushi_query_supported_document_types ();
+    sushi_mime_registry_register_types (native_types,
+                                        (const gchar **) types, "native");
+    g_strfreev (types);
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  renderer_id = sushi_mime_registry_lookup (native_types, content_type);
+  native = (renderer_id != NULL);
+  g_free (renderer_id);
+
+  return native;
 }
 
 static void
@@ -350,10 +1333,25 @@ query_info_ready_cb (GObject *obj,
 
   content_type = g_file_info_get_content_type (info);
 
-  if (content_type_is_native (content_type))
+  g_free (self->priv->cache_key);
+  self->priv->cache_key =
+    g_strdup_printf ("%s:%" G_GUINT64_FORMAT ":%" G_GOFFSET_FORMAT,
+                     self->priv->uri,
+                     g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                     g_file_info_get_size (info));
+  self->priv->file_size = g_file_info_get_size (info);
+
+  if (content_type_is_native (content_type)) {
     load_pdf (self, self->priv->uri);
-  else
-    load_libreoffice (self);
+  } else if (content_type_is_text_document (content_type)) {
+    /* most word processor documents are only looked at for their
+     * text: show it right away, and leave starting LibreOffice for
+     * when the actual layout is asked for.
+     */
+    load_text (self);
+  } else {
+    load_office_document (self);
+  }
 
   g_object_unref (info);
 }
@@ -365,7 +1363,9 @@ start_loading_document (SushiPdfLoader *self)
 
   file = g_file_new_for_uri (self->priv->uri);
   g_file_query_info_async (file,
-                           G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+                           G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+                           G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                           G_FILE_ATTRIBUTE_TIME_MODIFIED,
                            G_FILE_QUERY_INFO_NONE,
                            G_PRIORITY_DEFAULT,
                            NULL,
@@ -380,24 +1380,127 @@ sushi_pdf_loader_set_uri (SushiPdfLoader *self,
                           const gchar *uri)
 {
   g_clear_object (&self->priv->document);
+  g_clear_object (&self->priv->thumbnail);
+  g_clear_pointer (&self->priv->text, g_free);
+  g_clear_pointer (&self->priv->cache_key, g_free);
+  clear_index (self);
+  self->priv->conversion_failed = FALSE;
   g_free (self->priv->uri);
 
   self->priv->uri = g_strdup (uri);
   start_loading_document (self);
 }
 
+/**
+ * sushi_pdf_loader_load_document:
+ * @self:
+ *
+ * Converts and loads the whole document, when only its text was
+ * loaded so far. The document will be set on #SushiPdfLoader:document
+ * as usual.
+ */
 void
-sushi_pdf_loader_cleanup_document (SushiPdfLoader *self)
+sushi_pdf_loader_load_document (SushiPdfLoader *self)
 {
-  if (self->priv->pdf_path) {
-    g_unlink (self->priv->pdf_path);
-    g_free (self->priv->pdf_path);
-  }
+  if (self->priv->document != NULL ||
+      self->priv->libreoffice_pid != -1 ||
+      self->priv->text == NULL)
+    return;
+
+  load_libreoffice (self);
+}
+
+/**
+ * sushi_pdf_loader_is_native_type:
+ * @content_type: a content type
+ *
+ * Returns: %TRUE if documents of @content_type are loaded as they
+ * are, without converting them with LibreOffice first
+ */
+gboolean
+sushi_pdf_loader_is_native_type (const gchar *content_type)
+{
+  return content_type_is_native (content_type);
+}
+
+/**
+ * sushi_pdf_loader_get_conversion_stats:
+ * @self:
+ * @wall_time: (out) (allow-none): how long the last conversion took, in
+ *   microseconds, or 0 if it is still running
+ * @cpu_time: (out) (allow-none): the CPU time it used, in microseconds
+ * @timed_out: (out) (allow-none): whether it was killed for missing its
+ *   deadline
+ *
+ * Gets the timings of the last LibreOffice conversion of the document.
+ */
+void
+sushi_pdf_loader_get_conversion_stats (SushiPdfLoader *self,
+                                       gint64 *wall_time,
+                                       gint64 *cpu_time,
+                                       gboolean *timed_out)
+{
+  if (wall_time != NULL)
+    *wall_time = self->priv->conversion_time;
+  if (cpu_time != NULL)
+    *cpu_time = self->priv->conversion_cpu_time;
+  if (timed_out != NULL)
+    *timed_out = self->priv->conversion_timed_out;
+}
 
+static void
+reap_child_cb (GPid pid,
+               gint status,
+               gpointer user_data)
+{
+  g_spawn_close_pid (pid);
+}
+
+/**
+ * sushi_pdf_loader_search:
+ * @self:
+ * @text: (allow-none): the text to look for, or %NULL to stop searching
+ *
+ * Looks for @text in the loaded document, case-insensitively. The
+ * text of the document is indexed in the background the first time;
+ * #SushiPdfLoader::search-match is emitted for every page containing
+ * @text, in order, as soon as that page has been indexed.
+ */
+void
+sushi_pdf_loader_search (SushiPdfLoader *self,
+                         const gchar *text)
+{
+  g_clear_pointer (&self->priv->search_query, g_free);
+  self->priv->search_page = 0;
+
+  if (self->priv->document == NULL || text == NULL || text[0] == '\0')
+    return;
+
+  self->priv->search_query = sushi_pdf_index_fold_text (text);
+
+  ensure_index (self);
+  search_indexed_pages (self);
+}
+
+void
+sushi_pdf_loader_cleanup_document (SushiPdfLoader *self)
+{
   if (self->priv->libreoffice_pid != -1) {
-    kill (self->priv->libreoffice_pid, SIGKILL);
+    kill_libreoffice (self);
+
+    /* nobody is interested in the result anymore, but the child
+     * still needs to be reaped
+     */
+    g_source_remove (self->priv->child_watch_id);
+    g_child_watch_add (self->priv->libreoffice_pid, reap_child_cb, NULL);
+
+    self->priv->child_watch_id = 0;
     self->priv->libreoffice_pid = -1;
   }
+
+  stop_watchdog (self);
+  clear_conversion (self);
+  clear_index (self);
 }
 
 static void
@@ -408,6 +1511,9 @@ sushi_pdf_loader_dispose (GObject *object)
   sushi_pdf_loader_cleanup_document (self);
 
   g_clear_object (&self->priv->document);
+  g_clear_object (&self->priv->thumbnail);
+  g_clear_pointer (&self->priv->text, g_free);
+  g_clear_pointer (&self->priv->cache_key, g_free);
   g_free (self->priv->uri);
 
   G_OBJECT_CLASS (sushi_pdf_loader_parent_class)->dispose (object);
@@ -428,6 +1534,15 @@ sushi_pdf_loader_get_property (GObject *object,
   case PROP_URI:
     g_value_set_string (value, self->priv->uri);
     break;
+  case PROP_THUMBNAIL:
+    g_value_set_object (value, self->priv->thumbnail);
+    break;
+  case PROP_TARGET_WIDTH:
+    g_value_set_int (value, self->priv->target_width);
+    break;
+  case PROP_TEXT:
+    g_value_set_string (value, self->priv->text);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     break;
@@ -446,6 +1561,9 @@ sushi_pdf_loader_set_property (GObject *object,
   case PROP_URI:
     sushi_pdf_loader_set_uri (self, g_value_get_string (value));
     break;
+  case PROP_TARGET_WIDTH:
+    self->priv->target_width = g_value_get_int (value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     break;
@@ -480,6 +1598,59 @@ sushi_pdf_loader_class_init (SushiPdfLoaderClass *klass)
                             NULL,
                             G_PARAM_READWRITE));
 
+    g_object_class_install_property
+      (oclass,
+       PROP_THUMBNAIL,
+       g_param_spec_object ("thumbnail",
+                            "Thumbnail",
+                            "A preview of the first page, available before the document",
+                            GDK_TYPE_PIXBUF,
+                            G_PARAM_READABLE));
+
+    g_object_class_install_property
+      (oclass,
+       PROP_TARGET_WIDTH,
+       g_param_spec_int ("target-width",
+                         "Target width",
+                         "The width to render the first page preview at, or 0 to disable it",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE));
+
+    g_object_class_install_property
+      (oclass,
+       PROP_TEXT,
+       g_param_spec_string ("text",
+                            "Text",
+                            "The text at the start of a word processor document, set instead of converting it",
+                            NULL,
+                            G_PARAM_READABLE));
+
+    signals[SEARCH_MATCH] =
+      g_signal_new ("search-match",
+                    G_TYPE_FROM_CLASS (klass),
+                    G_SIGNAL_RUN_FIRST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_generic,
+                    G_TYPE_NONE,
+                    2, G_TYPE_INT, G_TYPE_UINT);
+
+    signals[SEARCH_PROGRESS] =
+      g_signal_new ("search-progress",
+                    G_TYPE_FROM_CLASS (klass),
+                    G_SIGNAL_RUN_FIRST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_VOID__INT,
+                    G_TYPE_NONE,
+                    1, G_TYPE_INT);
+
+    signals[CONVERSION_FAILED] =
+      g_signal_new ("conversion-failed",
+                    G_TYPE_FROM_CLASS (klass),
+                    G_SIGNAL_RUN_FIRST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_VOID__VOID,
+                    G_TYPE_NONE, 0);
+
     g_type_class_add_private (klass, sizeof (SushiPdfLoaderPrivate));
 }
 
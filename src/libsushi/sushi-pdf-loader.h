@@ -56,7 +56,15 @@ struct _SushiPdfLoaderClass
 GType    sushi_pdf_loader_get_type     (void) G_GNUC_CONST;
 
 SushiPdfLoader *sushi_pdf_loader_new (const gchar *uri);
+void sushi_pdf_loader_load_document (SushiPdfLoader *self);
+gboolean sushi_pdf_loader_is_native_type (const gchar *content_type);
+void sushi_pdf_loader_search (SushiPdfLoader *self,
+                              const gchar *text);
 void sushi_pdf_loader_cleanup_document (SushiPdfLoader *self);
+void sushi_pdf_loader_get_conversion_stats (SushiPdfLoader *self,
+                                            gint64 *wall_time,
+                                            gint64 *cpu_time,
+                                            gboolean *timed_out);
 void sushi_pdf_loader_get_max_page_size (SushiPdfLoader *self,
                                          gdouble *width,
                                          gdouble *height);
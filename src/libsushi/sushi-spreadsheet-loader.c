@@ -0,0 +1,1009 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-spreadsheet-loader.h"
+#include "sushi-trace.h"
+
+#include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sushi-zip-reader.h"
+
+/* Only the top-left corner of the first sheet is shown, so that the
+ * preview never needs more than a few chunks of the sheet in memory,
+ * however large the document is.
+ */
+#define MAX_ROWS 1000
+#define MAX_COLUMNS 64
+#define READ_CHUNK_SIZE 16384
+
+G_DEFINE_TYPE (SushiSpreadsheetLoader, sushi_spreadsheet_loader, G_TYPE_OBJECT);
+
+enum {
+  PROP_URI = 1,
+  NUM_PROPERTIES
+};
+
+enum {
+  LOADED,
+  ERROR,
+  NUM_SIGNALS
+};
+
+static GParamSpec* properties[NUM_PROPERTIES] = { NULL, };
+static guint signals[NUM_SIGNALS] = { 0, };
+
+struct _SushiSpreadsheetLoaderPrivate {
+  gchar *uri;
+  GCancellable *cancellable;
+  GtkTreeModel *model;
+};
+
+typedef struct {
+  guint row;
+  guint column;
+  guint index;
+} SharedStringRef;
+
+typedef struct {
+  /* GPtrArray of rows, each a GPtrArray of cell strings (or NULL) */
+  GPtrArray *rows;
+  guint n_columns;
+
+  /* XLSX cells pointing into the shared string table, and the
+   * strings they need, by index
+   */
+  GArray *shared_refs;
+  GHashTable *shared_strings;
+  guint string_index;
+  guint max_string_index;
+
+  /* parser state */
+  gboolean done;
+  gboolean in_table;
+  guint column;
+  guint repeat_rows;
+  guint repeat_columns;
+  gchar *cell_type;
+  GString *text;
+  gint collecting;
+  gint skipping;
+} SheetData;
+
+static SheetData *
+sheet_data_new (void)
+{
+  SheetData *data;
+
+  data = g_slice_new0 (SheetData);
+  data->rows = g_ptr_array_new_with_free_func ((GDestroyNotify) g_ptr_array_unref);
+  data->shared_refs = g_array_new (FALSE, FALSE, sizeof (SharedStringRef));
+  data->text = g_string_new (NULL);
+
+  return data;
+}
+
+static void
+sheet_data_free (SheetData *data)
+{
+  g_ptr_array_unref (data->rows);
+  g_array_unref (data->shared_refs);
+  g_clear_pointer (&data->shared_strings, g_hash_table_unref);
+  g_string_free (data->text, TRUE);
+  g_free (data->cell_type);
+
+  g_slice_free (SheetData, data);
+}
+
+static GPtrArray *
+sheet_data_append_row (SheetData *data)
+{
+  GPtrArray *row;
+
+  row = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (data->rows, row);
+
+  return row;
+}
+
+static void
+sheet_data_set_cell (SheetData *data,
+                     guint row_idx,
+                     guint column,
+                     gchar *text)
+{
+  GPtrArray *row;
+
+  if (row_idx >= data->rows->len ||
+      column >= MAX_COLUMNS ||
+      text == NULL || text[0] == '\0') {
+    g_free (text);
+    return;
+  }
+
+  row = g_ptr_array_index (data->rows, row_idx);
+  if (row->len <= column)
+    g_ptr_array_set_size (row, column + 1);
+
+  g_free (g_ptr_array_index (row, column));
+  g_ptr_array_index (row, column) = text;
+
+  data->n_columns = MAX (data->n_columns, column + 1);
+}
+
+static void
+sheet_data_trim (SheetData *data)
+{
+  GPtrArray *row;
+
+  /* ODS files commonly end with a huge run of repeated empty rows */
+  while (data->rows->len > 0) {
+    row = g_ptr_array_index (data->rows, data->rows->len - 1);
+    if (row->len > 0)
+      break;
+
+    g_ptr_array_remove_index (data->rows, data->rows->len - 1);
+  }
+}
+
+static const gchar *
+local_name (const gchar *name)
+{
+  const gchar *colon;
+
+  colon = strrchr (name, ':');
+  return (colon != NULL) ? colon + 1 : name;
+}
+
+static const gchar *
+lookup_attribute (const gchar **names,
+                  const gchar **values,
+                  const gchar *name)
+{
+  gint idx;
+
+  for (idx = 0; names[idx] != NULL; idx++) {
+    if (g_strcmp0 (local_name (names[idx]), name) == 0)
+      return values[idx];
+  }
+
+  return NULL;
+}
+
+static guint
+parse_count (const gchar *value,
+             guint max)
+{
+  guint64 count;
+
+  if (value == NULL)
+    return 1;
+
+  count = g_ascii_strtoull (value, NULL, 10);
+  return (guint) CLAMP (count, 1, max);
+}
+
+static gboolean
+parse_stream (GInputStream *stream,
+              const GMarkupParser *parser,
+              SheetData *data,
+              GCancellable *cancellable,
+              GError **error)
+{
+  GMarkupParseContext *context;
+  gchar buffer[READ_CHUNK_SIZE];
+  gssize len;
+  gboolean retval = TRUE;
+
+  context = g_markup_parse_context_new (parser, 0, data, NULL);
+
+  /* stop reading as soon as the parser has seen enough, without
+   * decompressing the rest of the entry
+   */
+  while (!data->done) {
+    len = g_input_stream_read (stream, buffer, sizeof (buffer),
+                               cancellable, error);
+
+    if (len < 0) {
+      retval = FALSE;
+      break;
+    }
+
+    if (len == 0) {
+      retval = g_markup_parse_context_end_parse (context, error);
+      break;
+    }
+
+    if (!g_markup_parse_context_parse (context, buffer, len, error)) {
+      retval = FALSE;
+      break;
+    }
+  }
+
+  g_markup_parse_context_free (context);
+
+  return retval;
+}
+
+static gboolean
+parse_entry (SushiZipReader *reader,
+             const gchar *name,
+             const GMarkupParser *parser,
+             SheetData *data,
+             GCancellable *cancellable,
+             GError **error)
+{
+  GInputStream *stream;
+  gboolean retval;
+
+  stream = sushi_zip_reader_open_entry (reader, name, error);
+  if (stream == NULL)
+    return FALSE;
+
+  data->done = FALSE;
+  retval = parse_stream (stream, parser, data, cancellable, error);
+  g_object_unref (stream);
+
+  return retval;
+}
+
+/* XLSX */
+
+typedef struct {
+  gchar *rel_id;
+  gchar *target;
+} WorkbookData;
+
+static void
+workbook_start_element (GMarkupParseContext *context,
+                        const gchar *element_name,
+                        const gchar **attribute_names,
+                        const gchar **attribute_values,
+                        gpointer user_data,
+                        GError **error)
+{
+  WorkbookData *workbook = user_data;
+  const gchar *name = local_name (element_name);
+
+  if (workbook->rel_id == NULL && g_strcmp0 (name, "sheet") == 0) {
+    workbook->rel_id = g_strdup (lookup_attribute (attribute_names,
+                                                   attribute_values, "id"));
+  } else if (workbook->target == NULL &&
+             g_strcmp0 (name, "Relationship") == 0 &&
+             g_strcmp0 (lookup_attribute (attribute_names,
+                                          attribute_values, "Id"),
+                        workbook->rel_id) == 0) {
+    workbook->target = g_strdup (lookup_attribute (attribute_names,
+                                                   attribute_values, "Target"));
+  }
+}
+
+static gboolean
+parse_small_entry (SushiZipReader *reader,
+                   const gchar *name,
+                   const GMarkupParser *parser,
+                   gpointer user_data)
+{
+  GMarkupParseContext *context;
+  GBytes *bytes;
+  gboolean retval;
+
+  bytes = sushi_zip_reader_extract (reader, name, NULL);
+  if (bytes == NULL)
+    return FALSE;
+
+  context = g_markup_parse_context_new (parser, 0, user_data, NULL);
+  retval = g_markup_parse_context_parse (context,
+                                         g_bytes_get_data (bytes, NULL),
+                                         g_bytes_get_size (bytes),
+                                         NULL);
+  g_markup_parse_context_free (context);
+  g_bytes_unref (bytes);
+
+  return retval;
+}
+
+static gchar *
+xlsx_find_first_sheet (SushiZipReader *reader)
+{
+  const GMarkupParser parser = { workbook_start_element, NULL, NULL, NULL, NULL };
+  WorkbookData workbook = { NULL, NULL };
+  gchar *path = NULL;
+
+  if (parse_small_entry (reader, "xl/workbook.xml", &parser, &workbook) &&
+      workbook.rel_id != NULL)
+    parse_small_entry (reader, "xl/_rels/workbook.xml.rels", &parser, &workbook);
+
+  if (workbook.target != NULL) {
+    /* targets are relative to xl/, unless absolute within the package */
+    if (workbook.target[0] == '/')
+      path = g_strdup (workbook.target + 1);
+    else
+      path = g_strconcat ("xl/", workbook.target, NULL);
+
+    if (!sushi_zip_reader_has_entry (reader, path))
+      g_clear_pointer (&path, g_free);
+  }
+
+  if (path == NULL)
+    path = g_strdup ("xl/worksheets/sheet1.xml");
+
+  g_free (workbook.rel_id);
+  g_free (workbook.target);
+
+  return path;
+}
+
+static guint
+xlsx_parse_column (const gchar *ref)
+{
+  guint column = 0;
+
+  while (g_ascii_isalpha (*ref) && column <= MAX_COLUMNS) {
+    column = column * 26 + (g_ascii_toupper (*ref) - 'A' + 1);
+    ref++;
+  }
+
+  return (column > 0) ? column - 1 : 0;
+}
+
+static gchar *
+xlsx_format_value (const gchar *type,
+                   const gchar *value)
+{
+  gchar *end;
+  gdouble number;
+
+  if (g_strcmp0 (type, "b") == 0)
+    return g_strdup ((g_strcmp0 (value, "1") == 0) ? "TRUE" : "FALSE");
+
+  if (type == NULL || g_strcmp0 (type, "n") == 0) {
+    /* numbers are stored with full precision, which is unreadable */
+    number = g_ascii_strtod (value, &end);
+    if (end != value && *end == '\0')
+      return g_strdup_printf ("%.10g", number);
+  }
+
+  return g_strdup (value);
+}
+
+static void
+xlsx_sheet_start_element (GMarkupParseContext *context,
+                          const gchar *element_name,
+                          const gchar **attribute_names,
+                          const gchar **attribute_values,
+                          gpointer user_data,
+                          GError **error)
+{
+  SheetData *data = user_data;
+  const gchar *name = local_name (element_name);
+  const gchar *ref;
+  guint row_idx;
+
+  if (data->done)
+    return;
+
+  if (g_strcmp0 (name, "row") == 0) {
+    ref = lookup_attribute (attribute_names, attribute_values, "r");
+    row_idx = (ref != NULL) ? parse_count (ref, MAX_ROWS + 1) - 1 : data->rows->len;
+
+    /* rows without any cells are omitted from the sheet */
+    while (data->rows->len < row_idx && data->rows->len < MAX_ROWS)
+      sheet_data_append_row (data);
+
+    if (data->rows->len >= MAX_ROWS) {
+      data->done = TRUE;
+      return;
+    }
+
+    sheet_data_append_row (data);
+    data->column = 0;
+  } else if (g_strcmp0 (name, "c") == 0) {
+    ref = lookup_attribute (attribute_names, attribute_values, "r");
+    if (ref != NULL)
+      data->column = xlsx_parse_column (ref);
+
+    g_free (data->cell_type);
+    data->cell_type = g_strdup (lookup_attribute (attribute_names,
+                                                  attribute_values, "t"));
+    g_string_truncate (data->text, 0);
+  } else if (g_strcmp0 (name, "rPh") == 0) {
+    /* phonetic hints of inline strings are not displayed */
+    data->skipping++;
+  } else if (g_strcmp0 (name, "v") == 0 || g_strcmp0 (name, "t") == 0) {
+    data->collecting++;
+  }
+}
+
+static void
+xlsx_sheet_end_element (GMarkupParseContext *context,
+                        const gchar *element_name,
+                        gpointer user_data,
+                        GError **error)
+{
+  SheetData *data = user_data;
+  const gchar *name = local_name (element_name);
+  SharedStringRef ref;
+
+  if (data->done)
+    return;
+
+  if (g_strcmp0 (name, "c") == 0) {
+    if (data->rows->len > 0 && data->column < MAX_COLUMNS &&
+        data->text->len > 0) {
+      if (g_strcmp0 (data->cell_type, "s") == 0) {
+        ref.row = data->rows->len - 1;
+        ref.column = data->column;
+        ref.index = (guint) g_ascii_strtoull (data->text->str, NULL, 10);
+        g_array_append_val (data->shared_refs, ref);
+
+        data->n_columns = MAX (data->n_columns, data->column + 1);
+      } else {
+        sheet_data_set_cell (data, data->rows->len - 1, data->column,
+                             xlsx_format_value (data->cell_type,
+                                                data->text->str));
+      }
+    }
+
+    data->column++;
+  } else if (g_strcmp0 (name, "rPh") == 0) {
+    data->skipping--;
+  } else if (g_strcmp0 (name, "v") == 0 || g_strcmp0 (name, "t") == 0) {
+    data->collecting--;
+  } else if (g_strcmp0 (name, "sheetData") == 0) {
+    data->done = TRUE;
+  }
+}
+
+static void
+sheet_text (GMarkupParseContext *context,
+            const gchar *text,
+            gsize text_len,
+            gpointer user_data,
+            GError **error)
+{
+  SheetData *data = user_data;
+
+  if (!data->done && data->collecting > 0 && data->skipping == 0)
+    g_string_append_len (data->text, text, text_len);
+}
+
+static void
+xlsx_strings_start_element (GMarkupParseContext *context,
+                            const gchar *element_name,
+                            const gchar **attribute_names,
+                            const gchar **attribute_values,
+                            gpointer user_data,
+                            GError **error)
+{
+  SheetData *data = user_data;
+  const gchar *name = local_name (element_name);
+
+  if (g_strcmp0 (name, "si") == 0)
+    g_string_truncate (data->text, 0);
+  else if (g_strcmp0 (name, "rPh") == 0)
+    data->skipping++;
+  else if (g_strcmp0 (name, "t") == 0)
+    data->collecting++;
+}
+
+static void
+xlsx_strings_end_element (GMarkupParseContext *context,
+                          const gchar *element_name,
+                          gpointer user_data,
+                          GError **error)
+{
+  SheetData *data = user_data;
+  const gchar *name = local_name (element_name);
+  gpointer key;
+
+  if (data->done)
+    return;
+
+  if (g_strcmp0 (name, "rPh") == 0) {
+    data->skipping--;
+  } else if (g_strcmp0 (name, "t") == 0) {
+    data->collecting--;
+  } else if (g_strcmp0 (name, "si") == 0) {
+    key = GUINT_TO_POINTER (data->string_index);
+
+    /* only keep the strings which are actually displayed */
+    if (g_hash_table_contains (data->shared_strings, key))
+      g_hash_table_insert (data->shared_strings, key,
+                           g_strndup (data->text->str, data->text->len));
+
+    data->string_index++;
+    if (data->string_index > data->max_string_index)
+      data->done = TRUE;
+  }
+}
+
+static void
+xlsx_resolve_shared_strings (SushiZipReader *reader,
+                             SheetData *data,
+                             GCancellable *cancellable)
+{
+  const GMarkupParser parser = { xlsx_strings_start_element,
+                                 xlsx_strings_end_element,
+                                 sheet_text, NULL, NULL };
+  SharedStringRef *ref;
+  guint idx;
+
+  if (data->shared_refs->len == 0)
+    return;
+
+  data->shared_strings = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  for (idx = 0; idx < data->shared_refs->len; idx++) {
+    ref = &g_array_index (data->shared_refs, SharedStringRef, idx);
+    g_hash_table_insert (data->shared_strings,
+                         GUINT_TO_POINTER (ref->index), NULL);
+    data->max_string_index = MAX (data->max_string_index, ref->index);
+  }
+
+  /* the table is in index order, so it can be abandoned after the
+   * last string a visible cell refers to
+   */
+  data->collecting = 0;
+  data->skipping = 0;
+  parse_entry (reader, "xl/sharedStrings.xml", &parser, data,
+               cancellable, NULL);
+
+  for (idx = 0; idx < data->shared_refs->len; idx++) {
+    ref = &g_array_index (data->shared_refs, SharedStringRef, idx);
+    sheet_data_set_cell (data, ref->row, ref->column,
+                         g_strdup (g_hash_table_lookup (data->shared_strings,
+                                                        GUINT_TO_POINTER (ref->index))));
+  }
+
+  g_clear_pointer (&data->shared_strings, g_hash_table_unref);
+}
+
+static gboolean
+load_xlsx (SushiZipReader *reader,
+           SheetData *data,
+           GCancellable *cancellable,
+           GError **error)
+{
+  const GMarkupParser parser = { xlsx_sheet_start_element,
+                                 xlsx_sheet_end_element,
+                                 sheet_text, NULL, NULL };
+  gchar *sheet;
+  gboolean retval;
+
+  sheet = xlsx_find_first_sheet (reader);
+  retval = parse_entry (reader, sheet, &parser, data, cancellable, error);
+  g_free (sheet);
+
+  if (retval)
+    xlsx_resolve_shared_strings (reader, data, cancellable);
+
+  return retval;
+}
+
+/* ODS */
+
+static void
+ods_start_element (GMarkupParseContext *context,
+                   const gchar *element_name,
+                   const gchar **attribute_names,
+                   const gchar **attribute_values,
+                   gpointer user_data,
+                   GError **error)
+{
+  SheetData *data = user_data;
+  const gchar *name = local_name (element_name);
+  const gchar *value;
+
+  if (data->done)
+    return;
+
+  if (g_strcmp0 (element_name, "table:table") == 0) {
+    data->in_table = TRUE;
+    return;
+  }
+
+  if (!data->in_table)
+    return;
+
+  if (g_strcmp0 (element_name, "table:table-row") == 0) {
+    data->repeat_rows =
+      parse_count (lookup_attribute (attribute_names, attribute_values,
+                                     "number-rows-repeated"), MAX_ROWS);
+    sheet_data_append_row (data);
+    data->column = 0;
+  } else if (g_strcmp0 (element_name, "table:table-cell") == 0 ||
+             g_strcmp0 (element_name, "table:covered-table-cell") == 0) {
+    data->repeat_columns =
+      parse_count (lookup_attribute (attribute_names, attribute_values,
+                                     "number-columns-repeated"), MAX_COLUMNS);
+    g_string_truncate (data->text, 0);
+  } else if (g_strcmp0 (element_name, "office:annotation") == 0) {
+    data->skipping++;
+  } else if (g_strcmp0 (element_name, "text:p") == 0) {
+    if (data->text->len > 0 && data->skipping == 0)
+      g_string_append_c (data->text, '\n');
+    data->collecting++;
+  } else if (data->collecting > 0 && data->skipping == 0) {
+    if (g_strcmp0 (name, "s") == 0) {
+      value = lookup_attribute (attribute_names, attribute_values, "c");
+      g_string_append_printf (data->text, "%*s",
+                              (gint) parse_count (value, 256), "");
+    } else if (g_strcmp0 (name, "tab") == 0) {
+      g_string_append_c (data->text, '\t');
+    } else if (g_strcmp0 (name, "line-break") == 0) {
+      g_string_append_c (data->text, '\n');
+    }
+  }
+}
+
+static void
+ods_end_element (GMarkupParseContext *context,
+                 const gchar *element_name,
+                 gpointer user_data,
+                 GError **error)
+{
+  SheetData *data = user_data;
+  GPtrArray *row, *copy;
+  guint idx, column;
+
+  if (data->done || !data->in_table)
+    return;
+
+  if (g_strcmp0 (element_name, "table:table-cell") == 0 ||
+      g_strcmp0 (element_name, "table:covered-table-cell") == 0) {
+    if (data->text->len > 0) {
+      for (idx = 0; idx < data->repeat_columns; idx++)
+        sheet_data_set_cell (data, data->rows->len - 1, data->column + idx,
+                             g_strndup (data->text->str, data->text->len));
+    }
+
+    data->column = MIN (data->column + data->repeat_columns, MAX_COLUMNS);
+  } else if (g_strcmp0 (element_name, "table:table-row") == 0) {
+    row = g_ptr_array_index (data->rows, data->rows->len - 1);
+
+    for (idx = 1; idx < data->repeat_rows && data->rows->len < MAX_ROWS; idx++) {
+      copy = sheet_data_append_row (data);
+      for (column = 0; column < row->len; column++)
+        g_ptr_array_add (copy, g_strdup (g_ptr_array_index (row, column)));
+    }
+
+    if (data->rows->len >= MAX_ROWS)
+      data->done = TRUE;
+  } else if (g_strcmp0 (element_name, "office:annotation") == 0) {
+    data->skipping--;
+  } else if (g_strcmp0 (element_name, "text:p") == 0) {
+    data->collecting--;
+  } else if (g_strcmp0 (element_name, "table:table") == 0) {
+    data->done = TRUE;
+  }
+}
+
+static gboolean
+load_ods (SushiZipReader *reader,
+          SheetData *data,
+          GCancellable *cancellable,
+          GError **error)
+{
+  const GMarkupParser parser = { ods_start_element,
+                                 ods_end_element,
+                                 sheet_text, NULL, NULL };
+
+  return parse_entry (reader, "content.xml", &parser, data, cancellable, error);
+}
+
+static void
+load_sheet_thread (GTask *task,
+                   gpointer source_object,
+                   gpointer task_data,
+                   GCancellable *cancellable)
+{
+  const gchar *uri = task_data;
+  SushiZipReader *reader;
+  SheetData *data;
+  GFile *file;
+  gchar *path;
+  gboolean retval;
+  GError *error = NULL;
+
+  file = g_file_new_for_uri (uri);
+  path = g_file_get_path (file);
+  g_object_unref (file);
+
+  if (path == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Spreadsheets can only be previewed from local files");
+    return;
+  }
+
+  reader = sushi_zip_reader_new (path, &error);
+  g_free (path);
+
+  if (reader == NULL) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  data = sheet_data_new ();
+
+  if (sushi_zip_reader_has_entry (reader, "xl/workbook.xml")) {
+    retval = load_xlsx (reader, data, cancellable, &error);
+  } else if (sushi_zip_reader_has_entry (reader, "content.xml")) {
+    retval = load_ods (reader, data, cancellable, &error);
+  } else {
+    g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "Unrecognized spreadsheet format");
+    retval = FALSE;
+  }
+
+  sushi_zip_reader_free (reader);
+
+  if (!retval) {
+    sheet_data_free (data);
+    g_task_return_error (task, error);
+    return;
+  }
+
+  sheet_data_trim (data);
+  g_task_return_pointer (task, data, (GDestroyNotify) sheet_data_free);
+}
+
+static GtkTreeModel *
+build_model (SheetData *data)
+{
+  GtkListStore *store;
+  GType *types;
+  GValue *values;
+  gint *columns;
+  GPtrArray *row;
+  gchar *label;
+  guint n_columns, idx, column;
+
+  /* the first column holds the row number */
+  n_columns = data->n_columns + 1;
+
+  types = g_new (GType, n_columns);
+  columns = g_new (gint, n_columns);
+  values = g_new0 (GValue, n_columns);
+
+  for (column = 0; column < n_columns; column++) {
+    types[column] = G_TYPE_STRING;
+    columns[column] = column;
+    g_value_init (&values[column], G_TYPE_STRING);
+  }
+
+  store = gtk_list_store_newv (n_columns, types);
+
+  for (idx = 0; idx < data->rows->len; idx++) {
+    row = g_ptr_array_index (data->rows, idx);
+
+    label = g_strdup_printf ("%u", idx + 1);
+    g_value_take_string (&values[0], label);
+
+    for (column = 1; column < n_columns; column++)
+      g_value_set_static_string (&values[column],
+                                 (column - 1 < row->len) ?
+                                 g_ptr_array_index (row, column - 1) : NULL);
+
+    gtk_list_store_insert_with_valuesv (store, NULL, -1,
+                                        columns, values, n_columns);
+  }
+
+  for (column = 0; column < n_columns; column++)
+    g_value_unset (&values[column]);
+
+  g_free (values);
+  g_free (columns);
+  g_free (types);
+
+  return GTK_TREE_MODEL (store);
+}
+
+static void
+load_sheet_ready_cb (GObject *source,
+                     GAsyncResult *res,
+                     gpointer user_data)
+{
+  SushiSpreadsheetLoader *self = SUSHI_SPREADSHEET_LOADER (source);
+  SheetData *data;
+  GError *error = NULL;
+
+  data = g_task_propagate_pointer (G_TASK (res), &error);
+
+  if (data == NULL) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_signal_emit (self, signals[ERROR], 0, error->message);
+
+    g_error_free (error);
+    return;
+  }
+
+  self->priv->model = build_model (data);
+  sheet_data_free (data);
+
+  sushi_trace_mark (self->priv->uri, "spreadsheet-loaded");
+  g_signal_emit (self, signals[LOADED], 0, self->priv->model);
+}
+
+static void
+start_loading_sheet (SushiSpreadsheetLoader *self)
+{
+  GTask *task;
+
+  self->priv->cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, self->priv->cancellable, load_sheet_ready_cb, NULL);
+  g_task_set_task_data (task, g_strdup (self->priv->uri), g_free);
+  g_task_run_in_thread (task, load_sheet_thread);
+
+  g_object_unref (task);
+}
+
+static void
+sushi_spreadsheet_loader_set_uri (SushiSpreadsheetLoader *self,
+                                  const gchar *uri)
+{
+  if (g_strcmp0 (uri, self->priv->uri) != 0) {
+    g_free (self->priv->uri);
+
+    self->priv->uri = g_strdup (uri);
+    g_clear_object (&self->priv->model);
+
+    if (self->priv->cancellable != NULL) {
+      g_cancellable_cancel (self->priv->cancellable);
+      g_clear_object (&self->priv->cancellable);
+    }
+
+    if (self->priv->uri != NULL)
+      start_loading_sheet (self);
+
+    g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_URI]);
+  }
+}
+
+static void
+sushi_spreadsheet_loader_dispose (GObject *object)
+{
+  SushiSpreadsheetLoader *self = SUSHI_SPREADSHEET_LOADER (object);
+
+  if (self->priv->cancellable != NULL) {
+    g_cancellable_cancel (self->priv->cancellable);
+    g_clear_object (&self->priv->cancellable);
+  }
+
+  g_clear_object (&self->priv->model);
+
+  G_OBJECT_CLASS (sushi_spreadsheet_loader_parent_class)->dispose (object);
+}
+
+static void
+sushi_spreadsheet_loader_finalize (GObject *object)
+{
+  SushiSpreadsheetLoader *self = SUSHI_SPREADSHEET_LOADER (object);
+
+  g_free (self->priv->uri);
+
+  G_OBJECT_CLASS (sushi_spreadsheet_loader_parent_class)->finalize (object);
+}
+
+static void
+sushi_spreadsheet_loader_get_property (GObject *object,
+                                       guint       prop_id,
+                                       GValue     *value,
+                                       GParamSpec *pspec)
+{
+  SushiSpreadsheetLoader *self = SUSHI_SPREADSHEET_LOADER (object);
+
+  switch (prop_id) {
+  case PROP_URI:
+    g_value_set_string (value, self->priv->uri);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_spreadsheet_loader_set_property (GObject *object,
+                                       guint       prop_id,
+                                       const GValue *value,
+                                       GParamSpec *pspec)
+{
+  SushiSpreadsheetLoader *self = SUSHI_SPREADSHEET_LOADER (object);
+
+  switch (prop_id) {
+  case PROP_URI:
+    sushi_spreadsheet_loader_set_uri (self, g_value_get_string (value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_spreadsheet_loader_class_init (SushiSpreadsheetLoaderClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->dispose = sushi_spreadsheet_loader_dispose;
+  oclass->finalize = sushi_spreadsheet_loader_finalize;
+  oclass->get_property = sushi_spreadsheet_loader_get_property;
+  oclass->set_property = sushi_spreadsheet_loader_set_property;
+
+  properties[PROP_URI] =
+    g_param_spec_string ("uri",
+                         "URI",
+                         "The URI to load",
+                         NULL,
+                         G_PARAM_READWRITE);
+
+  signals[LOADED] =
+    g_signal_new ("loaded",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1, GTK_TYPE_TREE_MODEL);
+
+  signals[ERROR] =
+    g_signal_new ("error",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__STRING,
+                  G_TYPE_NONE,
+                  1, G_TYPE_STRING);
+
+  g_object_class_install_properties (oclass, NUM_PROPERTIES, properties);
+
+  g_type_class_add_private (klass, sizeof (SushiSpreadsheetLoaderPrivate));
+}
+
+static void
+sushi_spreadsheet_loader_init (SushiSpreadsheetLoader *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_SPREADSHEET_LOADER,
+                                 SushiSpreadsheetLoaderPrivate);
+}
+
+/**
+ * sushi_spreadsheet_loader_new:
+ * @uri: the URI of an ODS or XLSX document
+ *
+ * Returns: (transfer full): a new #SushiSpreadsheetLoader, emitting
+ * #SushiSpreadsheetLoader::loaded with the first rows of the first sheet
+ */
+SushiSpreadsheetLoader *
+sushi_spreadsheet_loader_new (const gchar *uri)
+{
+  return g_object_new (SUSHI_TYPE_SPREADSHEET_LOADER,
+                       "uri", uri,
+                       NULL);
+}
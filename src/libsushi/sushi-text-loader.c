@@ -24,6 +24,7 @@
  */
 
 #include "sushi-text-loader.h"
+#include "sushi-trace.h"
 
 #include <gtksourceview/gtksource.h>
 
@@ -175,6 +176,7 @@ load_contents_async_ready_cb (GObject *source,
   language = text_loader_get_buffer_language (self, gtk_source_file_loader_get_location (loader));
   gtk_source_buffer_set_language (self->priv->buffer, language);
 
+  sushi_trace_mark (self->priv->uri, "text-loaded");
   g_signal_emit (self, signals[LOADED], 0, self->priv->buffer);
 }
 
@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-thumbnail-queue.h"
+
+/* pages just outside of the visible range are rendered as well, so
+ * that scrolling a little doesn't reveal empty slots.
+ */
+#define PREFETCH_PAGES 4
+#define DEFAULT_CACHE_SIZE (8 * 1024 * 1024)
+
+G_DEFINE_TYPE (SushiThumbnailQueue, sushi_thumbnail_queue, G_TYPE_OBJECT);
+
+enum {
+  PROP_DOCUMENT = 1,
+  PROP_WIDTH,
+  PROP_CACHE_SIZE,
+  NUM_PROPERTIES
+};
+
+enum {
+  THUMBNAIL_READY,
+  NUM_SIGNALS
+};
+
+static GParamSpec* properties[NUM_PROPERTIES] = { NULL, };
+static guint signals[NUM_SIGNALS] = { 0, };
+
+struct _SushiThumbnailQueuePrivate {
+  EvDocument *document;
+  gint width;
+
+  GThreadPool *pool;
+  GHashTable *pending;
+  gint center;
+
+  /* rendered thumbnails, least recently used last */
+  GQueue lru;
+  GHashTable *cache;
+  gsize cache_size;
+  gsize cached_bytes;
+};
+
+typedef struct {
+  SushiThumbnailQueue *queue;
+  gint page;
+  gint cancelled;
+  GdkPixbuf *pixbuf;
+} ThumbnailJob;
+
+typedef struct {
+  gint page;
+  GdkPixbuf *pixbuf;
+} CacheEntry;
+
+static gsize
+pixbuf_get_byte_size (GdkPixbuf *pixbuf)
+{
+  return (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_object_unref (entry->pixbuf);
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+cache_trim (SushiThumbnailQueue *self)
+{
+  CacheEntry *entry;
+
+  while (self->priv->cached_bytes > self->priv->cache_size &&
+         self->priv->lru.length > 1) {
+    entry = g_queue_pop_tail (&self->priv->lru);
+
+    g_hash_table_remove (self->priv->cache, GINT_TO_POINTER (entry->page));
+    self->priv->cached_bytes -= pixbuf_get_byte_size (entry->pixbuf);
+
+    cache_entry_free (entry);
+  }
+}
+
+static void
+cache_insert (SushiThumbnailQueue *self,
+              gint page,
+              GdkPixbuf *pixbuf)
+{
+  CacheEntry *entry;
+  GList *link;
+
+  link = g_hash_table_lookup (self->priv->cache, GINT_TO_POINTER (page));
+  if (link != NULL) {
+    entry = link->data;
+
+    self->priv->cached_bytes -= pixbuf_get_byte_size (entry->pixbuf);
+    g_queue_delete_link (&self->priv->lru, link);
+    cache_entry_free (entry);
+  }
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->page = page;
+  entry->pixbuf = g_object_ref (pixbuf);
+
+  g_queue_push_head (&self->priv->lru, entry);
+  g_hash_table_insert (self->priv->cache, GINT_TO_POINTER (page),
+                       self->priv->lru.head);
+  self->priv->cached_bytes += pixbuf_get_byte_size (pixbuf);
+
+  cache_trim (self);
+}
+
+static void
+thumbnail_job_free (ThumbnailJob *job)
+{
+  g_clear_object (&job->pixbuf);
+  g_object_unref (job->queue);
+  g_slice_free (ThumbnailJob, job);
+}
+
+static gboolean
+thumbnail_job_done (gpointer user_data)
+{
+  ThumbnailJob *job = user_data;
+  SushiThumbnailQueue *self = job->queue;
+  gpointer key = GINT_TO_POINTER (job->page);
+
+  if (g_hash_table_lookup (self->priv->pending, key) == job)
+    g_hash_table_remove (self->priv->pending, key);
+
+  /* keep the result even if it scrolled out of view meanwhile */
+  if (job->pixbuf != NULL) {
+    cache_insert (self, job->page, job->pixbuf);
+    g_signal_emit (self, signals[THUMBNAIL_READY], 0, job->page);
+  }
+
+  thumbnail_job_free (job);
+
+  return FALSE;
+}
+
+static void
+render_thumbnail (gpointer data,
+                  gpointer user_data)
+{
+  ThumbnailJob *job = data;
+  EvDocument *document = job->queue->priv->document;
+  EvRenderContext *rc;
+  EvPage *page;
+  gdouble width, height;
+
+  if (!g_atomic_int_get (&job->cancelled)) {
+    ev_document_doc_mutex_lock ();
+
+    ev_document_get_page_size (document, job->page, &width, &height);
+
+    if (width > 0) {
+      page = ev_document_get_page (document, job->page);
+      rc = ev_render_context_new (page, 0, job->queue->priv->width / width);
+      job->pixbuf = ev_document_get_thumbnail (document, rc);
+
+      g_object_unref (rc);
+      g_object_unref (page);
+    }
+
+    ev_document_doc_mutex_unlock ();
+  }
+
+  g_idle_add (thumbnail_job_done, job);
+}
+
+static gint
+compare_jobs (gconstpointer a,
+              gconstpointer b,
+              gpointer user_data)
+{
+  const ThumbnailJob *job_a = a;
+  const ThumbnailJob *job_b = b;
+  SushiThumbnailQueue *self = user_data;
+  gint center;
+
+  /* the closer to the middle of the viewport, the sooner */
+  center = g_atomic_int_get (&self->priv->center);
+
+  return ABS (job_a->page - center) - ABS (job_b->page - center);
+}
+
+static gboolean
+cancel_job (gpointer key,
+            gpointer value,
+            gpointer user_data)
+{
+  ThumbnailJob *job = value;
+
+  g_atomic_int_set (&job->cancelled, TRUE);
+  return TRUE;
+}
+
+static gboolean
+cancel_job_out_of_range (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+  ThumbnailJob *job = value;
+  gint *range = user_data;
+
+  if (job->page >= range[0] && job->page <= range[1])
+    return FALSE;
+
+  return cancel_job (key, value, user_data);
+}
+
+/**
+ * sushi_thumbnail_queue_set_visible_range:
+ * @self:
+ * @first_page: the first page visible in the viewport, or -1 if none is
+ * @last_page: the last page visible in the viewport
+ *
+ * Renders the thumbnails of the pages around the viewport which are not
+ * in the cache yet, nearest first, and cancels the pending ones which
+ * went out of view. #SushiThumbnailQueue::thumbnail-ready is emitted
+ * as each one becomes available.
+ */
+void
+sushi_thumbnail_queue_set_visible_range (SushiThumbnailQueue *self,
+                                         gint first_page,
+                                         gint last_page)
+{
+  ThumbnailJob *job;
+  gint range[2];
+  gint page;
+
+  if (first_page < 0 || last_page < first_page) {
+    sushi_thumbnail_queue_cancel_all (self);
+    return;
+  }
+
+  range[0] = MAX (first_page - PREFETCH_PAGES, 0);
+  range[1] = MIN (last_page + PREFETCH_PAGES,
+                  ev_document_get_n_pages (self->priv->document) - 1);
+
+  g_atomic_int_set (&self->priv->center, (first_page + last_page) / 2);
+
+  g_hash_table_foreach_remove (self->priv->pending,
+                               cancel_job_out_of_range, range);
+
+  for (page = range[0]; page <= range[1]; page++) {
+    if (g_hash_table_contains (self->priv->cache, GINT_TO_POINTER (page)) ||
+        g_hash_table_contains (self->priv->pending, GINT_TO_POINTER (page)))
+      continue;
+
+    job = g_slice_new0 (ThumbnailJob);
+    job->queue = g_object_ref (self);
+    job->page = page;
+
+    g_hash_table_insert (self->priv->pending, GINT_TO_POINTER (page), job);
+    g_thread_pool_push (self->priv->pool, job, NULL);
+  }
+}
+
+/**
+ * sushi_thumbnail_queue_get_thumbnail:
+ * @self:
+ * @page: a page of the document
+ *
+ * Returns: (transfer none) (allow-none): the thumbnail of @page, or
+ *   %NULL if it's not rendered yet
+ */
+GdkPixbuf *
+sushi_thumbnail_queue_get_thumbnail (SushiThumbnailQueue *self,
+                                     gint page)
+{
+  GList *link;
+
+  link = g_hash_table_lookup (self->priv->cache, GINT_TO_POINTER (page));
+  if (link == NULL)
+    return NULL;
+
+  g_queue_unlink (&self->priv->lru, link);
+  g_queue_push_head_link (&self->priv->lru, link);
+
+  return ((CacheEntry *) link->data)->pixbuf;
+}
+
+/**
+ * sushi_thumbnail_queue_cancel_all:
+ * @self:
+ *
+ * Cancels all the pending thumbnails, e.g. when they are hidden.
+ */
+void
+sushi_thumbnail_queue_cancel_all (SushiThumbnailQueue *self)
+{
+  g_hash_table_foreach_remove (self->priv->pending, cancel_job, NULL);
+}
+
+static void
+sushi_thumbnail_queue_dispose (GObject *object)
+{
+  SushiThumbnailQueue *self = SUSHI_THUMBNAIL_QUEUE (object);
+
+  g_clear_object (&self->priv->document);
+
+  G_OBJECT_CLASS (sushi_thumbnail_queue_parent_class)->dispose (object);
+}
+
+static void
+sushi_thumbnail_queue_finalize (GObject *object)
+{
+  SushiThumbnailQueue *self = SUSHI_THUMBNAIL_QUEUE (object);
+
+  /* pending jobs keep the queue alive, so the pool is idle by now */
+  g_thread_pool_free (self->priv->pool, TRUE, FALSE);
+
+  g_hash_table_destroy (self->priv->pending);
+  g_hash_table_destroy (self->priv->cache);
+  g_queue_foreach (&self->priv->lru, (GFunc) cache_entry_free, NULL);
+  g_queue_clear (&self->priv->lru);
+
+  G_OBJECT_CLASS (sushi_thumbnail_queue_parent_class)->finalize (object);
+}
+
+static void
+sushi_thumbnail_queue_get_property (GObject *object,
+                                    guint       prop_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+  SushiThumbnailQueue *self = SUSHI_THUMBNAIL_QUEUE (object);
+
+  switch (prop_id) {
+  case PROP_DOCUMENT:
+    g_value_set_object (value, self->priv->document);
+    break;
+  case PROP_WIDTH:
+    g_value_set_int (value, self->priv->width);
+    break;
+  case PROP_CACHE_SIZE:
+    g_value_set_uint (value, self->priv->cache_size);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_thumbnail_queue_set_property (GObject *object,
+                                    guint       prop_id,
+                                    const GValue *value,
+                                    GParamSpec *pspec)
+{
+  SushiThumbnailQueue *self = SUSHI_THUMBNAIL_QUEUE (object);
+
+  switch (prop_id) {
+  case PROP_DOCUMENT:
+    self->priv->document = g_value_dup_object (value);
+    break;
+  case PROP_WIDTH:
+    self->priv->width = g_value_get_int (value);
+    break;
+  case PROP_CACHE_SIZE:
+    self->priv->cache_size = g_value_get_uint (value);
+    cache_trim (self);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_thumbnail_queue_class_init (SushiThumbnailQueueClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->dispose = sushi_thumbnail_queue_dispose;
+  oclass->finalize = sushi_thumbnail_queue_finalize;
+  oclass->get_property = sushi_thumbnail_queue_get_property;
+  oclass->set_property = sushi_thumbnail_queue_set_property;
+
+  properties[PROP_DOCUMENT] =
+    g_param_spec_object ("document",
+                         "Document",
+                         "The document to render thumbnails of",
+                         EV_TYPE_DOCUMENT,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  properties[PROP_WIDTH] =
+    g_param_spec_int ("width",
+                      "Width",
+                      "The width of the thumbnails",
+                      1, G_MAXINT, 96,
+                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  properties[PROP_CACHE_SIZE] =
+    g_param_spec_uint ("cache-size",
+                       "Cache size",
+                       "How many bytes of rendered thumbnails to keep",
+                       0, G_MAXUINT, DEFAULT_CACHE_SIZE,
+                       G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+
+  signals[THUMBNAIL_READY] =
+    g_signal_new ("thumbnail-ready",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__INT,
+                  G_TYPE_NONE,
+                  1, G_TYPE_INT);
+
+  g_object_class_install_properties (oclass, NUM_PROPERTIES, properties);
+
+  g_type_class_add_private (klass, sizeof (SushiThumbnailQueuePrivate));
+}
+
+static void
+sushi_thumbnail_queue_init (SushiThumbnailQueue *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_THUMBNAIL_QUEUE,
+                                 SushiThumbnailQueuePrivate);
+
+  self->priv->pending = g_hash_table_new (NULL, NULL);
+  self->priv->cache = g_hash_table_new (NULL, NULL);
+  g_queue_init (&self->priv->lru);
+
+  /* rendering is serialized by the document mutex anyway */
+  self->priv->pool = g_thread_pool_new (render_thumbnail, self,
+                                        1, FALSE, NULL);
+  g_thread_pool_set_sort_function (self->priv->pool, compare_jobs, self);
+}
+
+/**
+ * sushi_thumbnail_queue_new:
+ * @document: a loaded document
+ * @width: the width of the thumbnails, in pixels
+ *
+ * Returns: (transfer full): a new #SushiThumbnailQueue
+ */
+SushiThumbnailQueue *
+sushi_thumbnail_queue_new (EvDocument *document,
+                           gint width)
+{
+  return g_object_new (SUSHI_TYPE_THUMBNAIL_QUEUE,
+                       "document", document,
+                       "width", width,
+                       NULL);
+}
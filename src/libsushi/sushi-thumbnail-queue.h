@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_THUMBNAIL_QUEUE_H__
+#define __SUSHI_THUMBNAIL_QUEUE_H__
+
+#include <glib-object.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <evince-document.h>
+
+G_BEGIN_DECLS
+
+#define SUSHI_TYPE_THUMBNAIL_QUEUE            (sushi_thumbnail_queue_get_type ())
+#define SUSHI_THUMBNAIL_QUEUE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUSHI_TYPE_THUMBNAIL_QUEUE, SushiThumbnailQueue))
+#define SUSHI_IS_THUMBNAIL_QUEUE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SUSHI_TYPE_THUMBNAIL_QUEUE))
+#define SUSHI_THUMBNAIL_QUEUE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  SUSHI_TYPE_THUMBNAIL_QUEUE, SushiThumbnailQueueClass))
+#define SUSHI_IS_THUMBNAIL_QUEUE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  SUSHI_TYPE_THUMBNAIL_QUEUE))
+#define SUSHI_THUMBNAIL_QUEUE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  SUSHI_TYPE_THUMBNAIL_QUEUE, SushiThumbnailQueueClass))
+
+typedef struct _SushiThumbnailQueue          SushiThumbnailQueue;
+typedef struct _SushiThumbnailQueuePrivate   SushiThumbnailQueuePrivate;
+typedef struct _SushiThumbnailQueueClass     SushiThumbnailQueueClass;
+
+struct _SushiThumbnailQueue
+{
+  GObject parent_instance;
+
+  SushiThumbnailQueuePrivate *priv;
+};
+
+struct _SushiThumbnailQueueClass
+{
+  GObjectClass parent_class;
+};
+
+GType    sushi_thumbnail_queue_get_type     (void) G_GNUC_CONST;
+
+SushiThumbnailQueue *sushi_thumbnail_queue_new (EvDocument *document,
+                                                gint width);
+
+void sushi_thumbnail_queue_set_visible_range (SushiThumbnailQueue *self,
+                                              gint first_page,
+                                              gint last_page);
+GdkPixbuf *sushi_thumbnail_queue_get_thumbnail (SushiThumbnailQueue *self,
+                                                gint page);
+void sushi_thumbnail_queue_cancel_all (SushiThumbnailQueue *self);
+
+G_END_DECLS
+
+#endif /* __SUSHI_THUMBNAIL_QUEUE_H__ */
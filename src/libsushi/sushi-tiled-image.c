@@ -0,0 +1,778 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+#include "sushi-tiled-image.h"
+
+#include "sushi-image-region.h"
+
+/* Serves an image too large to be decoded whole as a pyramid of tiles:
+ * level L is the image scaled down by 2^L, cut in squares of
+ * SUSHI_TILED_IMAGE_TILE_SIZE pixels, and the last level fits in a
+ * single tile. Tiles are decoded on demand by a pool of workers, a row
+ * of adjacent tiles at a time, and kept in a bounded cache; the last
+ * level is always kept, to have something to draw in the meantime.
+ */
+
+#define TILE_SIZE SUSHI_TILED_IMAGE_TILE_SIZE
+
+/* tiles just outside of the viewport are decoded as well, so that
+ * panning a little doesn't reveal missing ones.
+ */
+#define PREFETCH_TILES 1
+#define MAX_WORKERS 4
+#define DEFAULT_CACHE_SIZE (128 * 1024 * 1024)
+
+G_DEFINE_TYPE (SushiTiledImage, sushi_tiled_image, G_TYPE_OBJECT);
+
+enum {
+  PROP_FILE = 1,
+  PROP_WIDTH,
+  PROP_HEIGHT,
+  PROP_N_LEVELS,
+  PROP_CACHE_SIZE,
+  NUM_PROPERTIES
+};
+
+enum {
+  TILES_READY,
+  NUM_SIGNALS
+};
+
+static GParamSpec* properties[NUM_PROPERTIES] = { NULL, };
+static guint signals[NUM_SIGNALS] = { 0, };
+
+struct _SushiTiledImagePrivate {
+  GFile *file;
+  SushiImageRegionReader *reader;
+
+  gint width;
+  gint height;
+  gint n_levels;
+
+  /* the whole image, at the last level */
+  GdkPixbuf *base;
+
+  GThreadPool *pool;
+  GHashTable *pending;
+  gint center_row;
+
+  /* decoded tiles, least recently used last */
+  GQueue lru;
+  GHashTable *cache;
+  gsize cache_size;
+  gsize cached_bytes;
+};
+
+typedef struct {
+  SushiTiledImage *image;
+  GCancellable *cancellable;
+
+  gint level;
+  gint row;
+  gint first_col;
+  gint last_col;
+
+  /* how many of its tiles are still wanted */
+  gint wanted;
+
+  GdkPixbuf **tiles;
+} TileJob;
+
+typedef struct {
+  gint64 key;
+  GdkPixbuf *pixbuf;
+} CacheEntry;
+
+static gint64
+tile_key (gint level,
+          gint col,
+          gint row)
+{
+  return ((gint64) level << 56) | ((gint64) row << 28) | col;
+}
+
+static gint
+level_size (gint size,
+            gint level)
+{
+  return MAX (1, (size + (1 << level) - 1) >> level);
+}
+
+static gsize
+pixbuf_get_byte_size (GdkPixbuf *pixbuf)
+{
+  return (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_object_unref (entry->pixbuf);
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+cache_trim (SushiTiledImage *self)
+{
+  CacheEntry *entry;
+
+  while (self->priv->cached_bytes > self->priv->cache_size &&
+         self->priv->lru.length > 1) {
+    entry = g_queue_pop_tail (&self->priv->lru);
+
+    g_hash_table_remove (self->priv->cache, &entry->key);
+    self->priv->cached_bytes -= pixbuf_get_byte_size (entry->pixbuf);
+
+    cache_entry_free (entry);
+  }
+}
+
+static void
+cache_insert (SushiTiledImage *self,
+              gint64 key,
+              GdkPixbuf *pixbuf)
+{
+  CacheEntry *entry;
+  GList *link;
+
+  link = g_hash_table_lookup (self->priv->cache, &key);
+  if (link != NULL) {
+    entry = link->data;
+
+    g_hash_table_remove (self->priv->cache, &key);
+    self->priv->cached_bytes -= pixbuf_get_byte_size (entry->pixbuf);
+    g_queue_delete_link (&self->priv->lru, link);
+    cache_entry_free (entry);
+  }
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->key = key;
+  entry->pixbuf = g_object_ref (pixbuf);
+
+  g_queue_push_head (&self->priv->lru, entry);
+  g_hash_table_insert (self->priv->cache, &entry->key,
+                       self->priv->lru.head);
+  self->priv->cached_bytes += pixbuf_get_byte_size (pixbuf);
+
+  cache_trim (self);
+}
+
+static gboolean
+tile_is_available (SushiTiledImage *self,
+                   gint64 key)
+{
+  return g_hash_table_contains (self->priv->cache, &key) ||
+    g_hash_table_contains (self->priv->pending, &key);
+}
+
+static void
+tile_job_free (TileJob *job)
+{
+  gint idx;
+
+  for (idx = 0; idx <= job->last_col - job->first_col; idx++)
+    g_clear_object (&job->tiles[idx]);
+
+  g_free (job->tiles);
+  g_object_unref (job->cancellable);
+  g_object_unref (job->image);
+  g_slice_free (TileJob, job);
+}
+
+static gboolean
+tile_job_done (gpointer user_data)
+{
+  TileJob *job = user_data;
+  SushiTiledImage *self = job->image;
+  gboolean any_ready = FALSE;
+  gint64 key;
+  gint col;
+
+  for (col = job->first_col; col <= job->last_col; col++) {
+    GdkPixbuf *tile = job->tiles[col - job->first_col];
+
+    key = tile_key (job->level, col, job->row);
+
+    if (g_hash_table_lookup (self->priv->pending, &key) == job)
+      g_hash_table_remove (self->priv->pending, &key);
+
+    if (tile == NULL)
+      continue;
+
+    /* keep the result even if it went out of view meanwhile */
+    if (job->level == self->priv->n_levels - 1) {
+      g_clear_object (&self->priv->base);
+      self->priv->base = g_object_ref (tile);
+    } else
+      cache_insert (self, key, tile);
+
+    any_ready = TRUE;
+  }
+
+  if (any_ready)
+    g_signal_emit (self, signals[TILES_READY], 0, job->level);
+
+  tile_job_free (job);
+
+  return FALSE;
+}
+
+static void
+decode_tiles (gpointer data,
+              gpointer user_data)
+{
+  TileJob *job = data;
+  SushiImageRegionReader *reader = job->image->priv->reader;
+  GdkPixbuf *region, *sub;
+  gint width, height, x, col;
+  GError *error = NULL;
+
+  if (g_cancellable_is_cancelled (job->cancellable))
+    goto out;
+
+  region = sushi_image_region_reader_read (reader, job->level,
+                                           job->first_col * TILE_SIZE,
+                                           job->row * TILE_SIZE,
+                                           (job->last_col - job->first_col + 1) * TILE_SIZE,
+                                           TILE_SIZE,
+                                           job->cancellable, &error);
+
+  if (region == NULL) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Unable to decode tiles of the image: %s", error->message);
+
+    g_error_free (error);
+    goto out;
+  }
+
+  width = gdk_pixbuf_get_width (region);
+  height = gdk_pixbuf_get_height (region);
+
+  if (job->first_col == job->last_col) {
+    job->tiles[0] = region;
+    goto out;
+  }
+
+  /* copy the tiles out, so that the row can go away */
+  for (col = job->first_col; col <= job->last_col; col++) {
+    x = (col - job->first_col) * TILE_SIZE;
+    if (x >= width)
+      break;
+
+    sub = gdk_pixbuf_new_subpixbuf (region, x, 0,
+                                    MIN (TILE_SIZE, width - x), height);
+    job->tiles[col - job->first_col] = gdk_pixbuf_copy (sub);
+    g_object_unref (sub);
+  }
+
+  g_object_unref (region);
+
+ out:
+  g_idle_add (tile_job_done, job);
+}
+
+static gint
+compare_jobs (gconstpointer a,
+              gconstpointer b,
+              gpointer user_data)
+{
+  const TileJob *job_a = a;
+  const TileJob *job_b = b;
+  SushiTiledImage *self = user_data;
+  gint center;
+
+  /* the last level comes first, as it stands in for everything else */
+  if (job_a->level != job_b->level)
+    return job_b->level - job_a->level;
+
+  /* some formats can only be read forward; reading from the top
+   * continues where the previous row stopped.
+   */
+  if (sushi_image_region_reader_is_sequential (self->priv->reader))
+    return job_a->row - job_b->row;
+
+  /* otherwise, the closer to the middle of the viewport, the sooner */
+  center = g_atomic_int_get (&self->priv->center_row);
+
+  return ABS (job_a->row - center) - ABS (job_b->row - center);
+}
+
+static void
+queue_tiles (SushiTiledImage *self,
+             gint level,
+             gint row,
+             gint first_col,
+             gint last_col)
+{
+  TileJob *job;
+  gint64 *key;
+  gint col;
+
+  job = g_slice_new0 (TileJob);
+  job->image = g_object_ref (self);
+  job->cancellable = g_cancellable_new ();
+  job->level = level;
+  job->row = row;
+  job->first_col = first_col;
+  job->last_col = last_col;
+  job->wanted = last_col - first_col + 1;
+  job->tiles = g_new0 (GdkPixbuf *, job->wanted);
+
+  for (col = first_col; col <= last_col; col++) {
+    key = g_new (gint64, 1);
+    *key = tile_key (level, col, row);
+
+    g_hash_table_insert (self->priv->pending, key, job);
+  }
+
+  g_thread_pool_push (self->priv->pool, job, NULL);
+}
+
+static gboolean
+cancel_tile (gpointer key,
+             gpointer value,
+             gpointer user_data)
+{
+  TileJob *job = value;
+
+  /* a row is given up on once none of its tiles are wanted anymore */
+  if (--job->wanted == 0)
+    g_cancellable_cancel (job->cancellable);
+
+  return TRUE;
+}
+
+static gboolean
+cancel_tile_out_of_range (gpointer key,
+                          gpointer value,
+                          gpointer user_data)
+{
+  TileJob *job = value;
+  gint *range = user_data;
+  gint64 tile = *(gint64 *) key;
+  gint col, row;
+
+  col = tile & ((1 << 28) - 1);
+  row = (tile >> 28) & ((1 << 28) - 1);
+
+  if (job->level == range[0] &&
+      col >= range[1] && col <= range[2] &&
+      row >= range[3] && row <= range[4])
+    return FALSE;
+
+  /* never give up on the last level */
+  if (job->level == job->image->priv->n_levels - 1)
+    return FALSE;
+
+  return cancel_tile (key, value, user_data);
+}
+
+/**
+ * sushi_tiled_image_set_viewport:
+ * @self:
+ * @level: the level being shown
+ * @x: the left edge of the viewport, in the coordinates of @level
+ * @y: the top edge of the viewport, in the coordinates of @level
+ * @width: the width of the viewport
+ * @height: the height of the viewport
+ *
+ * Decodes the tiles of @level around the viewport which are not in the
+ * cache yet, and cancels the pending ones which went out of view.
+ * #SushiTiledImage::tiles-ready is emitted as they become available.
+ */
+void
+sushi_tiled_image_set_viewport (SushiTiledImage *self,
+                                gint level,
+                                gint x,
+                                gint y,
+                                gint width,
+                                gint height)
+{
+  gint range[5];
+  gint level_w, level_h;
+  gint row, col, first_col;
+  gint top;
+
+  g_return_if_fail (self->priv->reader != NULL);
+
+  top = self->priv->n_levels - 1;
+
+  if (self->priv->base == NULL &&
+      !tile_is_available (self, tile_key (top, 0, 0)))
+    queue_tiles (self, top, 0, 0, 0);
+
+  level = CLAMP (level, 0, top);
+  level_w = level_size (self->priv->width, level);
+  level_h = level_size (self->priv->height, level);
+
+  x = CLAMP (x, 0, level_w - 1);
+  y = CLAMP (y, 0, level_h - 1);
+  width = MIN (x + MAX (width, 1), level_w) - x;
+  height = MIN (y + MAX (height, 1), level_h) - y;
+
+  range[0] = level;
+  range[1] = MAX (x / TILE_SIZE - PREFETCH_TILES, 0);
+  range[2] = MIN ((x + width - 1) / TILE_SIZE + PREFETCH_TILES,
+                  (level_w - 1) / TILE_SIZE);
+  range[3] = MAX (y / TILE_SIZE - PREFETCH_TILES, 0);
+  range[4] = MIN ((y + height - 1) / TILE_SIZE + PREFETCH_TILES,
+                  (level_h - 1) / TILE_SIZE);
+
+  g_atomic_int_set (&self->priv->center_row, (range[3] + range[4]) / 2);
+
+  g_hash_table_foreach_remove (self->priv->pending,
+                               cancel_tile_out_of_range, range);
+
+  if (level == top)
+    return;
+
+  /* runs of missing tiles on a row are decoded together */
+  for (row = range[3]; row <= range[4]; row++) {
+    first_col = -1;
+
+    for (col = range[1]; col <= range[2] + 1; col++) {
+      if (col <= range[2] &&
+          !tile_is_available (self, tile_key (level, col, row))) {
+        if (first_col < 0)
+          first_col = col;
+        continue;
+      }
+
+      if (first_col >= 0)
+        queue_tiles (self, level, row, first_col, col - 1);
+      first_col = -1;
+    }
+  }
+}
+
+/**
+ * sushi_tiled_image_get_tile:
+ * @self:
+ * @level: a level of the image
+ * @col: the column of the tile
+ * @row: the row of the tile
+ *
+ * Returns: (transfer none) (allow-none): the tile, or %NULL if it's not
+ *   decoded yet
+ */
+GdkPixbuf *
+sushi_tiled_image_get_tile (SushiTiledImage *self,
+                            gint level,
+                            gint col,
+                            gint row)
+{
+  GList *link;
+  gint64 key;
+
+  if (level == self->priv->n_levels - 1)
+    return (col == 0 && row == 0) ? self->priv->base : NULL;
+
+  key = tile_key (level, col, row);
+  link = g_hash_table_lookup (self->priv->cache, &key);
+  if (link == NULL)
+    return NULL;
+
+  g_queue_unlink (&self->priv->lru, link);
+  g_queue_push_head_link (&self->priv->lru, link);
+
+  return ((CacheEntry *) link->data)->pixbuf;
+}
+
+/**
+ * sushi_tiled_image_cancel_all:
+ * @self:
+ *
+ * Cancels all the pending tiles, e.g. when the image is hidden.
+ */
+void
+sushi_tiled_image_cancel_all (SushiTiledImage *self)
+{
+  g_hash_table_foreach_remove (self->priv->pending, cancel_tile, NULL);
+}
+
+static void
+load_reader_thread (GTask *task,
+                    gpointer source_object,
+                    gpointer task_data,
+                    GCancellable *cancellable)
+{
+  SushiTiledImage *self = source_object;
+  SushiImageRegionReader *reader;
+  gchar *path;
+  GError *error = NULL;
+
+  path = g_file_get_path (self->priv->file);
+  if (path == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Only local images can be tiled");
+    return;
+  }
+
+  reader = sushi_image_region_reader_open (path, &error);
+  g_free (path);
+
+  if (reader == NULL) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  g_task_return_pointer (task, reader,
+                         (GDestroyNotify) sushi_image_region_reader_free);
+}
+
+/**
+ * sushi_tiled_image_load_async:
+ * @self:
+ * @cancellable: (allow-none):
+ * @callback:
+ * @user_data:
+ *
+ * Reads the size of the image in a thread; tiles can be asked for once
+ * it's done.
+ */
+void
+sushi_tiled_image_load_async (SushiTiledImage *self,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+  GTask *task;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_run_in_thread (task, load_reader_thread);
+
+  g_object_unref (task);
+}
+
+/**
+ * sushi_tiled_image_load_finish:
+ * @self:
+ * @result:
+ * @error:
+ *
+ * Returns: %TRUE if the image can be tiled
+ */
+gboolean
+sushi_tiled_image_load_finish (SushiTiledImage *self,
+                               GAsyncResult *result,
+                               GError **error)
+{
+  SushiImageRegionReader *reader;
+  gint size, n_levels;
+
+  reader = g_task_propagate_pointer (G_TASK (result), error);
+  if (reader == NULL)
+    return FALSE;
+
+  g_clear_pointer (&self->priv->reader, sushi_image_region_reader_free);
+  self->priv->reader = reader;
+
+  sushi_image_region_reader_get_size (reader,
+                                      &self->priv->width,
+                                      &self->priv->height);
+
+  size = MAX (self->priv->width, self->priv->height);
+  for (n_levels = 1; size > TILE_SIZE; n_levels++)
+    size = (size + 1) / 2;
+
+  self->priv->n_levels = n_levels;
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_WIDTH]);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_HEIGHT]);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_N_LEVELS]);
+
+  return TRUE;
+}
+
+static void
+sushi_tiled_image_dispose (GObject *object)
+{
+  SushiTiledImage *self = SUSHI_TILED_IMAGE (object);
+
+  g_clear_object (&self->priv->file);
+  g_clear_object (&self->priv->base);
+
+  G_OBJECT_CLASS (sushi_tiled_image_parent_class)->dispose (object);
+}
+
+static void
+sushi_tiled_image_finalize (GObject *object)
+{
+  SushiTiledImage *self = SUSHI_TILED_IMAGE (object);
+
+  /* pending jobs keep the image alive, so the pool is idle by now */
+  g_thread_pool_free (self->priv->pool, TRUE, FALSE);
+
+  g_hash_table_destroy (self->priv->pending);
+  g_hash_table_destroy (self->priv->cache);
+  g_queue_foreach (&self->priv->lru, (GFunc) cache_entry_free, NULL);
+  g_queue_clear (&self->priv->lru);
+
+  g_clear_pointer (&self->priv->reader, sushi_image_region_reader_free);
+
+  G_OBJECT_CLASS (sushi_tiled_image_parent_class)->finalize (object);
+}
+
+static void
+sushi_tiled_image_get_property (GObject *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  SushiTiledImage *self = SUSHI_TILED_IMAGE (object);
+
+  switch (prop_id) {
+  case PROP_FILE:
+    g_value_set_object (value, self->priv->file);
+    break;
+  case PROP_WIDTH:
+    g_value_set_int (value, self->priv->width);
+    break;
+  case PROP_HEIGHT:
+    g_value_set_int (value, self->priv->height);
+    break;
+  case PROP_N_LEVELS:
+    g_value_set_int (value, self->priv->n_levels);
+    break;
+  case PROP_CACHE_SIZE:
+    g_value_set_uint (value, self->priv->cache_size);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_tiled_image_set_property (GObject *object,
+                                guint       prop_id,
+                                const GValue *value,
+                                GParamSpec *pspec)
+{
+  SushiTiledImage *self = SUSHI_TILED_IMAGE (object);
+
+  switch (prop_id) {
+  case PROP_FILE:
+    self->priv->file = g_value_dup_object (value);
+    break;
+  case PROP_CACHE_SIZE:
+    self->priv->cache_size = g_value_get_uint (value);
+    cache_trim (self);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+sushi_tiled_image_class_init (SushiTiledImageClass *klass)
+{
+  GObjectClass *oclass;
+
+  oclass = G_OBJECT_CLASS (klass);
+  oclass->dispose = sushi_tiled_image_dispose;
+  oclass->finalize = sushi_tiled_image_finalize;
+  oclass->get_property = sushi_tiled_image_get_property;
+  oclass->set_property = sushi_tiled_image_set_property;
+
+  properties[PROP_FILE] =
+    g_param_spec_object ("file",
+                         "File",
+                         "The image file",
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  properties[PROP_WIDTH] =
+    g_param_spec_int ("width",
+                      "Width",
+                      "The full width of the image",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE);
+
+  properties[PROP_HEIGHT] =
+    g_param_spec_int ("height",
+                      "Height",
+                      "The full height of the image",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE);
+
+  properties[PROP_N_LEVELS] =
+    g_param_spec_int ("n-levels",
+                      "Levels",
+                      "The number of levels; the last one fits in a tile",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE);
+
+  properties[PROP_CACHE_SIZE] =
+    g_param_spec_uint ("cache-size",
+                       "Cache size",
+                       "How many bytes of decoded tiles to keep",
+                       0, G_MAXUINT, DEFAULT_CACHE_SIZE,
+                       G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+
+  signals[TILES_READY] =
+    g_signal_new ("tiles-ready",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__INT,
+                  G_TYPE_NONE,
+                  1, G_TYPE_INT);
+
+  g_object_class_install_properties (oclass, NUM_PROPERTIES, properties);
+
+  g_type_class_add_private (klass, sizeof (SushiTiledImagePrivate));
+}
+
+static void
+sushi_tiled_image_init (SushiTiledImage *self)
+{
+  self->priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                 SUSHI_TYPE_TILED_IMAGE,
+                                 SushiTiledImagePrivate);
+
+  self->priv->pending = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                               g_free, NULL);
+  self->priv->cache = g_hash_table_new (g_int64_hash, g_int64_equal);
+  g_queue_init (&self->priv->lru);
+
+  self->priv->pool = g_thread_pool_new (decode_tiles, self,
+                                        CLAMP (g_get_num_processors (), 1, MAX_WORKERS),
+                                        FALSE, NULL);
+  g_thread_pool_set_sort_function (self->priv->pool, compare_jobs, self);
+}
+
+/**
+ * sushi_tiled_image_new:
+ * @file: an image file
+ *
+ * Returns: (transfer full): a new #SushiTiledImage for @file
+ */
+SushiTiledImage *
+sushi_tiled_image_new (GFile *file)
+{
+  return g_object_new (SUSHI_TYPE_TILED_IMAGE,
+                       "file", file,
+                       NULL);
+}
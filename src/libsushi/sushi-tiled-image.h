@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_TILED_IMAGE_H__
+#define __SUSHI_TILED_IMAGE_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+#define SUSHI_TILED_IMAGE_TILE_SIZE 256
+
+#define SUSHI_TYPE_TILED_IMAGE            (sushi_tiled_image_get_type ())
+#define SUSHI_TILED_IMAGE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUSHI_TYPE_TILED_IMAGE, SushiTiledImage))
+#define SUSHI_IS_TILED_IMAGE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SUSHI_TYPE_TILED_IMAGE))
+#define SUSHI_TILED_IMAGE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  SUSHI_TYPE_TILED_IMAGE, SushiTiledImageClass))
+#define SUSHI_IS_TILED_IMAGE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  SUSHI_TYPE_TILED_IMAGE))
+#define SUSHI_TILED_IMAGE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  SUSHI_TYPE_TILED_IMAGE, SushiTiledImageClass))
+
+typedef struct _SushiTiledImage          SushiTiledImage;
+typedef struct _SushiTiledImagePrivate   SushiTiledImagePrivate;
+typedef struct _SushiTiledImageClass     SushiTiledImageClass;
+
+struct _SushiTiledImage
+{
+  GObject parent_instance;
+
+  SushiTiledImagePrivate *priv;
+};
+
+struct _SushiTiledImageClass
+{
+  GObjectClass parent_class;
+};
+
+GType    sushi_tiled_image_get_type     (void) G_GNUC_CONST;
+
+SushiTiledImage *sushi_tiled_image_new (GFile *file);
+
+void     sushi_tiled_image_load_async  (SushiTiledImage *self,
+                                        GCancellable *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer user_data);
+gboolean sushi_tiled_image_load_finish (SushiTiledImage *self,
+                                        GAsyncResult *result,
+                                        GError **error);
+
+void sushi_tiled_image_set_viewport (SushiTiledImage *self,
+                                     gint level,
+                                     gint x,
+                                     gint y,
+                                     gint width,
+                                     gint height);
+GdkPixbuf *sushi_tiled_image_get_tile (SushiTiledImage *self,
+                                       gint level,
+                                       gint col,
+                                       gint row);
+void sushi_tiled_image_cancel_all (SushiTiledImage *self);
+
+G_END_DECLS
+
+#endif /* __SUSHI_TILED_IMAGE_H__ */
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include <config.h>
+
+#include "sushi-trace.h"
+
+#include <gio/gio.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+typedef struct {
+  const gchar *phase;
+  gint64 time;
+} TraceMark;
+
+/* marks of the last preview, in the order they were hit; the phase
+ * names are interned, so they can be compared by pointer. Marks of
+ * other files, e.g. the ones prefetched around it, are left out.
+ */
+static GMutex trace_lock;
+static GArray *trace_marks = NULL;
+static gchar *trace_uri = NULL;
+static gint64 trace_start = 0;
+
+static void
+add_mark (const gchar *phase,
+          gint64 time)
+{
+  TraceMark mark;
+  guint idx;
+
+  /* only the first time a phase is reached counts */
+  for (idx = 0; idx < trace_marks->len; idx++) {
+    if (g_array_index (trace_marks, TraceMark, idx).phase == phase)
+      return;
+  }
+
+  mark.phase = phase;
+  mark.time = time;
+  g_array_append_val (trace_marks, mark);
+}
+
+/**
+ * sushi_trace_begin:
+ * @uri: the file about to be previewed
+ *
+ * Forgets the marks of the previous preview, and starts timing a new
+ * one from now.
+ */
+void
+sushi_trace_begin (const gchar *uri)
+{
+  gint64 now = g_get_monotonic_time ();
+  GFile *file;
+
+#ifdef HAVE_SYS_SDT_H
+  DTRACE_PROBE1 (sushi, preview_begin, uri);
+#endif
+
+  /* the same form as the URIs of the GFiles the marks come from */
+  file = g_file_new_for_uri (uri);
+
+  g_mutex_lock (&trace_lock);
+
+  if (trace_marks == NULL)
+    trace_marks = g_array_new (FALSE, FALSE, sizeof (TraceMark));
+
+  g_free (trace_uri);
+  trace_uri = g_file_get_uri (file);
+
+  g_array_set_size (trace_marks, 0);
+  trace_start = now;
+  add_mark (g_intern_static_string ("show-file"), now);
+
+  g_mutex_unlock (&trace_lock);
+
+  g_object_unref (file);
+
+  g_debug ("Preview of %s started", uri);
+}
+
+/**
+ * sushi_trace_mark:
+ * @uri: the file whose preview reached @phase
+ * @phase: the name of the phase that just completed
+ *
+ * Records that the preview of @uri reached @phase, if it's the
+ * current one. Marks are cheap and may be hit from any thread.
+ */
+void
+sushi_trace_mark (const gchar *uri,
+                  const gchar *phase)
+{
+  gint64 now = g_get_monotonic_time ();
+  gboolean current;
+
+#ifdef HAVE_SYS_SDT_H
+  DTRACE_PROBE2 (sushi, preview_mark, uri, phase);
+#endif
+
+  g_mutex_lock (&trace_lock);
+
+  current = (trace_marks != NULL && g_strcmp0 (uri, trace_uri) == 0);
+  if (current)
+    add_mark (g_intern_string (phase), now);
+
+  g_mutex_unlock (&trace_lock);
+
+  if (current)
+    g_debug ("Preview reached %s after %" G_GINT64_FORMAT " us",
+             phase, now - trace_start);
+}
+
+/**
+ * sushi_trace_get_last_timings:
+ *
+ * Returns: (transfer full): an a{sx} dictionary of the phases the last
+ *   preview went through, with the microseconds each was reached at
+ *   since it started
+ */
+GVariant *
+sushi_trace_get_last_timings (void)
+{
+  GVariantBuilder builder;
+  TraceMark *mark;
+  guint idx;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sx}"));
+
+  g_mutex_lock (&trace_lock);
+
+  for (idx = 0; trace_marks != NULL && idx < trace_marks->len; idx++) {
+    mark = &g_array_index (trace_marks, TraceMark, idx);
+    g_variant_builder_add (&builder, "{sx}",
+                           mark->phase, mark->time - trace_start);
+  }
+
+  g_mutex_unlock (&trace_lock);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
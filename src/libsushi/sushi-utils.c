@@ -64,6 +64,9 @@ sushi_query_supported_document_types (void)
   EvTypeInfo *info;
   gint idx;
 
+  /* this may be asked before any viewer initialized evince */
+  ev_init ();
+
   infos = ev_backends_manager_get_all_types_info ();
 
   if (infos == NULL)
@@ -83,3 +86,34 @@ sushi_query_supported_document_types (void)
 
   return retval;
 }
+
+/**
+ * sushi_clutter_image_set_pixbuf:
+ * @image: a #ClutterImage
+ * @pixbuf: a #GdkPixbuf
+ * @error:
+ *
+ * Uploads the pixels of @pixbuf into @image right from its buffer,
+ * rowstride and all, rather than through a copy of them in JS.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+sushi_clutter_image_set_pixbuf (ClutterImage *image,
+                                GdkPixbuf *pixbuf,
+                                GError **error)
+{
+  CoglPixelFormat format;
+
+  /* Cogl premultiplies the alpha on the way, if there's any */
+  format = gdk_pixbuf_get_has_alpha (pixbuf) ?
+    COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888;
+
+  return clutter_image_set_data (image,
+                                 gdk_pixbuf_get_pixels (pixbuf),
+                                 format,
+                                 gdk_pixbuf_get_width (pixbuf),
+                                 gdk_pixbuf_get_height (pixbuf),
+                                 gdk_pixbuf_get_rowstride (pixbuf),
+                                 error);
+}
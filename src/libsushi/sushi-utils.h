@@ -35,6 +35,10 @@ G_BEGIN_DECLS
 GdkWindow *    sushi_create_foreign_window (guint xid);
 gchar **       sushi_query_supported_document_types (void);
 
+gboolean       sushi_clutter_image_set_pixbuf (ClutterImage *image,
+                                               GdkPixbuf *pixbuf,
+                                               GError **error);
+
 G_END_DECLS
 
 #endif /* __SUSHI_UTILS_H__ */
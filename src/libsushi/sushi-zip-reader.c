@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#include "sushi-zip-reader.h"
+
+#include <string.h>
+
+/* Only the central directory is parsed when the archive is opened;
+ * entry data is never touched until it's extracted, so the pages of
+ * the mapping that back the rest of the document are never read in.
+ */
+
+#define EOCD_SIGNATURE           0x06054b50
+#define EOCD_SIZE                22
+#define ZIP64_LOCATOR_SIGNATURE  0x07064b50
+#define ZIP64_LOCATOR_SIZE       20
+#define ZIP64_EOCD_SIGNATURE     0x06064b50
+#define ZIP64_EOCD_SIZE          56
+#define CDIR_SIGNATURE           0x02014b50
+#define CDIR_SIZE                46
+#define LOCAL_SIGNATURE          0x04034b50
+#define LOCAL_SIZE               30
+#define ZIP64_EXTRA_ID           0x0001
+
+#define METHOD_STORED            0
+#define METHOD_DEFLATED          8
+
+/* refuse to inflate single entries bigger than this in memory;
+ * callers that need more should use sushi_zip_reader_open_entry().
+ */
+#define MAX_EXTRACT_SIZE         (64 * 1024 * 1024)
+
+typedef struct {
+  guint16 method;
+  guint64 compressed_size;
+  guint64 uncompressed_size;
+  guint64 local_offset;
+} SushiZipEntry;
+
+struct _SushiZipReader {
+  GMappedFile *mapped_file;
+  GBytes *bytes;
+
+  const guint8 *data;
+  gsize length;
+
+  GHashTable *entries;
+};
+
+static inline guint16
+read_u16 (const guint8 *p)
+{
+  return (guint16) (p[0] | (p[1] << 8));
+}
+
+static inline guint32
+read_u32 (const guint8 *p)
+{
+  return (guint32) p[0] | ((guint32) p[1] << 8) |
+    ((guint32) p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static inline guint64
+read_u64 (const guint8 *p)
+{
+  return (guint64) read_u32 (p) | ((guint64) read_u32 (p + 4) << 32);
+}
+
+static gboolean
+set_corrupt_error (GError **error)
+{
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Malformed or unsupported zip archive");
+  return FALSE;
+}
+
+static const guint8 *
+find_end_of_central_directory (SushiZipReader *self)
+{
+  const guint8 *p;
+  gsize offset, min_offset;
+
+  if (self->length < EOCD_SIZE)
+    return NULL;
+
+  /* the record is followed by a comment of at most 64k */
+  if (self->length > EOCD_SIZE + G_MAXUINT16)
+    min_offset = self->length - EOCD_SIZE - G_MAXUINT16;
+  else
+    min_offset = 0;
+
+  for (offset = self->length - EOCD_SIZE + 1; offset > min_offset; offset--) {
+    p = self->data + offset - 1;
+
+    if (read_u32 (p) == EOCD_SIGNATURE &&
+        offset - 1 + EOCD_SIZE + read_u16 (p + 20) <= self->length)
+      return p;
+  }
+
+  return NULL;
+}
+
+static void
+parse_zip64_extra (const guint8 *extra,
+                   guint16 extra_len,
+                   SushiZipEntry *entry,
+                   gboolean need_uncompressed,
+                   gboolean need_compressed,
+                   gboolean need_offset)
+{
+  const guint8 *end = extra + extra_len;
+
+  while (extra + 4 <= end) {
+    guint16 id = read_u16 (extra);
+    guint16 len = read_u16 (extra + 2);
+    const guint8 *field = extra + 4;
+    const guint8 *field_end = field + len;
+
+    if (field_end > end)
+      return;
+
+    if (id == ZIP64_EXTRA_ID) {
+      /* values are only present for the fields that overflowed,
+       * in this fixed order.
+       */
+      if (need_uncompressed && field + 8 <= field_end) {
+        entry->uncompressed_size = read_u64 (field);
+        field += 8;
+      }
+      if (need_compressed && field + 8 <= field_end) {
+        entry->compressed_size = read_u64 (field);
+        field += 8;
+      }
+      if (need_offset && field + 8 <= field_end)
+        entry->local_offset = read_u64 (field);
+
+      return;
+    }
+
+    extra = field_end;
+  }
+}
+
+static gboolean
+read_central_directory (SushiZipReader *self,
+                        GError **error)
+{
+  const guint8 *eocd, *p, *end;
+  guint64 n_entries, cdir_size, cdir_offset, idx;
+
+  eocd = find_end_of_central_directory (self);
+  if (eocd == NULL)
+    return set_corrupt_error (error);
+
+  n_entries = read_u16 (eocd + 10);
+  cdir_size = read_u32 (eocd + 12);
+  cdir_offset = read_u32 (eocd + 16);
+
+  if ((n_entries == G_MAXUINT16 ||
+       cdir_size == G_MAXUINT32 ||
+       cdir_offset == G_MAXUINT32) &&
+      eocd - self->data >= ZIP64_LOCATOR_SIZE) {
+    const guint8 *locator = eocd - ZIP64_LOCATOR_SIZE;
+    guint64 zip64_offset;
+
+    if (read_u32 (locator) == ZIP64_LOCATOR_SIGNATURE) {
+      zip64_offset = read_u64 (locator + 8);
+
+      if (self->length < ZIP64_EOCD_SIZE ||
+          zip64_offset > self->length - ZIP64_EOCD_SIZE ||
+          read_u32 (self->data + zip64_offset) != ZIP64_EOCD_SIGNATURE)
+        return set_corrupt_error (error);
+
+      p = self->data + zip64_offset;
+      n_entries = read_u64 (p + 32);
+      cdir_size = read_u64 (p + 40);
+      cdir_offset = read_u64 (p + 48);
+    }
+  }
+
+  if (cdir_offset > self->length ||
+      cdir_size > self->length - cdir_offset)
+    return set_corrupt_error (error);
+
+  p = self->data + cdir_offset;
+  end = p + cdir_size;
+
+  for (idx = 0; idx < n_entries; idx++) {
+    SushiZipEntry *entry;
+    guint16 name_len, extra_len, comment_len;
+    guint32 compressed, uncompressed, offset;
+
+    if (p + CDIR_SIZE > end || read_u32 (p) != CDIR_SIGNATURE)
+      return set_corrupt_error (error);
+
+    name_len = read_u16 (p + 28);
+    extra_len = read_u16 (p + 30);
+    comment_len = read_u16 (p + 32);
+
+    if (p + CDIR_SIZE + name_len + extra_len + comment_len > end)
+      return set_corrupt_error (error);
+
+    compressed = read_u32 (p + 20);
+    uncompressed = read_u32 (p + 24);
+    offset = read_u32 (p + 42);
+
+    entry = g_slice_new0 (SushiZipEntry);
+    entry->method = read_u16 (p + 10);
+    entry->compressed_size = compressed;
+    entry->uncompressed_size = uncompressed;
+    entry->local_offset = offset;
+
+    if (compressed == G_MAXUINT32 ||
+        uncompressed == G_MAXUINT32 ||
+        offset == G_MAXUINT32)
+      parse_zip64_extra (p + CDIR_SIZE + name_len, extra_len, entry,
+                         uncompressed == G_MAXUINT32,
+                         compressed == G_MAXUINT32,
+                         offset == G_MAXUINT32);
+
+    g_hash_table_insert (self->entries,
+                         g_strndup ((const gchar *) p + CDIR_SIZE, name_len),
+                         entry);
+
+    p += CDIR_SIZE + name_len + extra_len + comment_len;
+  }
+
+  return TRUE;
+}
+
+static void
+zip_entry_free (gpointer data)
+{
+  g_slice_free (SushiZipEntry, data);
+}
+
+/**
+ * sushi_zip_reader_new: (skip)
+ * @path: the local path of a zip archive
+ * @error:
+ *
+ * Maps @path in memory and reads its central directory.
+ *
+ * Returns: a new #SushiZipReader, or %NULL on error
+ */
+SushiZipReader *
+sushi_zip_reader_new (const gchar *path,
+                      GError **error)
+{
+  SushiZipReader *self;
+  GMappedFile *mapped_file;
+
+  mapped_file = g_mapped_file_new (path, FALSE, error);
+  if (mapped_file == NULL)
+    return NULL;
+
+  self = g_slice_new0 (SushiZipReader);
+  self->mapped_file = mapped_file;
+  self->bytes = g_mapped_file_get_bytes (mapped_file);
+  self->data = (const guint8 *) g_mapped_file_get_contents (mapped_file);
+  self->length = g_mapped_file_get_length (mapped_file);
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, zip_entry_free);
+
+  if (!read_central_directory (self, error)) {
+    sushi_zip_reader_free (self);
+    return NULL;
+  }
+
+  return self;
+}
+
+/**
+ * sushi_zip_reader_free: (skip)
+ * @self:
+ *
+ */
+void
+sushi_zip_reader_free (SushiZipReader *self)
+{
+  g_hash_table_destroy (self->entries);
+  g_bytes_unref (self->bytes);
+  g_mapped_file_unref (self->mapped_file);
+
+  g_slice_free (SushiZipReader, self);
+}
+
+/**
+ * sushi_zip_reader_has_entry: (skip)
+ * @self:
+ * @name:
+ *
+ */
+gboolean
+sushi_zip_reader_has_entry (SushiZipReader *self,
+                            const gchar *name)
+{
+  return g_hash_table_contains (self->entries, name);
+}
+
+static GBytes *
+get_entry_data (SushiZipReader *self,
+                const gchar *name,
+                SushiZipEntry **entry_out,
+                GError **error)
+{
+  SushiZipEntry *entry;
+  const guint8 *local;
+  guint64 data_offset;
+
+  entry = g_hash_table_lookup (self->entries, name);
+  if (entry == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                 "No entry named '%s' in the archive", name);
+    return NULL;
+  }
+
+  if (entry->method != METHOD_STORED &&
+      entry->method != METHOD_DEFLATED) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Unsupported compression method %d for '%s'",
+                 entry->method, name);
+    return NULL;
+  }
+
+  /* the local header repeats name and extra field, but the lengths
+   * may differ from the ones in the central directory.
+   */
+  if (entry->local_offset > self->length - LOCAL_SIZE)
+    goto corrupt;
+
+  local = self->data + entry->local_offset;
+  if (read_u32 (local) != LOCAL_SIGNATURE)
+    goto corrupt;
+
+  data_offset = entry->local_offset + LOCAL_SIZE +
+    read_u16 (local + 26) + read_u16 (local + 28);
+
+  if (data_offset > self->length ||
+      entry->compressed_size > self->length - data_offset)
+    goto corrupt;
+
+  *entry_out = entry;
+
+  return g_bytes_new_from_bytes (self->bytes, data_offset,
+                                 entry->compressed_size);
+
+ corrupt:
+  set_corrupt_error (error);
+  return NULL;
+}
+
+/**
+ * sushi_zip_reader_extract: (skip)
+ * @self:
+ * @name: the name of the entry in the archive
+ * @error:
+ *
+ * Extracts the whole contents of the entry @name in memory. Stored
+ * entries are returned without copying the data out of the mapping.
+ *
+ * Returns: the entry data, or %NULL on error
+ */
+GBytes *
+sushi_zip_reader_extract (SushiZipReader *self,
+                          const gchar *name,
+                          GError **error)
+{
+  SushiZipEntry *entry = NULL;
+  GConverter *decompressor;
+  GConverterResult res;
+  GBytes *compressed;
+  const guint8 *in;
+  guint8 *out;
+  gsize in_len, bytes_read, bytes_written;
+  gsize in_pos = 0, out_pos = 0;
+
+  compressed = get_entry_data (self, name, &entry, error);
+  if (compressed == NULL)
+    return NULL;
+
+  if (entry->method == METHOD_STORED)
+    return compressed;
+
+  if (entry->uncompressed_size > MAX_EXTRACT_SIZE) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                 "Entry '%s' is too big to be extracted in memory", name);
+    g_bytes_unref (compressed);
+    return NULL;
+  }
+
+  in = g_bytes_get_data (compressed, &in_len);
+  out = g_malloc (entry->uncompressed_size + 1);
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+
+  do {
+    res = g_converter_convert (decompressor,
+                               in + in_pos, in_len - in_pos,
+                               out + out_pos,
+                               entry->uncompressed_size + 1 - out_pos,
+                               G_CONVERTER_INPUT_AT_END,
+                               &bytes_read, &bytes_written,
+                               error);
+    in_pos += bytes_read;
+    out_pos += bytes_written;
+  } while (res == G_CONVERTER_CONVERTED &&
+           (bytes_read > 0 || bytes_written > 0) &&
+           out_pos <= entry->uncompressed_size);
+
+  g_object_unref (decompressor);
+  g_bytes_unref (compressed);
+
+  if (res == G_CONVERTER_ERROR) {
+    g_free (out);
+    return NULL;
+  }
+
+  if (res != G_CONVERTER_FINISHED ||
+      out_pos != entry->uncompressed_size) {
+    g_free (out);
+    set_corrupt_error (error);
+    return NULL;
+  }
+
+  return g_bytes_new_take (out, out_pos);
+}
+
+/**
+ * sushi_zip_reader_open_entry: (skip)
+ * @self:
+ * @name: the name of the entry in the archive
+ * @error:
+ *
+ * Opens a stream that inflates the entry @name as it's read, so that
+ * arbitrarily large entries can be consumed in constant memory.
+ * The stream keeps the mapping alive, and can outlive @self.
+ *
+ * Returns: (transfer full): a #GInputStream, or %NULL on error
+ */
+GInputStream *
+sushi_zip_reader_open_entry (SushiZipReader *self,
+                             const gchar *name,
+                             GError **error)
+{
+  SushiZipEntry *entry = NULL;
+  GConverter *decompressor;
+  GInputStream *stream, *retval;
+  GBytes *compressed;
+
+  compressed = get_entry_data (self, name, &entry, error);
+  if (compressed == NULL)
+    return NULL;
+
+  stream = g_memory_input_stream_new_from_bytes (compressed);
+  g_bytes_unref (compressed);
+
+  if (entry->method == METHOD_STORED)
+    return stream;
+
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+  retval = g_converter_input_stream_new (stream, decompressor);
+
+  g_object_unref (decompressor);
+  g_object_unref (stream);
+
+  return retval;
+}
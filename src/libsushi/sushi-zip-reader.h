@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2011 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Sushi project hereby grant permission for non-gpl compatible GStreamer
+ * plugins to be used and distributed together with GStreamer and Sushi. This
+ * permission is above and beyond the permissions granted by the GPL license
+ * Sushi is covered by.
+ *
+ */
+
+#ifndef __SUSHI_ZIP_READER_H__
+#define __SUSHI_ZIP_READER_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SushiZipReader SushiZipReader;
+
+SushiZipReader *sushi_zip_reader_new (const gchar *path,
+                                      GError **error);
+void sushi_zip_reader_free (SushiZipReader *self);
+
+gboolean sushi_zip_reader_has_entry (SushiZipReader *self,
+                                     const gchar *name);
+
+GBytes *sushi_zip_reader_extract (SushiZipReader *self,
+                                  const gchar *name,
+                                  GError **error);
+
+GInputStream *sushi_zip_reader_open_entry (SushiZipReader *self,
+                                           const gchar *name,
+                                           GError **error);
+
+G_END_DECLS
+
+#endif /* __SUSHI_ZIP_READER_H__ */